@@ -0,0 +1,16 @@
+# PlatformIO extra script: "pio run -e ESP32-size -t size_report" prints flash and RAM per
+# object from the linker map (extras/tools/size_report.py). Extra arguments, e.g. a budget:
+#   SIZE_REPORT_ARGS="--compare 1.2.0.json --budget-flash 1400000" pio run -e ESP32-size -t size_report
+import os
+
+Import("env")
+
+tool = os.path.normpath(os.path.join(env.subst("$PROJECT_DIR"), "..", "..", "extras", "tools", "size_report.py"))
+
+env.AddCustomTarget(
+    name="size_report",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions='"$PYTHONEXE" "%s" "$BUILD_DIR/${PROGNAME}.map" --filter "Sinric|Wally|WebSockets|NimBLE" %s' % (tool, os.environ.get("SIZE_REPORT_ARGS", "")),
+    title="Size report",
+    description="Flash and RAM per object file",
+)
@@ -1,12 +1,16 @@
 #pragma once
 
 #include "inc/WiFiManager.h"
+#include <JsonArena.h>
 
 // Define constants for setting types
 #define SET_WIFI_PRIMARY "pro.sinric::set.wifi.primary"
 #define SET_WIFI_SECONDARY "pro.sinric::set.wifi.secondary"
 #define SET_FIXED_IP_ADDRESS "pro.sinric::set.fixed.ip.address"
 
+// Product specific settings, handled in the sketch
+#define SET_OTA_CANCEL "ota.cancel"
+
 /**
  * @struct SetModuleSettingResult_t
  * @brief Represents the result of a module setting operation.
@@ -55,7 +59,7 @@ ModuleSettingsManager::~ModuleSettingsManager() {}
 SetModuleSettingResult_t ModuleSettingsManager::handleSetModuleSetting(const String& id, const String& value) {
   SetModuleSettingResult_t result = { false, "" };
 
-  JsonDocument doc;
+  JsonDocument doc(JsonArena::instance());
   DeserializationError error = deserializeJson(doc, value);
   if (error) {
     result.message = "handleSetModuleSetting::deserializeJson() failed: " + String(error.c_str());
@@ -5,6 +5,73 @@
 #define NO_HEART_BEAT_RESET_INTERVAL        900000          /* If there's no heart-beat ping-pong for 15 mins. reset ESP interval */
 #define BAUDRATE                            115200          /* Arduino Serial baud rate */
 #define WIFI_CONNECTION_TIMEOUT_MS          1000 * 60 * 10  /* WiFi connection timeout to reset ESP. default: 10 minutes */
+
+#define BUTTON_DEBOUNCE_MS                  50              /* Input must be stable this long before an edge is accepted */
+#define BUTTON_LONG_PRESS_MS                3000            /* Reset button: restart ESP32 when held longer than this */
+#define BUTTON_VERY_LONG_PRESS_MS           10000           /* Reset button: factory reset when held longer than this */
+#define BUTTON_TASK_STACK_SIZE              3072            /* Button debounce/classification task stack size */
+#define BUTTON_TASK_PRIORITY                5               /* Button task priority. Above the Arduino loop task */
+
+#if CONFIG_FREERTOS_UNICORE
+#define NETWORK_TASK_CORE                   0               /* Single core chip: everything shares core 0 */
+#define CONTROL_TASK_CORE                   0
+#else
+#define NETWORK_TASK_CORE                   0               /* SinricPro/TLS task shares the core with the WiFi/LWIP tasks */
+#define CONTROL_TASK_CORE                   1               /* Buttons and relays get the other core to themselves */
+#endif
+#define NETWORK_TASK_STACK_SIZE             8192            /* Same as the Arduino loop task it replaces (TLS, OTA) */
+#define NETWORK_TASK_PRIORITY               1
+#define CONTROL_TASK_STACK_SIZE             4096
+#define CONTROL_TASK_PRIORITY               3               /* Above the network task, mostly blocked on button events */
+#define CONTROL_TASK_POLL_MS                10              /* Upper bound on relay command latency from the server */
+#ifndef CONTROL_ON_NETWORK_TASK
+#define CONTROL_ON_NETWORK_TASK             false           /* Latency baseline: no control task, buttons and relays are polled by the network task as in the old loop() */
+#endif
+
+#ifndef HEALTH_COMPACT_REPORTS
+#define HEALTH_COMPACT_REPORTS              false           /* Opt in (-D HEALTH_COMPACT_REPORTS=1) once the backend merges partial reports: only values that changed since the last one are sent */
+#endif
+#define HEALTH_FULL_REPORT_EVERY            24              /* Every Nth compact report is complete, so the backend can resync */
+#define HEALTH_SENT_MAX_VALUES              768             /* Values remembered for compact reports (8 bytes each, taken only in compact mode) */
+#ifndef HEALTH_REPORT_ARENA_SIZE
+#define HEALTH_REPORT_ARENA_SIZE            24576           /* Arena of a report (PSRAM if available), about 19 KB at the limits. Compact mode takes a second one. Peak: "healthArena" */
+#endif
+#define METRICS_SAMPLE_PERIOD_MS            1000            /* Heap, RSSI, reconnect and loop latency sample period */
+#define METRICS_RING_SIZE                   300             /* Samples kept for the series (16 bytes each). Older ones still count in min/max/mean */
+#define METRICS_SERIES_POINTS               30              /* Points per series in the health report, each the worst of its samples */
+#define JOURNAL_PARTITION_LABEL             "journal"       /* Flash partition of the offline journal, e.g. Wally-PIO/partitions_journal.csv */
+#define JOURNAL_SAMPLE_PERIOD_MS            60000           /* Metric sample period while the server is unreachable (28 bytes each) */
+#define JOURNAL_UPLOAD_BATCH                32              /* Journal records per health report */
+#define BOOT_MAX_MARKS                      16              /* Boot phases recorded per boot (12 bytes each) */
+#define BOOT_HISTORY_SIZE                   5               /* Boots kept in NVS and reported, including the current one */
+
+#define EVENT_QUEUE_MAX_EVENTS_PER_SEC      1               /* Outbound power state events per second (all devices) */
+#define EVENT_QUEUE_RETRY_INTERVAL_MS       1000            /* Back-off before resending an event the SDK rejected */
+
+#define OTA_CHUNK_SIZE                      65536           /* OTA range request size. Multiple of the 4 KB flash sector */
+#define OTA_BUFFER_SIZE                     4096            /* OTA network read buffer */
+#define OTA_READ_TIMEOUT_MS                 10000           /* Give up on a range request after this long without data */
+#define OTA_MAX_RETRIES                     5               /* Consecutive failed range requests before giving up */
+#define OTA_RETRY_DELAY_MS                  2000            /* Back-off between retries, multiplied by the retry count */
+#define OTA_PIPELINE_BUFFERS                4               /* Buffers of OTA_BUFFER_SIZE shared by the network and flash stages */
+#define OTA_WRITER_TASK_STACK_SIZE          4096            /* Flash writer task stack size */
+#define OTA_WRITER_TASK_PRIORITY            2               /* Above the network task so buffers are recycled promptly */
+#define OTA_TASK_STACK_SIZE                 8192            /* Background OTA task (TLS, signature check) */
+#define OTA_TASK_PRIORITY                   1               /* Not above the network task, which must stay responsive */
+#define OTA_MAX_BYTES_PER_SEC               0               /* OTA download bandwidth cap. 0: unlimited */
+#define OTA_PEER_CACHE_ENABLED              false           /* Share the running firmware on the LAN (mDNS) and try peers before the origin */
+#define OTA_PEER_CACHE_PORT                 8070            /* HTTP port the firmware is shared on */
+#define OTA_PEER_TASK_STACK_SIZE            4096
+#define OTA_PEER_TASK_PRIORITY              1
+
+/* Require a detached signature (<image url>.sig) made with the matching private key:
+     openssl dgst -sha256 -sign ota_private.pem -out firmware.bin.sig firmware.bin */
+//#define OTA_SIGNING_PUBLIC_KEY            "-----BEGIN PUBLIC KEY-----\n...\n-----END PUBLIC KEY-----\n"
+
+/* Check the OTA server certificate. A pinned fingerprint adds no handshake cost, a CA certificate validates the chain:
+     openssl s_client -connect host:443 </dev/null | openssl x509 -noout -fingerprint -sha256 */
+//#define OTA_TLS_FINGERPRINT               "AB:CD:..."     /* SHA-256 fingerprint of the server certificate */
+//#define OTA_TLS_CA_CERT                   "-----BEGIN CERTIFICATE-----\n...\n-----END CERTIFICATE-----\n"
  
 #if !defined(ESP32)
 #error "Architecture not supported!"
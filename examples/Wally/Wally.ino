@@ -8,6 +8,8 @@
  *  Relays are connected to GPIO 27, 14
  *  Reset push button is connected to GPIO 0
  *  Status single color LED is connected to GPIO 13
+ *  SinricPro runs on a network task (core 0), buttons and relays on a control task (core 1)
+ *  OTA updates download on a background task; send the "ota.cancel" module setting to stop one
  *
  * @note This code supports ESP32 only.
  * @note To enable ESP32 logs: Tools -> Core Debug Level -> Verbose (to see provisioing and BLE logs)
@@ -36,6 +38,15 @@
 #include "inc/WiFiManager.h"
 #include "inc/HealthManager.h"
 #include "inc/OTAManager.h"
+#include "inc/ButtonManager.h"
+#include "inc/PowerStateEventQueue.h"
+#include "inc/SpscQueue.h"
+#include "inc/LatencyProfiler.h"
+#include "inc/MetricsSampler.h"
+#include "inc/FlashJournal.h"
+#include "inc/BootProfiler.h"
+#include "inc/AllocGuard.h"
+#include "inc/SerialLog.h"
 #include "WiFiProvisioningManager.h"
 #include "ModuleSettingsManager.h"
 
@@ -54,6 +65,15 @@ WiFiProvisioningManager g_provisioningManager(g_productConfig, g_wifiManager);
 ModuleSettingsManager g_moduleSettingsManager(g_wifiManager);
 OTAManager g_otaManager;
 HealthManager g_healthManager;
+ButtonManager g_buttonManager;
+PowerStateEventQueue g_eventQueue;
+LatencyProfiler g_latencyProfiler;
+MetricsSampler g_metricsSampler;
+FlashJournal g_journal;
+BootProfiler g_bootProfiler;
+#if OTA_PEER_CACHE_ENABLED
+OtaPeerCache g_otaPeerCache;
+#endif
 unsigned long g_lastHeartbeatMills = 0;
 
 // GPIO for push buttons
@@ -73,77 +93,113 @@ static uint8_t gpio_led = 13;
 /* Power statuses*/
 bool switch1_power_state = true;
 bool switch2_power_state = true;
- 
-struct WallyLightSwitch {
-  const uint8_t pin;
-  bool pressed;
-};
 
-// Define Wally light switches
-WallyLightSwitch switch_1 = {gpio_switch1, false};
-WallyLightSwitch switch_2 = {gpio_switch2, false};
-
-void ARDUINO_ISR_ATTR isr(void *arg) {
-  WallyLightSwitch *s = static_cast<WallyLightSwitch *>(arg);
-  s->pressed = true;
-}
+// Button ids assigned by ButtonManager
+int button_switch1 = -1;
+int button_switch2 = -1;
+int button_reset = -1;
 
 /**
  * @brief Clear settings and reboot the device.
  */
 void factoryResetAndReboot() {
+  BREADCRUMB("factory", 0);
   g_productConfig.clear();
   g_wifiManager.clear();
   ESP.restart();
 }
 
 /**
- * @brief Handles buttons for switch 1, switch 2 and reset
+ * @brief Relay state change passed between the network and control tasks.
  */
-void handleSwitchButtonPress() {
-   if (switch_1.pressed) {
-    Serial.printf("[handleSwitchButtonPress()]: Switch 1 has been changed\n");
-    switch_1.pressed = false;
-    
-    // Toggle switch 1 power state
-    switch1_power_state = !switch1_power_state;
-    Serial.printf("[handleSwitchButtonPress()]: Toggle State to %s.\n", switch1_power_state ? "true" : "false");
-
-    if (switch1_power_state) { digitalWrite(gpio_relay1, HIGH); } else { digitalWrite(gpio_relay1, LOW); };
-
-    // Update server
-    SinricProSwitch& mySwitch1 = SinricPro[g_config.switch_1_id];
-    mySwitch1.sendPowerStateEvent(switch1_power_state);
-
-  } else if (switch_2.pressed) {
-    Serial.printf("[handleSwitchButtonPress()]: Switch 2 has been changed\n");
-    switch_2.pressed = false;
-    
-    // Toggle switch 2 power state
-    switch2_power_state = !switch2_power_state;
-    Serial.printf("[handleSwitchButtonPress()]: Toggle State to %s.\n", switch2_power_state ? "true" : "false");
+struct SwitchState_t {
+  uint8_t channel;  ///< 0: switch 1, 1: switch 2
+  bool state;       ///< Relay power state
+};
 
-    if (switch2_power_state) { digitalWrite(gpio_relay2, HIGH); } else { digitalWrite(gpio_relay2, LOW); }
+// Network task -> control task: relay commands from the server.
+SpscQueue<SwitchState_t, 16> g_relayCommands;
+// Control task -> network task: local changes to report to the server.
+SpscQueue<SwitchState_t, 16> g_stateChanges;
+
+TaskHandle_t g_networkTask = nullptr;
+TaskHandle_t g_controlTask = nullptr;
+
+// Latency probes reported in the health report
+const int g_probeNetworkLoop = g_latencyProfiler.addProbe("networkLoop");
+const int g_probeControlLoop = g_latencyProfiler.addProbe("controlLoop");
+const int g_probeSinricProHandle = g_latencyProfiler.addProbe("sinricProHandle");
+const int g_probeOnPowerState = g_latencyProfiler.addProbe("onPowerState");
+const int g_probeOnSetModuleSetting = g_latencyProfiler.addProbe("onSetModuleSetting");
+const int g_probeOnOTAUpdate = g_latencyProfiler.addProbe("onOTAUpdate");
+// From the first ISR edge to the relay write, BUTTON_DEBOUNCE_MS included. Compare against CONTROL_ON_NETWORK_TASK builds.
+const int g_probeButtonToRelay = g_latencyProfiler.addProbe("buttonToRelay");
 
-    // Update server
-    SinricProSwitch& mySwitch2 = SinricPro[g_config.switch_2_id];
-    mySwitch2.sendPowerStateEvent(switch2_power_state);
+// Button to relay latency (us), measured on the control task. Includes BUTTON_DEBOUNCE_MS.
+uint32_t g_buttonLatencyMaxUs = 0;
+
+/**
+ * @brief Returns the device id for a relay channel.
+ */
+const char* channelDeviceId(uint8_t channel) {
+  return channel == 0 ? g_config.switch_1_id : g_config.switch_2_id;
+}
+
+/**
+ * @brief Drive a relay. Control task only.
+ */
+void setRelay(uint8_t channel, bool state) {
+  if (channel == 0) {
+    switch1_power_state = state;
+    if (switch1_power_state) { digitalWrite(gpio_relay1, HIGH); } else { digitalWrite(gpio_relay1, LOW); }
+  } else {
+    switch2_power_state = state;
+    if (switch2_power_state) { digitalWrite(gpio_relay2, HIGH); } else { digitalWrite(gpio_relay2, LOW); }
   }
+}
 
-  // Read external button to restart or factory reset
-  if (digitalRead(gpio_reset) == LOW) {  // Push button pressed
-    Serial.printf("[handleSwitchButtonPress()]: Reset Button Pressed!\n");
-    delay(100); // handle debounce
-    int startTime = millis();
-    while (digitalRead(gpio_reset) == LOW) {
-      delay(50);
-    }
-    int endTime = millis();
+/**
+ * @brief Toggle a relay and hand the new state to the network task. Control task only.
+ */
+void toggleSwitch(uint8_t channel, const ButtonEvent_t& event) {
+  bool state = !(channel == 0 ? switch1_power_state : switch2_power_state);
+  setRelay(channel, state);
+
+  uint32_t latencyUs = (uint32_t)(esp_timer_get_time() - event.timestamp);
+  if (latencyUs > g_buttonLatencyMaxUs) g_buttonLatencyMaxUs = latencyUs;
+  g_latencyProfiler.record(g_probeButtonToRelay, latencyUs * ESP.getCpuFreqMHz());  // probes count CPU cycles
+
+  serialPrintf("[toggleSwitch()]: Toggle State to %s. Button to relay: %u us (max: %u us)\n",
+               state ? "true" : "false", latencyUs, g_buttonLatencyMaxUs);
+
+  // Update server. Queued so rapid toggles are merged and nothing is lost while offline.
+  if (!g_stateChanges.push({ channel, state })) {
+    serialPrintf("[toggleSwitch()]: State change queue full!\n");
+  }
+}
 
-    if ((endTime - startTime) > 10000) {
+/**
+ * @brief Handles debounced button events for switch 1, switch 2 and reset. Control task only.
+ *
+ * The switches must not allocate (ALLOC_GUARD_SCOPE). The reset button is not a steady-state path.
+ */
+void handleSwitchButtonPress(const ButtonEvent_t& event) {
+  if (event.button == button_switch1) {
+    ALLOC_GUARD_SCOPE("switch");
+    serialPrintf("[handleSwitchButtonPress()]: Switch 1 has been changed\n");
+    toggleSwitch(0, event);
+  } else if (event.button == button_switch2) {
+    ALLOC_GUARD_SCOPE("switch");
+    serialPrintf("[handleSwitchButtonPress()]: Switch 2 has been changed\n");
+    toggleSwitch(1, event);
+  } else if (event.button == button_reset) {
+    // Read external button to restart or factory reset
+    Serial.printf("[handleSwitchButtonPress()]: Reset Button released after %u ms\n", event.duration);
+
+    if (event.type == BUTTON_EVENT_VERY_LONG_PRESS) {
       Serial.printf("[handleSwitchButtonPress()]: Reset to factory.\n"); // pressed for more than 10secs, reset all
       factoryResetAndReboot();
-    } else if ((endTime - startTime) > 3000) {
+    } else if (event.type == BUTTON_EVENT_LONG_PRESS) {
       Serial.printf("[handleSwitchButtonPress()]: Restart ESP32.\n");
       ESP.restart();
     }
@@ -151,21 +207,28 @@ void handleSwitchButtonPress() {
 }
 
 /**
- * @brief Callback function for power state changes
+ * @brief Callback function for power state changes. Runs on the network task.
  */
 bool onPowerState(const String& deviceId, bool& state) {
+  ScopedLatency latency(g_latencyProfiler, g_probeOnPowerState);
+  ALLOC_GUARD_SCOPE("powerState");
+  uint8_t channel;
   if (strcmp(g_config.switch_1_id, deviceId.c_str()) == 0) {
-    Serial.printf("[onPowerState()]: Change device: %s, power state changed to %s\r\n", deviceId.c_str(), state ? "on" : "off");
-    switch1_power_state = state;
-    if (switch1_power_state) { digitalWrite(gpio_relay1, HIGH); } else { digitalWrite(gpio_relay1, LOW); } ;
+    channel = 0;
   } else if (strcmp(g_config.switch_2_id, deviceId.c_str()) == 0) {
-    Serial.printf("[onPowerState()]: Change device: %s, power state changed to %s\r\n", deviceId.c_str(), state ? "on" : "off");
-    switch2_power_state = state;
-    if (switch2_power_state) { digitalWrite(gpio_relay2, HIGH); } else { digitalWrite(gpio_relay2, LOW); }
+    channel = 1;
   } else {
-    Serial.printf("[onPowerState()]: Device: %s not found!\r\n", deviceId.c_str());
+    serialPrintf("[onPowerState()]: Device: %s not found!\r\n", deviceId.c_str());
+    return true;
   }
 
+  serialPrintf("[onPowerState()]: Change device: %s, power state changed to %s\r\n", deviceId.c_str(), state ? "on" : "off");
+  g_eventQueue.confirm(channelDeviceId(channel), state);
+
+  if (!g_relayCommands.push({ channel, state })) {
+    serialPrintf("[onPowerState()]: Relay command queue full!\r\n");
+    return false;
+  }
   return true;
 }
 
@@ -173,6 +236,12 @@ bool onPowerState(const String& deviceId, bool& state) {
  * @brief Callback function for setting module settings 
  */
 bool onSetModuleSetting(const String& id, const String& value) {
+  ScopedLatency latency(g_latencyProfiler, g_probeOnSetModuleSetting);
+  if (id == SET_OTA_CANCEL) {
+    if (!g_otaManager.cancel()) SinricPro.setResponseMessage("No OTA update in progress.");
+    return true;
+  }
+
   SetModuleSettingResult_t result = g_moduleSettingsManager.handleSetModuleSetting(id, value);
   if (!result.success) {
     SinricPro.setResponseMessage(std::move(result.message));
@@ -181,9 +250,10 @@ bool onSetModuleSetting(const String& id, const String& value) {
 }
 
 /**
- * @brief Callback function for OTA updates
+ * @brief Callback function for OTA updates. Returns as soon as the update has started.
  */
 bool onOTAUpdate(const String& url, int major, int minor, int patch, bool forceUpdate) {
+  ScopedLatency latency(g_latencyProfiler, g_probeOnOTAUpdate);
   OtaUpdateResult_t result = g_otaManager.handleOTAUpdate(FIRMWARE_VERSION, url, major, minor, patch, forceUpdate);
   if (!result.success) {
     SinricPro.setResponseMessage(std::move(result.message));
@@ -203,12 +273,29 @@ void setupSinricPro() {
   SinricProSwitch& mySwitch2 = SinricPro[g_config.switch_2_id];
   mySwitch2.onPowerState(onPowerState);
 
+  g_eventQueue.addDevice(g_config.switch_1_id);
+  g_eventQueue.addDevice(g_config.switch_2_id);
+
   SinricPro.onConnected([]() {
     Serial.printf("[setupSinricPro()]: Connected to SinricPro\r\n");
+    BREADCRUMB("srvConn", ESP.getFreeHeap());
+    TRACE_INSTANT("srvConn");
+    g_journal.setOnline(true);
+    g_eventQueue.flush();
+
+    static bool firstConnect = true;
+    if (firstConnect) {
+      firstConnect = false;
+      g_bootProfiler.mark("cloud");
+      g_bootProfiler.save();
+    }
   });
 
   SinricPro.onDisconnected([]() {
     Serial.printf("[setupSinricPro()]: Disconnected from SinricPro\r\n");
+    BREADCRUMB("srvDisc", ESP.getFreeHeap());
+    TRACE_INSTANT("srvDisc");
+    g_journal.setOnline(false);
   });
 
   SinricPro.onPong([](uint32_t since) {
@@ -217,6 +304,13 @@ void setupSinricPro() {
 
   // SinricPro.restoreDeviceStates(true); If you want to restore the last know state from server!
 
+  g_healthManager.begin();
+  g_healthManager.setLatencyProfiler(&g_latencyProfiler);
+  g_healthManager.setOTAManager(&g_otaManager);
+  g_healthManager.setMetricsSampler(&g_metricsSampler);
+  g_healthManager.setJournal(&g_journal);
+  g_healthManager.setBootProfiler(&g_bootProfiler);
+  g_healthManager.setCompact(HEALTH_COMPACT_REPORTS);
   SinricPro.onReportHealth([&](String& healthReport) {
     return g_healthManager.reportHealth(healthReport);
   });
@@ -235,12 +329,14 @@ void setupSinricPro() {
 void setupPins() {
   Serial.printf("[setupPins()]: Setup pin definition.\r\n");
   
-  // Configure the input GPIOs
-  pinMode(gpio_reset, INPUT);
-  pinMode(switch_1.pin, INPUT_PULLUP);
-  attachInterruptArg(switch_1.pin, isr, &switch_1, CHANGE);
-  pinMode(switch_2.pin, INPUT_PULLUP);
-  attachInterruptArg(switch_2.pin, isr, &switch_2, CHANGE);
+  // Configure the input GPIOs. Edges are debounced and classified by ButtonManager.
+  button_reset = g_buttonManager.addButton(gpio_reset, BUTTON_MODE_PUSH, INPUT);
+  button_switch1 = g_buttonManager.addButton(gpio_switch1, BUTTON_MODE_TOGGLE, INPUT_PULLUP);
+  button_switch2 = g_buttonManager.addButton(gpio_switch2, BUTTON_MODE_TOGGLE, INPUT_PULLUP);
+
+  if (!g_buttonManager.begin()) {
+    Serial.printf("[setupPins()]: Button setup failed!\r\n");
+  }
 
   // Set the Relays GPIOs as output mode
   pinMode(gpio_relay1, OUTPUT);
@@ -308,6 +404,22 @@ void setupConfig() {
   } 
 }
  
+/**
+ * @brief Sample heap, RSSI, WiFi reconnects and network loop latency for the health report.
+ */
+void setupMetrics() {
+  g_metricsSampler.setLoopProbe(&g_latencyProfiler, g_probeNetworkLoop);
+  g_metricsSampler.begin();
+}
+
+/**
+ * @brief Record samples and events in flash while the server is unreachable.
+ */
+void setupJournal() {
+  g_journal.setMetricsSampler(&g_metricsSampler);
+  g_journal.begin();
+}
+
 /**
  * @brief Connects to WiFi 
  */
@@ -331,24 +443,135 @@ void setupWiFi() {
   }
 }
 
+/**
+ * @brief Share the running firmware with other devices on the LAN and download from them first.
+ */
+void setupOtaPeerCache() {
+#if OTA_PEER_CACHE_ENABLED
+  if (g_otaPeerCache.begin(FIRMWARE_VERSION)) {
+    g_otaManager.setPeerCache(&g_otaPeerCache);
+  }
+#endif
+}
+
+/**
+ * @brief Serial debug commands: 't' prints the trace events (built with TRACE_EVENT_COUNT).
+ */
+void handleSerialCommands() {
+  while (Serial.available()) {
+    if (Serial.read() == 't') ProvTrace::dump(Serial);
+  }
+}
+
+/**
+ * @brief Handle the next button event, waiting up to the given time, and the pending relay commands.
+ */
+void controlStep(TickType_t ticksToWait) {
+  ButtonEvent_t event;
+  bool hasEvent = g_buttonManager.waitEvent(event, ticksToWait);
+
+  ScopedLatency loopLatency(g_latencyProfiler, g_probeControlLoop);  // excludes the wait above
+  if (hasEvent) {
+    handleSwitchButtonPress(event);
+  }
+
+  ALLOC_GUARD_SCOPE("relayCommands");
+  SwitchState_t command;
+  while (g_relayCommands.pop(command)) {
+    setRelay(command.channel, command.state);
+  }
+}
+
+/**
+ * @brief Networking task: SinricPro websocket/TLS, heartbeat and outbound events.
+ */
+void networkTask(void* arg) {
+  while (true) {
+    {
+      ScopedLatency loopLatency(g_latencyProfiler, g_probeNetworkLoop);
+      {
+        ScopedLatency handleLatency(g_latencyProfiler, g_probeSinricProHandle);
+        SinricPro.handle();
+      }
+      handleNoHeartbeat();
+
+      {
+        ALLOC_GUARD_SCOPE("stateChanges");
+        SwitchState_t change;
+        while (g_stateChanges.pop(change)) {
+          if (!g_journal.isOnline()) g_journal.record(JOURNAL_STATE, &change, sizeof(change));
+          g_eventQueue.enqueue(channelDeviceId(change.channel), change.state);
+        }
+      }
+      g_eventQueue.handle();  // the SDK builds the event message on the heap
+      g_journal.handle();
+#if TRACE_EVENT_COUNT > 0
+      handleSerialCommands();
+#endif
+    }
+#if CONTROL_ON_NETWORK_TASK
+    controlStep(0);  // baseline: buttons wait for SinricPro.handle() like they did in loop()
+#endif
+
+    vTaskDelay(1);  // let lower priority tasks on this core run
+  }
+}
+
+/**
+ * @brief Control task: buttons and relays. Never waits on the network.
+ */
+void controlTask(void* arg) {
+  while (true) {
+    controlStep(pdMS_TO_TICKS(CONTROL_TASK_POLL_MS));
+  }
+}
+
+/**
+ * @brief Start the control task and the networking task on separate cores.
+ */
+void setupTasks() {
+  Serial.printf("[setupTasks()]: Starting network task on core %d, control task on core %d.\r\n", NETWORK_TASK_CORE, CONTROL_TASK_CORE);
+
+#if !CONTROL_ON_NETWORK_TASK
+  xTaskCreatePinnedToCore(controlTask, "ControlTask", CONTROL_TASK_STACK_SIZE, nullptr, CONTROL_TASK_PRIORITY, &g_controlTask, CONTROL_TASK_CORE);
+#endif
+  xTaskCreatePinnedToCore(networkTask, "NetworkTask", NETWORK_TASK_STACK_SIZE, nullptr, NETWORK_TASK_PRIORITY, &g_networkTask, NETWORK_TASK_CORE);
+}
+
 void setup() {
+  g_bootProfiler.begin(FIRMWARE_VERSION);
+
   Serial.begin(BAUDRATE);
   Serial.println();
   delay(1000);
+  g_bootProfiler.mark("serial");
 
   Serial.printf("Firmware: %s, SinricPro SDK: %s, Business SDK:%s\n", 
                 FIRMWARE_VERSION, SINRICPRO_VERSION, BUSINESS_SDK_VERSION);
 
+  JsonArena::instance()->begin();  // PSRAM, if any, joined the heap after the static constructors
   setupSPIFFS();
+  g_bootProfiler.mark("spiffs");
   setupPins();
+  g_bootProfiler.mark("pins");
   setupConfig();
+  g_bootProfiler.mark("config");
+  setupMetrics();
+  setupJournal();
+  g_bootProfiler.mark("journal");
   setupWiFi();
+  g_bootProfiler.mark("wifi");
+  setupOtaPeerCache();
   setupSinricPro();
+  g_bootProfiler.mark("sinric");
+  setupTasks();
+  g_bootProfiler.mark("tasks");
+  g_bootProfiler.save();
+  BREADCRUMB("setup", ESP.getFreeHeap());
+  ALLOC_GUARD_ARM();  // from here on the guarded paths must not allocate
 }
 
 void loop() {
-  SinricPro.handle();
-  handleNoHeartbeat();
-  handleSwitchButtonPress();
-  // Note: Avoid using delay() in the loop. Use non-blocking techniques for timing.
+  // All work runs in networkTask() and controlTask(). The Arduino loop task is not needed.
+  vTaskDelete(NULL);
 }
@@ -86,22 +86,14 @@ bool WiFiProvisioningManager::beginProvision(String productId) {
     return false;
   });
 
-  // Callback for cloud credentials
-  prov.onCloudCredentials([this](const String& config) -> bool {
-    JsonDocument jsonConfig;
-    DeserializationError error = deserializeJson(jsonConfig, config);
-
-    if (error) {
-      Serial.printf("[WiFiProvisioningManager.beginProvision()]: deserializeJson() failed: %s\n", error.c_str());
-      return false;
+  // Callback for cloud credentials. config is the decrypted BLE buffer, saved without a copy.
+  prov.onCloudCredentials([this](const char* config, size_t length) -> bool {
+    if (m_ProductConfigManager.saveConfig(config, length)) {
+      Serial.println(F("[WiFiProvisioningManager.beginProvision()]: Configuration updated!"));
+      return true;
     } else {
-      if (m_ProductConfigManager.saveJsonConfig(jsonConfig)) {
-        Serial.println(F("[WiFiProvisioningManager.beginProvision()]: Configuration updated!"));
-        return true;
-      } else {
-        Serial.println(F("[WiFiProvisioningManager.beginProvision()]: Failed to save configuration!"));
-        return false;
-      }
+      Serial.println(F("[WiFiProvisioningManager.beginProvision()]: Failed to save configuration!"));
+      return false;
     }
   });
 
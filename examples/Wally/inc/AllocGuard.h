@@ -0,0 +1,215 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <atomic>
+#include <esp_rom_sys.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifndef ALLOC_GUARD
+#define ALLOC_GUARD                 0  ///< Count heap allocations in ALLOC_GUARD_SCOPE blocks. Link with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+#endif
+#ifndef ALLOC_GUARD_ABORT
+#define ALLOC_GUARD_ABORT           0  ///< Abort on the first allocation in a scope, so the backtrace shows the caller
+#endif
+#define ALLOC_GUARD_MAX_TASKS       4  ///< Tasks that can be inside a scope at the same time
+#define ALLOC_GUARD_MAX_VIOLATIONS  4  ///< Allocations kept for the health report
+
+#if ALLOC_GUARD
+
+/**
+ * @struct AllocViolation_t
+ * @brief A heap allocation made inside a guarded scope.
+ */
+struct AllocViolation_t {
+  const char* scope;  ///< Scope the allocating task entered last
+  uint32_t size;      ///< Bytes requested
+  void* caller;       ///< Return address into the code that called malloc/calloc/realloc
+};
+
+/**
+ * @class AllocGuard
+ * @brief Checks that the steady-state paths do not touch the heap.
+ *
+ * malloc, calloc and realloc are wrapped at link time (the ESP32-alloc-guard environment).
+ * Once arm() is called at the end of setup(), every allocation made by a task inside an
+ * ALLOC_GUARD_SCOPE block is counted, printed with esp_rom_printf and, with ALLOC_GUARD_ABORT,
+ * aborts. Decode the caller with addr2line -pfiaC -e firmware.elf <caller>.
+ *
+ *     void onPowerState(...) {
+ *       ALLOC_GUARD_SCOPE("powerState");
+ *       ...
+ *     }
+ *
+ * The check is a load and a compare per allocation until a task is inside a scope.
+ */
+class AllocGuard {
+public:
+  /**
+     * @brief Start checking. Call once initialisation is done.
+     */
+  static void arm();
+
+  /**
+     * @brief Enter a scope on the calling task. Scopes nest.
+     * @param name Scope name, reported with violations. Must stay valid.
+     */
+  static void enter(const char* name);
+
+  /**
+     * @brief Leave the innermost scope of the calling task.
+     */
+  static void leave();
+
+  /**
+     * @brief Called by the wrapped allocator.
+     */
+  static void check(size_t size, void* caller);
+
+  /**
+     * @brief Add the violation count and the first violations to a JSON object.
+     * @param doc Target JSON object.
+     */
+  static void addAllocGuardInfo(JsonObject& doc);
+
+private:
+  struct Scope_t {
+    TaskHandle_t task;
+    const char* name;
+    uint8_t depth;
+  };
+
+  static std::atomic<bool> s_armed;
+  static std::atomic<uint8_t> s_active;  ///< Tasks inside a scope
+  static std::atomic<uint32_t> s_violations;
+  static portMUX_TYPE s_lock;
+  static Scope_t s_scopes[ALLOC_GUARD_MAX_TASKS];
+  static AllocViolation_t s_first[ALLOC_GUARD_MAX_VIOLATIONS];
+};
+
+/**
+ * @class AllocGuardScope
+ * @brief Guards the rest of the enclosing block.
+ */
+class AllocGuardScope {
+public:
+  explicit AllocGuardScope(const char* name) { AllocGuard::enter(name); }
+  ~AllocGuardScope() { AllocGuard::leave(); }
+  AllocGuardScope(const AllocGuardScope&) = delete;
+  AllocGuardScope& operator=(const AllocGuardScope&) = delete;
+};
+
+#define ALLOC_GUARD_SCOPE(name)  AllocGuardScope allocGuardScope(name)
+#define ALLOC_GUARD_ARM()        AllocGuard::arm()
+
+std::atomic<bool> AllocGuard::s_armed(false);
+std::atomic<uint8_t> AllocGuard::s_active(0);
+std::atomic<uint32_t> AllocGuard::s_violations(0);
+portMUX_TYPE AllocGuard::s_lock = portMUX_INITIALIZER_UNLOCKED;
+AllocGuard::Scope_t AllocGuard::s_scopes[ALLOC_GUARD_MAX_TASKS] = {};
+AllocViolation_t AllocGuard::s_first[ALLOC_GUARD_MAX_VIOLATIONS] = {};
+
+void AllocGuard::arm() {
+  s_armed.store(true, std::memory_order_release);
+}
+
+void AllocGuard::enter(const char* name) {
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
+  portENTER_CRITICAL(&s_lock);
+  Scope_t* scope = nullptr;
+  for (Scope_t& entry : s_scopes) {
+    if (entry.task == task) { scope = &entry; break; }
+    if (!scope && !entry.task) scope = &entry;
+  }
+  if (scope) {
+    if (!scope->task) s_active.fetch_add(1, std::memory_order_relaxed);
+    scope->task = task;
+    scope->name = name;  // most recently entered
+    scope->depth++;
+  }
+  portEXIT_CRITICAL(&s_lock);
+}
+
+void AllocGuard::leave() {
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
+  portENTER_CRITICAL(&s_lock);
+  for (Scope_t& entry : s_scopes) {
+    if (entry.task != task) continue;
+    if (--entry.depth == 0) {
+      entry.task = nullptr;
+      s_active.fetch_sub(1, std::memory_order_relaxed);
+    }
+    break;
+  }
+  portEXIT_CRITICAL(&s_lock);
+}
+
+void AllocGuard::check(size_t size, void* caller) {
+  // Runs on every allocation: nothing but loads until a task is inside a scope.
+  if (!s_armed.load(std::memory_order_relaxed) || !s_active.load(std::memory_order_relaxed)) return;
+
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  const char* name = nullptr;
+  for (const Scope_t& entry : s_scopes) {
+    if (entry.task == task) { name = entry.name; break; }
+  }
+  if (!name) return;
+
+  uint32_t index = s_violations.fetch_add(1, std::memory_order_relaxed);
+  if (index >= ALLOC_GUARD_MAX_VIOLATIONS) return;
+  s_first[index] = { name, (uint32_t)size, caller };
+
+  // Serial could allocate and recurse. The ROM printer does not.
+  esp_rom_printf("[AllocGuard.check()]: %u byte allocation in \"%s\" from %p\r\n", (unsigned)size, name, caller);
+#if ALLOC_GUARD_ABORT
+  abort();
+#endif
+}
+
+void AllocGuard::addAllocGuardInfo(JsonObject& doc) {
+  uint32_t violations = s_violations.load(std::memory_order_relaxed);
+  doc["armed"] = s_armed.load(std::memory_order_relaxed);
+  doc["violations"] = violations;
+
+  JsonArray first = doc["first"].to<JsonArray>();  // [scope, bytes, caller]
+  for (uint32_t i = 0; i < violations && i < ALLOC_GUARD_MAX_VIOLATIONS; i++) {
+    char caller[12];
+    snprintf(caller, sizeof(caller), "%p", s_first[i].caller);
+
+    JsonArray entry = first.add<JsonArray>();
+    entry.add(s_first[i].scope);
+    entry.add(s_first[i].size);
+    entry.add(caller);
+  }
+}
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+  AllocGuard::check(size, __builtin_return_address(0));
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  AllocGuard::check(count * size, __builtin_return_address(0));
+  return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  AllocGuard::check(size, __builtin_return_address(0));
+  return __real_realloc(ptr, size);
+}
+}
+
+#else
+
+#define ALLOC_GUARD_SCOPE(name)
+#define ALLOC_GUARD_ARM()
+
+#endif
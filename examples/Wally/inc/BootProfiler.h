@@ -0,0 +1,205 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <WiFi.h>
+#include <Preferences.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_cpu.h>
+
+#ifndef BOOT_LOADER_CPU_MHZ
+#define BOOT_LOADER_CPU_MHZ  80  ///< CPU clock of the second stage bootloader, for the time before the app
+#endif
+
+/**
+ * @struct BootMark_t
+ * @brief A named point of the boot. 12 bytes.
+ */
+struct BootMark_t {
+  char name[8];  ///< Not terminated when 8 characters long
+  uint32_t ms;   ///< Since the app timer started
+};
+
+/**
+ * @struct BootRecord_t
+ * @brief Timeline of one boot, as stored in NVS.
+ */
+struct BootRecord_t {
+  uint32_t boot;                        ///< Boot counter
+  char version[16];                     ///< Firmware version
+  uint32_t preAppMs;                    ///< Reset until the app timer started (ROM, bootloader, image load), estimated. UINT32_MAX: unknown
+  uint8_t reason;                       ///< esp_reset_reason_t
+  uint8_t count;                        ///< Marks used
+  uint16_t reserved;
+  BootMark_t marks[BOOT_MAX_MARKS];
+};
+
+/**
+ * @class BootProfiler
+ * @brief Times the phases of a boot up to the first cloud connection and keeps the last boots.
+ *
+ * mark() records the end of a phase in ms since the app timer started, once per name. WiFi
+ * association ("assoc") and DHCP ("dhcp") are marked from WiFi events.
+ *
+ * The time before the app is estimated from the cycle counter of core 0, which starts at
+ * every reset. It is read by a static constructor, before setup(), together with
+ * esp_timer_get_time(). The cycles the app ran at the current CPU clock are subtracted, and
+ * the rest is taken to run at BOOT_LOADER_CPU_MHZ. The ROM stage runs slower, so the estimate
+ * is a little short. Chips without an Xtensa core do not report it.
+ *
+ * The last BOOT_HISTORY_SIZE boots are kept in NVS, one record per key, and reported newest first:
+ *
+ *     "boot": [{"boot": 12, "version": "1.2.0", "reason": 3, "preApp": 310, "marks": {"setup": 402, "spiffs": 455, ..., "cloud": 5230}}, ...]
+ */
+class BootProfiler {
+public:
+  BootProfiler();
+
+  /**
+     * @brief Start the record of this boot. Call first in setup().
+     * @param version Firmware version.
+     */
+  void begin(const char* version);
+
+  /**
+     * @brief Mark the end of a phase. Later marks with the same name are ignored. Any task.
+     * @param name Up to 8 characters.
+     */
+  void mark(const char* name);
+
+  /**
+     * @brief Store the record of this boot in NVS. Call after setup() and after the first cloud connection.
+     */
+  void save();
+
+  /**
+     * @brief Add this boot and the previous ones to a JSON array.
+     * @param doc Target JSON array.
+     */
+  void addBootInfo(JsonArray& doc);
+
+private:
+  static void addRecord(JsonArray& doc, const BootRecord_t& record);
+
+  portMUX_TYPE m_lock;
+  BootRecord_t m_record;
+  bool m_begin;
+  uint8_t m_historyCount;
+  BootRecord_t m_history[BOOT_HISTORY_SIZE - 1];  ///< Previous boots, newest first
+};
+
+static_assert(BOOT_HISTORY_SIZE >= 2, "BOOT_HISTORY_SIZE includes the current boot");
+
+static uint32_t s_bootCycles;    ///< Core 0 cycle count when static constructors run
+static int64_t s_bootTimerUs;    ///< esp_timer_get_time() at the same moment
+static uint32_t s_bootCpuMhz;
+
+// Static constructors run on core 0, whose cycle counter has been counting since the reset.
+static void __attribute__((constructor)) readBootClocks() {
+  s_bootTimerUs = esp_timer_get_time();
+  s_bootCycles = esp_cpu_get_cycle_count();
+  s_bootCpuMhz = getCpuFrequencyMhz();
+}
+
+BootProfiler::BootProfiler()
+  : m_lock(portMUX_INITIALIZER_UNLOCKED), m_record(), m_begin(false), m_historyCount(0) {}
+
+void BootProfiler::begin(const char* version) {
+  if (m_begin) return;
+
+  esp_reset_reason_t reason = esp_reset_reason();
+
+  m_record.preAppMs = UINT32_MAX;
+#if __XTENSA__
+  uint64_t appCycles = (uint64_t)s_bootTimerUs * s_bootCpuMhz;
+  if (s_bootCpuMhz && s_bootCycles > appCycles) m_record.preAppMs = (s_bootCycles - appCycles) / (BOOT_LOADER_CPU_MHZ * 1000);
+#endif
+
+  m_record.reason = reason;
+  strlcpy(m_record.version, version, sizeof(m_record.version));
+
+  // The previous boots are read here, not per report, so reports do not touch NVS.
+  Preferences preferences;
+  if (preferences.begin("boot", false)) {
+    m_record.boot = preferences.getULong("count", 0) + 1;
+    preferences.putULong("count", m_record.boot);
+    for (uint32_t back = 1; back < BOOT_HISTORY_SIZE && back < m_record.boot; back++) {
+      uint32_t boot = m_record.boot - back;
+      char key[8];
+      snprintf(key, sizeof(key), "r%u", (unsigned)(boot % BOOT_HISTORY_SIZE));
+      BootRecord_t& record = m_history[m_historyCount];
+      if (preferences.getBytes(key, &record, sizeof(record)) == sizeof(record) && record.boot == boot) m_historyCount++;
+    }
+    preferences.end();
+  }
+
+  WiFi.onEvent([this](WiFiEvent_t event, WiFiEventInfo_t info) {
+    mark("assoc");
+  }, ARDUINO_EVENT_WIFI_STA_CONNECTED);
+  WiFi.onEvent([this](WiFiEvent_t event, WiFiEventInfo_t info) {
+    mark("dhcp");
+  }, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+
+  m_begin = true;
+  mark("setup");
+}
+
+void BootProfiler::mark(const char* name) {
+  uint32_t ms = esp_timer_get_time() / 1000;
+
+  portENTER_CRITICAL(&m_lock);
+  bool found = false;
+  for (uint8_t i = 0; i < m_record.count && !found; i++) {
+    found = strncmp(m_record.marks[i].name, name, sizeof(m_record.marks[i].name)) == 0;
+  }
+  if (!found && m_record.count < BOOT_MAX_MARKS) {
+    BootMark_t& entry = m_record.marks[m_record.count++];
+    strncpy(entry.name, name, sizeof(entry.name));
+    entry.ms = ms;
+  }
+  portEXIT_CRITICAL(&m_lock);
+}
+
+void BootProfiler::save() {
+  if (!m_begin) return;
+
+  BootRecord_t record;
+  portENTER_CRITICAL(&m_lock);
+  record = m_record;
+  portEXIT_CRITICAL(&m_lock);
+
+  Preferences preferences;
+  if (!preferences.begin("boot", false)) return;
+  char key[8];
+  snprintf(key, sizeof(key), "r%u", (unsigned)(record.boot % BOOT_HISTORY_SIZE));
+  preferences.putBytes(key, &record, sizeof(record));
+  preferences.end();
+}
+
+void BootProfiler::addRecord(JsonArray& doc, const BootRecord_t& record) {
+  JsonObject entry = doc.add<JsonObject>();
+  entry["boot"] = record.boot;
+  entry["version"] = record.version;
+  entry["reason"] = record.reason;
+  if (record.preAppMs != UINT32_MAX) entry["preApp"] = record.preAppMs;
+
+  JsonObject marks = entry["marks"].to<JsonObject>();
+  for (uint8_t i = 0; i < record.count && i < BOOT_MAX_MARKS; i++) {
+    char name[sizeof(record.marks[i].name) + 1];
+    strlcpy(name, record.marks[i].name, sizeof(name));
+    marks[name] = record.marks[i].ms;
+  }
+}
+
+void BootProfiler::addBootInfo(JsonArray& doc) {
+  if (!m_begin) return;
+
+  BootRecord_t record;
+  portENTER_CRITICAL(&m_lock);
+  record = m_record;
+  portEXIT_CRITICAL(&m_lock);
+
+  addRecord(doc, record);
+  for (uint8_t i = 0; i < m_historyCount; i++) addRecord(doc, m_history[i]);
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "SpscQueue.h"
+
+#define BUTTON_MAX_COUNT  8  ///< Maximum number of buttons handled by ButtonManager
+
+/**
+ * @enum ButtonMode_t
+ * @brief How the input attached to a GPIO behaves.
+ */
+enum ButtonMode_t : uint8_t {
+  BUTTON_MODE_TOGGLE,  ///< Wall (latching) switch. Every settled level change is an event.
+  BUTTON_MODE_PUSH     ///< Active LOW momentary push button. Classified by press duration on release.
+};
+
+/**
+ * @enum ButtonEventType_t
+ * @brief Debounced and classified button events.
+ */
+enum ButtonEventType_t : uint8_t {
+  BUTTON_EVENT_TOGGLE,           ///< Toggle switch changed position
+  BUTTON_EVENT_SHORT_PRESS,      ///< Push button released before BUTTON_LONG_PRESS_MS
+  BUTTON_EVENT_LONG_PRESS,       ///< Push button held longer than BUTTON_LONG_PRESS_MS
+  BUTTON_EVENT_VERY_LONG_PRESS   ///< Push button held longer than BUTTON_VERY_LONG_PRESS_MS
+};
+
+/**
+ * @struct ButtonEvent_t
+ * @brief A single button event delivered to the application.
+ */
+struct ButtonEvent_t {
+  uint8_t button;          ///< Button id returned by ButtonManager::addButton()
+  ButtonEventType_t type;  ///< Event type
+  int64_t timestamp;       ///< esp_timer time (us) of the first edge that caused this event
+  uint32_t duration;       ///< Press duration in ms (push buttons only)
+};
+
+/**
+ * @class ButtonManager
+ * @brief Interrupt driven GPIO event subsystem.
+ *
+ * The GPIO ISR pushes timestamped edges into a lock-free queue. A dedicated task drains
+ * the queue, debounces each input with an esp_timer one-shot and classifies the settled
+ * result. Classified events are handed to the application through a FreeRTOS queue, so
+ * nothing in the network loop ever waits for a button.
+ */
+class ButtonManager {
+public:
+  ButtonManager();
+  ~ButtonManager();
+
+  /**
+     * @brief Register a GPIO input. Must be called before begin().
+     * @param pin GPIO number.
+     * @param mode Toggle switch or push button.
+     * @param inputMode Arduino pin mode (INPUT or INPUT_PULLUP).
+     * @return Button id (>= 0) on success, -1 on failure.
+     */
+  int addButton(uint8_t pin, ButtonMode_t mode, uint8_t inputMode = INPUT_PULLUP);
+
+  /**
+     * @brief Create the button task, debounce timers and attach the interrupts.
+     * @return True on success, otherwise false.
+     */
+  bool begin();
+
+  /**
+     * @brief Get the next button event without blocking.
+     * @param event Receives the event.
+     * @return True if an event was returned.
+     */
+  bool getEvent(ButtonEvent_t& event);
+
+  /**
+     * @brief Get the next button event, waiting up to the given time.
+     * @param event Receives the event.
+     * @param ticksToWait Maximum time to wait in RTOS ticks.
+     * @return True if an event was returned.
+     */
+  bool waitEvent(ButtonEvent_t& event, TickType_t ticksToWait);
+
+  /**
+     * @brief Number of edges or events dropped because a queue was full.
+     */
+  uint32_t getDroppedCount() const { return m_dropped; }
+
+private:
+  struct Edge_t {
+    uint8_t button;
+    int64_t timestamp;
+  };
+
+  struct Button_t {
+    ButtonManager* manager;
+    uint8_t id;
+    uint8_t pin;
+    ButtonMode_t mode;
+    int stableLevel;               ///< Last debounced level
+    bool settling;                 ///< Debounce timer is running
+    int64_t firstEdgeAt;           ///< Timestamp of the first edge of the current settle window
+    bool pressed;                  ///< A debounced HIGH -> LOW edge was seen and not released yet (push buttons)
+    int64_t pressedAt;             ///< Timestamp of that press
+    esp_timer_handle_t debounceTimer;
+  };
+
+  static const uint32_t EDGE_NOTIFY_BIT = (1UL << 31);
+
+  static void ARDUINO_ISR_ATTR onEdge(void* arg);
+  static void onDebounceTimer(void* arg);
+  static void taskEntry(void* arg);
+
+  void task();
+  void drainEdges();
+  void settle(Button_t& button);
+  void emit(const ButtonEvent_t& event);
+
+  Button_t m_buttons[BUTTON_MAX_COUNT];
+  uint8_t m_count;
+  SpscQueue<Edge_t, 32> m_edges;  ///< ISR -> button task
+  QueueHandle_t m_events;         ///< Button task -> application
+  TaskHandle_t m_task;
+  volatile uint32_t m_dropped;
+};
+
+ButtonManager::ButtonManager()
+  : m_count(0), m_events(nullptr), m_task(nullptr), m_dropped(0) {
+  memset(m_buttons, 0, sizeof(m_buttons));
+}
+
+ButtonManager::~ButtonManager() {
+  for (uint8_t i = 0; i < m_count; i++) {
+    detachInterrupt(m_buttons[i].pin);
+    if (m_buttons[i].debounceTimer) {
+      esp_timer_stop(m_buttons[i].debounceTimer);
+      esp_timer_delete(m_buttons[i].debounceTimer);
+    }
+  }
+  if (m_task) vTaskDelete(m_task);
+  if (m_events) vQueueDelete(m_events);
+}
+
+int ButtonManager::addButton(uint8_t pin, ButtonMode_t mode, uint8_t inputMode) {
+  if (m_task || m_count >= BUTTON_MAX_COUNT) {
+    Serial.printf("[ButtonManager.addButton()]: Cannot add button on GPIO %u!\r\n", pin);
+    return -1;
+  }
+
+  pinMode(pin, inputMode);
+
+  Button_t& button = m_buttons[m_count];
+  button.manager = this;
+  button.id = m_count;
+  button.pin = pin;
+  button.mode = mode;
+  button.stableLevel = digitalRead(pin);
+  button.settling = false;
+  button.pressed = false;  // a button held at boot has no press to measure from
+  button.pressedAt = 0;
+  button.debounceTimer = nullptr;
+
+  return m_count++;
+}
+
+bool ButtonManager::begin() {
+  m_events = xQueueCreate(16, sizeof(ButtonEvent_t));
+  if (!m_events) {
+    Serial.printf("[ButtonManager.begin()]: Event queue allocation failed!\r\n");
+    return false;
+  }
+
+  for (uint8_t i = 0; i < m_count; i++) {
+    esp_timer_create_args_t args = {};
+    args.callback = &ButtonManager::onDebounceTimer;
+    args.arg = &m_buttons[i];
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "btn_debounce";
+
+    if (esp_timer_create(&args, &m_buttons[i].debounceTimer) != ESP_OK) {
+      Serial.printf("[ButtonManager.begin()]: Debounce timer creation failed!\r\n");
+      return false;
+    }
+  }
+
+  if (xTaskCreatePinnedToCore(&ButtonManager::taskEntry, "ButtonTask", BUTTON_TASK_STACK_SIZE, this, BUTTON_TASK_PRIORITY, &m_task, tskNO_AFFINITY) != pdPASS) {
+    Serial.printf("[ButtonManager.begin()]: Button task creation failed!\r\n");
+    return false;
+  }
+
+  for (uint8_t i = 0; i < m_count; i++) {
+    attachInterruptArg(m_buttons[i].pin, &ButtonManager::onEdge, &m_buttons[i], CHANGE);
+  }
+
+  return true;
+}
+
+bool ButtonManager::getEvent(ButtonEvent_t& event) {
+  return waitEvent(event, 0);
+}
+
+bool ButtonManager::waitEvent(ButtonEvent_t& event, TickType_t ticksToWait) {
+  if (!m_events) return false;
+  return xQueueReceive(m_events, &event, ticksToWait) == pdTRUE;
+}
+
+void ARDUINO_ISR_ATTR ButtonManager::onEdge(void* arg) {
+  Button_t* button = static_cast<Button_t*>(arg);
+  ButtonManager* self = button->manager;
+
+  // All GPIO interrupts are dispatched by one ISR, so there is a single producer.
+  if (!self->m_edges.push({ button->id, esp_timer_get_time() })) {
+    self->m_dropped++;
+  }
+
+  BaseType_t woken = pdFALSE;
+  xTaskNotifyFromISR(self->m_task, EDGE_NOTIFY_BIT, eSetBits, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+void ButtonManager::onDebounceTimer(void* arg) {
+  Button_t* button = static_cast<Button_t*>(arg);
+  xTaskNotify(button->manager->m_task, (1UL << button->id), eSetBits);
+}
+
+void ButtonManager::taskEntry(void* arg) {
+  static_cast<ButtonManager*>(arg)->task();
+}
+
+void ButtonManager::task() {
+  uint32_t bits = 0;
+
+  while (true) {
+    xTaskNotifyWait(0, ULONG_MAX, &bits, portMAX_DELAY);
+
+    if (bits & EDGE_NOTIFY_BIT) drainEdges();
+
+    for (uint8_t i = 0; i < m_count; i++) {
+      if (bits & (1UL << i)) settle(m_buttons[i]);
+    }
+  }
+}
+
+void ButtonManager::drainEdges() {
+  Edge_t edge;
+  while (m_edges.pop(edge)) {
+    Button_t& button = m_buttons[edge.button];
+
+    // Every bounce restarts the settle window; keep the time of the first edge.
+    if (!button.settling) {
+      button.settling = true;
+      button.firstEdgeAt = edge.timestamp;
+    }
+    esp_timer_stop(button.debounceTimer);
+    esp_timer_start_once(button.debounceTimer, BUTTON_DEBOUNCE_MS * 1000ULL);
+  }
+}
+
+void ButtonManager::settle(Button_t& button) {
+  button.settling = false;
+
+  int level = digitalRead(button.pin);
+  if (level == button.stableLevel) return;  // bounced back, nothing changed
+  button.stableLevel = level;
+
+  ButtonEvent_t event = { button.id, BUTTON_EVENT_TOGGLE, button.firstEdgeAt, 0 };
+
+  if (button.mode == BUTTON_MODE_TOGGLE) {
+    emit(event);
+    return;
+  }
+
+  if (level == LOW) {  // pressed
+    button.pressed = true;
+    button.pressedAt = button.firstEdgeAt;
+    return;
+  }
+
+  // released. Ignored without a press, e.g. the button was held LOW at boot.
+  if (!button.pressed) return;
+  button.pressed = false;
+  event.duration = (uint32_t)((button.firstEdgeAt - button.pressedAt) / 1000);
+  if (event.duration > BUTTON_VERY_LONG_PRESS_MS) {
+    event.type = BUTTON_EVENT_VERY_LONG_PRESS;
+  } else if (event.duration > BUTTON_LONG_PRESS_MS) {
+    event.type = BUTTON_EVENT_LONG_PRESS;
+  } else {
+    event.type = BUTTON_EVENT_SHORT_PRESS;
+  }
+  emit(event);
+}
+
+void ButtonManager::emit(const ButtonEvent_t& event) {
+  if (xQueueSend(m_events, &event, 0) != pdTRUE) {
+    m_dropped++;
+  }
+}
@@ -0,0 +1,414 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <WiFi.h>
+#include <Preferences.h>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "MetricsSampler.h"
+
+/**
+ * @enum JournalRecordType_t
+ * @brief Record types of the flash journal.
+ */
+enum JournalRecordType_t : uint8_t {
+  JOURNAL_BOOT = 1,             ///< Payload: esp_reset_reason_t (1 byte)
+  JOURNAL_METRICS,              ///< Payload: MetricsSample_t
+  JOURNAL_STATE,                ///< Payload: relay channel, state (local change while offline)
+  JOURNAL_WIFI_DISCONNECTED,    ///< Payload: wifi_err_reason_t (1 byte)
+  JOURNAL_WIFI_CONNECTED,       ///< No payload
+  JOURNAL_SERVER_DISCONNECTED,  ///< No payload
+  JOURNAL_SERVER_CONNECTED      ///< No payload
+};
+
+/**
+ * @class FlashJournal
+ * @brief Append-only journal of metric samples and events in a flash partition.
+ *
+ * While the server is unreachable, a MetricsSample_t is recorded every JOURNAL_SAMPLE_PERIOD_MS
+ * together with boot, WiFi, server and local relay events. Records reach the server in batches
+ * of JOURNAL_UPLOAD_BATCH with the health reports after the reconnect:
+ *
+ *     "journal": {"pending": 40, "evicted": 0, "from": 8200, "records": [[3, 12, "boot", 1], [3, 72, "metrics", 81234, 65536, -61, 0, 1830], ...]}
+ *
+ * Each record is [boot, uptime (s), type, payload...]. "from" identifies the first record, so a
+ * batch resent after a disconnect can be recognised. A batch counts as delivered when the next
+ * report is requested on the same connection.
+ *
+ * The partition (JOURNAL_PARTITION_LABEL) is a ring of 4 KB sectors, each starting with a magic
+ * and a sequence number. Records are written once and never moved. Delivered records are marked
+ * by clearing a flag bit, which needs no erase. When the ring is full, the oldest sector is
+ * erased, so every sector is erased once per lap. A torn write fails its CRC and ends the sector.
+ * Marking records in place does not work with flash encryption.
+ */
+class FlashJournal {
+public:
+  FlashJournal();
+
+  /**
+     * @brief Find the partition, recover the write position and record a boot event.
+     * @return False if there is no journal partition. The journal then records nothing.
+     */
+  bool begin();
+
+  /**
+     * @brief Append a record. Any task.
+     * @param type Record type.
+     * @param payload Record payload, up to 32 bytes.
+     * @param length Payload length.
+     * @return True on success.
+     */
+  bool record(JournalRecordType_t type, const void* payload = nullptr, uint8_t length = 0);
+
+  /**
+     * @brief Server connection state. Call from SinricPro.onConnected()/onDisconnected().
+     */
+  void setOnline(bool online);
+
+  bool isOnline() const { return m_online; }
+
+  /**
+     * @brief Record metric samples while offline. Call from the network loop.
+     */
+  void handle();
+
+  /**
+     * @brief Source of the metric samples recorded while offline.
+     */
+  void setMetricsSampler(MetricsSampler* sampler) { m_sampler = sampler; }
+
+  /**
+     * @brief Add the next batch of records to the health report.
+     * @param doc Target JSON object.
+     */
+  void addJournalInfo(JsonObject& doc);
+
+private:
+  struct SectorHeader_t {
+    uint32_t magic;
+    uint32_t sequence;  ///< Incremented for every sector started
+  };
+
+  struct RecordHeader_t {
+    uint8_t type;       ///< JournalRecordType_t, 0xFF: free space
+    uint8_t length;     ///< Payload length
+    uint16_t crc;       ///< CRC-16 of header and payload, with crc 0 and flags 0xFF
+    uint16_t boot;      ///< Boot counter
+    uint8_t flags;      ///< FLAG_PENDING is cleared once delivered
+    uint8_t reserved;
+    uint32_t uptime;    ///< Seconds since boot
+  };
+
+  static const uint32_t SECTOR_MAGIC = 0x314A5457;  ///< "WTJ1"
+  static const uint8_t FLAG_PENDING = 0x01;
+  static const uint8_t MAX_PAYLOAD = 32;
+
+  bool readSectorHeader(uint16_t sector, SectorHeader_t& header);
+  bool readRecord(uint32_t address, RecordHeader_t& header, uint8_t* payload);
+  bool next(uint32_t& address, RecordHeader_t& header, uint8_t* payload, uint32_t& start);
+  bool startSector(uint16_t sector);
+  void evictSector(uint16_t sector);
+  void commit();
+  void addRecord(JsonArray records, const RecordHeader_t& header, const uint8_t* payload);
+  static uint16_t checksum(const RecordHeader_t& header, const uint8_t* payload);
+  static uint32_t recordSize(uint8_t length) { return sizeof(RecordHeader_t) + ((length + 3) & ~3); }
+  // Addresses never point at a sector header, so the end of a full sector still belongs to it.
+  static uint16_t sectorOf(uint32_t address) { return (address - 1) / SPI_FLASH_SEC_SIZE; }
+
+  const esp_partition_t* m_partition;
+  SemaphoreHandle_t m_mutex;
+  uint16_t m_sectors;
+  uint16_t m_head;            ///< Sector being written
+  uint32_t m_sequence;        ///< Sequence number of the head sector
+  uint32_t m_writeAddress;    ///< Next record in the head sector
+  uint32_t m_cursor;          ///< First record not delivered
+  uint16_t m_inFlightCount;   ///< Records in the batch of the last report, 0 if none
+  uint32_t m_inFlightEpoch;
+  uint32_t m_epoch;           ///< Incremented on every disconnect
+  uint32_t m_pending;         ///< Records not delivered yet
+  uint32_t m_evicted;         ///< Records erased before delivery, since boot
+  uint16_t m_boot;
+  bool m_online;
+  bool m_wifiConnected;
+  unsigned long m_lastSample;
+  MetricsSampler* m_sampler;
+};
+
+FlashJournal::FlashJournal()
+  : m_partition(nullptr), m_mutex(nullptr), m_sectors(0), m_head(0), m_sequence(0), m_writeAddress(0), m_cursor(0),
+    m_inFlightCount(0), m_inFlightEpoch(0), m_epoch(0), m_pending(0), m_evicted(0), m_boot(0),
+    m_online(false), m_wifiConnected(false), m_lastSample(0), m_sampler(nullptr) {}
+
+bool FlashJournal::begin() {
+  if (m_partition) return true;
+
+  const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, JOURNAL_PARTITION_LABEL);
+  if (!partition || partition->size < 2 * SPI_FLASH_SEC_SIZE) {
+    Serial.printf("[FlashJournal.begin()]: No \"%s\" partition, journal disabled\r\n", JOURNAL_PARTITION_LABEL);
+    return false;
+  }
+  m_sectors = partition->size / SPI_FLASH_SEC_SIZE;
+  m_partition = partition;
+  m_mutex = xSemaphoreCreateMutex();
+
+  Preferences preferences;
+  if (preferences.begin("journal", false)) {
+    m_boot = preferences.getUShort("boot", 0) + 1;
+    preferences.putUShort("boot", m_boot);
+    preferences.end();
+  }
+
+  // The head is the sector with the highest sequence, the oldest one follows it.
+  bool found = false;
+  for (uint16_t sector = 0; sector < m_sectors; sector++) {
+    SectorHeader_t header;
+    if (readSectorHeader(sector, header) && (!found || header.sequence > m_sequence)) {
+      m_head = sector;
+      m_sequence = header.sequence;
+      found = true;
+    }
+  }
+
+  if (!found) {
+    m_sequence = 0;
+    if (!startSector(0)) {
+      m_partition = nullptr;
+      return false;
+    }
+  } else {
+    uint16_t tail = m_head;
+    uint32_t sequence = m_sequence;
+    SectorHeader_t header;
+    while (true) {
+      uint16_t previous = (tail + m_sectors - 1) % m_sectors;
+      if (previous == m_head || !readSectorHeader(previous, header) || header.sequence >= sequence) break;
+      tail = previous;
+      sequence = header.sequence;
+    }
+
+    // Count the pending records and find the first one and the end of the head sector.
+    uint32_t address = tail * SPI_FLASH_SEC_SIZE + sizeof(SectorHeader_t);
+    m_cursor = 0;
+    bool cursorFound = false;
+    RecordHeader_t record;
+    uint8_t payload[MAX_PAYLOAD];
+    uint32_t start;
+    while (next(address, record, payload, start)) {
+      if (!(record.flags & FLAG_PENDING)) continue;
+      if (!cursorFound) m_cursor = start;
+      cursorFound = true;
+      m_pending++;
+    }
+    if (!cursorFound) m_cursor = address;
+
+    // After a torn write the rest of the head sector is not used.
+    m_writeAddress = address;
+    readRecord(address, record, payload);
+    if (record.type != 0xFF) m_writeAddress = (m_head + 1) * SPI_FLASH_SEC_SIZE;
+  }
+
+  WiFi.onEvent([this](WiFiEvent_t event, WiFiEventInfo_t info) {
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP && !m_wifiConnected) {
+      m_wifiConnected = true;
+      record(JOURNAL_WIFI_CONNECTED);
+    } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED && m_wifiConnected) {
+      m_wifiConnected = false;  // only the first of the reconnect attempts
+      uint8_t reason = info.wifi_sta_disconnected.reason;
+      record(JOURNAL_WIFI_DISCONNECTED, &reason, sizeof(reason));
+    }
+  });
+
+  Serial.printf("[FlashJournal.begin()]: %u sectors, boot %u, %u records pending\r\n", m_sectors, m_boot, m_pending);
+
+  uint8_t reason = esp_reset_reason();
+  record(JOURNAL_BOOT, &reason, sizeof(reason));
+  return true;
+}
+
+bool FlashJournal::readSectorHeader(uint16_t sector, SectorHeader_t& header) {
+  return esp_partition_read(m_partition, sector * SPI_FLASH_SEC_SIZE, &header, sizeof(header)) == ESP_OK && header.magic == SECTOR_MAGIC;
+}
+
+uint16_t FlashJournal::checksum(const RecordHeader_t& header, const uint8_t* payload) {
+  RecordHeader_t copy = header;
+  copy.crc = 0;
+  copy.flags = 0xFF;
+  uint16_t crc = esp_rom_crc16_le(0, (const uint8_t*)&copy, sizeof(copy));
+  return esp_rom_crc16_le(crc, payload, header.length);
+}
+
+bool FlashJournal::readRecord(uint32_t address, RecordHeader_t& header, uint8_t* payload) {
+  uint32_t end = (sectorOf(address) + 1) * SPI_FLASH_SEC_SIZE;
+  header.type = 0xFF;
+  if (address + sizeof(header) > end) return false;
+  if (esp_partition_read(m_partition, address, &header, sizeof(header)) != ESP_OK || header.type == 0xFF) return false;
+  if (header.length > MAX_PAYLOAD || address + recordSize(header.length) > end) return false;
+  if (esp_partition_read(m_partition, address + sizeof(header), payload, header.length) != ESP_OK) return false;
+  return checksum(header, payload) == header.crc;
+}
+
+bool FlashJournal::next(uint32_t& address, RecordHeader_t& header, uint8_t* payload, uint32_t& start) {
+  while (true) {
+    if (readRecord(address, header, payload)) {
+      start = address;
+      address += recordSize(header.length);
+      return true;
+    }
+
+    uint16_t sector = sectorOf(address);
+    if (sector == m_head) return false;
+    address = ((sector + 1) % m_sectors) * SPI_FLASH_SEC_SIZE + sizeof(SectorHeader_t);
+  }
+}
+
+bool FlashJournal::startSector(uint16_t sector) {
+  SectorHeader_t header;
+  if (readSectorHeader(sector, header)) evictSector(sector);
+
+  header = { SECTOR_MAGIC, m_sequence + 1 };
+  if (esp_partition_erase_range(m_partition, sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE) != ESP_OK ||
+      esp_partition_write(m_partition, sector * SPI_FLASH_SEC_SIZE, &header, sizeof(header)) != ESP_OK) {
+    Serial.printf("[FlashJournal.startSector()]: Sector %u write failed\r\n", sector);
+    return false;
+  }
+
+  if (m_pending == 0) m_cursor = sector * SPI_FLASH_SEC_SIZE + sizeof(SectorHeader_t);
+  m_head = sector;
+  m_sequence = header.sequence;
+  m_writeAddress = sector * SPI_FLASH_SEC_SIZE + sizeof(SectorHeader_t);
+  return true;
+}
+
+void FlashJournal::evictSector(uint16_t sector) {
+  // Pending records only precede the cursor if they were all delivered.
+  if (sectorOf(m_cursor) != sector || m_pending == 0) return;
+
+  uint32_t address = m_cursor;
+  RecordHeader_t header;
+  uint8_t payload[MAX_PAYLOAD];
+  uint32_t lost = 0;
+  while (readRecord(address, header, payload)) {
+    address += recordSize(header.length);
+    lost++;
+  }
+
+  m_pending -= min(lost, m_pending);
+  m_evicted += lost;
+  m_inFlightCount = 0;
+  m_cursor = ((sector + 1) % m_sectors) * SPI_FLASH_SEC_SIZE + sizeof(SectorHeader_t);
+}
+
+bool FlashJournal::record(JournalRecordType_t type, const void* payload, uint8_t length) {
+  if (!m_partition || length > MAX_PAYLOAD) return false;
+
+  uint8_t buffer[sizeof(RecordHeader_t) + MAX_PAYLOAD];
+  memset(buffer, 0xFF, sizeof(buffer));
+
+  RecordHeader_t header = { type, length, 0, m_boot, 0xFF, 0xFF, (uint32_t)(esp_timer_get_time() / 1000000) };
+  header.crc = checksum(header, (const uint8_t*)payload);
+  memcpy(buffer, &header, sizeof(header));
+  if (length) memcpy(buffer + sizeof(header), payload, length);
+
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  bool success = true;
+  if (m_writeAddress + recordSize(length) > (m_head + 1) * SPI_FLASH_SEC_SIZE) {
+    success = startSector((m_head + 1) % m_sectors);
+  }
+  if (success) success = esp_partition_write(m_partition, m_writeAddress, buffer, recordSize(length)) == ESP_OK;
+  if (success) {
+    m_writeAddress += recordSize(length);
+    m_pending++;
+  }
+  xSemaphoreGive(m_mutex);
+  return success;
+}
+
+void FlashJournal::setOnline(bool online) {
+  if (online == m_online) return;
+  if (!online) m_epoch++;
+  m_online = online;
+  record(online ? JOURNAL_SERVER_CONNECTED : JOURNAL_SERVER_DISCONNECTED);
+}
+
+void FlashJournal::handle() {
+  if (!m_partition || m_online || !m_sampler) return;
+  if (millis() - m_lastSample < JOURNAL_SAMPLE_PERIOD_MS) return;
+  m_lastSample = millis();
+
+  MetricsSample_t sample;
+  if (m_sampler->latest(sample)) record(JOURNAL_METRICS, &sample, sizeof(sample));
+}
+
+void FlashJournal::commit() {
+  RecordHeader_t header;
+  uint8_t payload[MAX_PAYLOAD];
+  uint32_t start;
+
+  for (uint16_t i = 0; i < m_inFlightCount && next(m_cursor, header, payload, start); i++) {
+    uint8_t flags = header.flags & ~FLAG_PENDING;
+    esp_partition_write(m_partition, start + offsetof(RecordHeader_t, flags), &flags, 1);
+    if (m_pending) m_pending--;
+  }
+  m_inFlightCount = 0;
+}
+
+void FlashJournal::addRecord(JsonArray records, const RecordHeader_t& header, const uint8_t* payload) {
+  static const char* const NAMES[] = { "", "boot", "metrics", "state", "wifiDown", "wifiUp", "serverDown", "serverUp" };
+
+  JsonArray record = records.add<JsonArray>();
+  record.add(header.boot);
+  record.add(header.uptime);
+  record.add(header.type < sizeof(NAMES) / sizeof(NAMES[0]) ? NAMES[header.type] : "unknown");
+
+  switch (header.type) {
+    case JOURNAL_METRICS: {
+      MetricsSample_t sample;
+      memcpy(&sample, payload, sizeof(sample));
+      record.add(sample.freeHeap);
+      record.add(sample.largestFreeBlock);
+      record.add(sample.rssi);
+      record.add(sample.reconnects);
+      record.add(sample.loopMaxUs);
+      break;
+    }
+    default:
+      for (uint8_t i = 0; i < header.length; i++) record.add(payload[i]);
+      break;
+  }
+}
+
+void FlashJournal::addJournalInfo(JsonObject& doc) {
+  if (!m_partition) return;
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+
+  // The last batch arrived if the connection has stayed up since it was sent.
+  if (m_inFlightCount && m_inFlightEpoch == m_epoch) commit();
+  m_inFlightCount = 0;
+
+  doc["pending"] = m_pending;
+  doc["evicted"] = m_evicted;
+
+  SectorHeader_t sector;
+  uint32_t address = m_cursor;
+  RecordHeader_t header;
+  uint8_t payload[MAX_PAYLOAD];
+  uint32_t start;
+  JsonArray records;
+
+  while (m_inFlightCount < JOURNAL_UPLOAD_BATCH && next(address, header, payload, start)) {
+    if (m_inFlightCount == 0) {
+      // Sector sequence and offset: unique and increasing for the life of the partition.
+      readSectorHeader(sectorOf(start), sector);
+      doc["from"] = (uint64_t)sector.sequence * SPI_FLASH_SEC_SIZE + start % SPI_FLASH_SEC_SIZE;
+      records = doc["records"].to<JsonArray>();
+    }
+    addRecord(records, header, payload);
+    m_inFlightCount++;
+  }
+  m_inFlightEpoch = m_epoch;
+
+  xSemaphoreGive(m_mutex);
+}
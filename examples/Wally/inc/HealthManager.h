@@ -7,12 +7,86 @@
 #include "esp_system.h"
 #include <esp_wifi.h>
 #include <esp_heap_caps.h>
+#include <esp_core_dump.h>
+#include <Breadcrumbs.h>
+#include <JsonArena.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "AllocGuard.h"
+#include "LatencyProfiler.h"
+#include "MetricsSampler.h"
+#include "FlashJournal.h"
+#include "OTAManager.h"
+#include "BootProfiler.h"
+
+#ifndef HEALTH_MAX_TASKS
+#define HEALTH_MAX_TASKS  32  ///< Maximum number of FreeRTOS tasks listed in the health report
+#endif
+
+// Compact reports: a value is resent once it moved at least this far from the value last sent.
+#ifndef HEALTH_DELTA_HEAP_BYTES
+#define HEALTH_DELTA_HEAP_BYTES     1024  ///< Heap and PSRAM byte counts
+#endif
+#ifndef HEALTH_DELTA_HEAP_BLOCKS
+#define HEALTH_DELTA_HEAP_BLOCKS    16    ///< Heap block counts
+#endif
+#ifndef HEALTH_DELTA_STACK_BYTES
+#define HEALTH_DELTA_STACK_BYTES    64    ///< Task stack high-water marks
+#endif
+#ifndef HEALTH_DELTA_RSSI
+#define HEALTH_DELTA_RSSI           3     ///< WiFi RSSI (dBm)
+#endif
+#ifndef HEALTH_DELTA_CPU_PERCENT
+#define HEALTH_DELTA_CPU_PERCENT    1.0   ///< Task CPU usage
+#endif
+#ifndef HEALTH_DELTA_LATENCY_RATIO
+#define HEALTH_DELTA_LATENCY_RATIO  0.2   ///< Latency statistics, relative to the value last sent
+#endif
+#ifndef HEALTH_FULL_REPORT_EVERY
+#define HEALTH_FULL_REPORT_EVERY    24    ///< Send a full compact report every N reports. 0: only after boot
+#endif
+#ifndef HEALTH_SENT_MAX_VALUES
+#define HEALTH_SENT_MAX_VALUES      768   ///< Values remembered as last sent (compact reports, 8 bytes each). Others are sent every time
+#endif
+#ifndef HEALTH_REPORT_ARENA_SIZE
+#define HEALTH_REPORT_ARENA_SIZE    24576 ///< Arena of a report document, PSRAM if available. Compact mode adds a second one
+#endif
+#define HEALTH_PATH_LENGTH          64    ///< Longest flattened path, e.g. "tasks/NetworkTask/stackFree". Deeper values are not compared
 
 /**
  * @brief Class to handle health diagnostics
+ *
+ * In compact mode only values that changed since they were last sent are reported:
+ *
+ *     {"seq": 7, "uptime": 4200, "heap": {"freeHeap": 81234}, "tasks": {"OtaTask": {"stackFree": 1180}}}
+ *
+ * The first report after boot (seq 0), every HEALTH_FULL_REPORT_EVERY-th report and any
+ * report after a value disappeared, e.g. a task ended, carry "full": true and all values.
+ * A full report replaces the state, the others are merged into it in seq order. Arrays of
+ * named objects (tasks) become objects keyed by name. A gap in seq means the backend has
+ * to wait for the next full report.
+ *
+ * Append-only data, the journal batch and the metric series, is not compared: a new
+ * record or point can equal the one sent at the same position before, so these are
+ * always sent whole. Values are remembered as 8-byte hashes in a table of
+ * HEALTH_SENT_MAX_VALUES entries, values that do not fit in it are sent every time.
+ *
+ * Building a report does not touch the heap: the values that only change per boot are read
+ * once, before the ALLOC_GUARD_SCOPE, and the report is built in an arena of its own, taken
+ * by begin(). A full report at the HEALTH_MAX_TASKS, JOURNAL_UPLOAD_BATCH,
+ * BOOT_HISTORY_SIZE and METRICS_SERIES_POINTS limits takes about 17 KB of it on the ESP32,
+ * the changes of a compact report resent whole about 19 KB (see extras/tests). "healthArena"
+ * in the report shows the peak, and a report that overflowed to the heap is logged. Compact
+ * mode adds a second arena, for the changes, and the table, both taken by setCompact(). Only
+ * the SDK's report String is reserved once for the serialized report.
  */
 class HealthManager {
 public:
+  /**
+     * @brief Take the report arena. From setup(): on boards with PSRAM it is not in the heap before.
+     */
+  void begin();
+
   /**
      * @brief Report the health diagnostic information.
      * 
@@ -21,17 +95,144 @@ public:
      */
   bool reportHealth(String& healthReport);
 
+  /**
+     * @brief Include the latency histograms of a profiler in every report.
+     * 
+     * @param profiler Profiler to report. Its histograms are reset after each report.
+     */
+  void setLatencyProfiler(LatencyProfiler* profiler);
+
+  /**
+     * @brief Include the state and progress of background OTA updates in every report.
+     * 
+     * @param otaManager OTA manager to report.
+     */
+  void setOTAManager(OTAManager* otaManager);
+
+  /**
+     * @brief Include the metrics sampled since the previous report in every report.
+     * 
+     * @param sampler Started metrics sampler.
+     */
+  void setMetricsSampler(MetricsSampler* sampler);
+
+  /**
+     * @brief Upload the offline journal in batches with the reports.
+     * 
+     * @param journal Started journal.
+     */
+  void setJournal(FlashJournal* journal);
+
+  /**
+     * @brief Include the boot phase timings of this and the previous boots in every report.
+     * 
+     * @param profiler Started boot profiler.
+     */
+  void setBootProfiler(BootProfiler* profiler);
+
+  /**
+     * @brief Switch between full and compact (changes only) reports.
+     * 
+     * @param compact True to send only values that changed beyond the HEALTH_DELTA_* thresholds.
+     *                Takes the changes arena and the table of sent values, call it from setup().
+     */
+  void setCompact(bool compact);
+
 private:
-  String getChipId();
+  LatencyProfiler* m_latencyProfiler = nullptr;
+  OTAManager* m_otaManager = nullptr;
+  MetricsSampler* m_metricsSampler = nullptr;
+  FlashJournal* m_journal = nullptr;
+  BootProfiler* m_bootProfiler = nullptr;
+
+  struct TaskRunTime_t {
+    TaskHandle_t handle;
+    uint32_t runTime;
+  };
+
+  TaskStatus_t m_taskStatus[HEALTH_MAX_TASKS];       ///< Scratch buffer for uxTaskGetSystemState()
+  TaskRunTime_t m_prevRunTime[HEALTH_MAX_TASKS];     ///< Per-task run time at the previous report
+  UBaseType_t m_prevTaskCount = 0;
+  uint32_t m_prevTotalRunTime = 0;
+
+#if CONFIG_ESP_COREDUMP_ENABLE_TO_FLASH && CONFIG_ESP_COREDUMP_DATA_FORMAT_ELF
+  bool m_hasCrash = false;           ///< Core dump summary of the crash that caused this boot
+  esp_core_dump_summary_t m_crash;
+#endif
+
+  bool m_bootInfoRead = false;       ///< Chip id and sketch sizes have been read
+  char m_chipId[9];
+  uint32_t m_sketchSize;
+  uint32_t m_freeSketchSpace;
+
+  JsonArena m_reportArena{ HEALTH_REPORT_ARENA_SIZE, HEALTH_REPORT_ARENA_SIZE };
+  uint32_t m_fallbacks = 0;  ///< Arena fallbacks already logged
+
+  /**
+     * @brief A value as last sent, found by the hash of its path.
+     */
+  struct SentValue_t {
+    uint32_t path : 29;  ///< hash() of the path
+    uint32_t seen : 1;   ///< Still in the report being compared
+    uint32_t type : 2;   ///< SENT_*, SENT_FREE for an unused entry
+    uint32_t value;      ///< Integer, float bits or hash() of the text
+  };
+  enum { SENT_FREE, SENT_INTEGER, SENT_FLOAT, SENT_OTHER };
+
+  bool m_compact = false;
+  uint32_t m_sequence = 0;              ///< Compact report sequence number, 0 after boot
+  JsonArena* m_changesArena = nullptr;  ///< Taken by setCompact(true), kept afterwards
+  SentValue_t* m_sent = nullptr;        ///< HEALTH_SENT_MAX_VALUES entries, open addressing
+  uint16_t m_untracked = 0;             ///< Values of this report that did not fit in m_sent
+  bool m_untrackedLogged = false;
+
+  void readBootInfo();
+  void buildReport(JsonDocument& doc);
+  void addArenaInfo(JsonObject& doc, JsonArena* arena);
   void addHeapInfo(JsonObject& doc);
   void addWiFiInfo(JsonObject& doc);
   void addSketchInfo(JsonObject& doc);
   void addResetCause(JsonObject& doc);
+  void addCrashDetails(JsonObject& doc);
+  void addTaskInfo(JsonArray& doc);
+  uint32_t getPrevRunTime(TaskHandle_t handle);
+
+  void addChanges(JsonDocument& report, JsonDocument& changes);
+  void compare(JsonVariantConst value, char* path, size_t length, JsonDocument& changes);
+  void compareValue(const char* path, JsonVariantConst value, JsonDocument& changes);
+  static size_t appendKey(char* path, size_t length, const char* key);
+  static bool isSeries(const char* path);
+  static uint32_t hash(const char* text);
+  static SentValue_t encode(JsonVariantConst value);
+  bool hasChanged(const char* path, const SentValue_t& value, const SentValue_t& sent);
+  double deltaThreshold(const char* path);
+  void setPath(JsonDocument& doc, const char* path, JsonVariantConst value);
+
+  /**
+     * @brief ArduinoJson writer that appends to a String without emptying it first.
+     */
+  struct StringAppender {
+    String& string;
+    size_t write(uint8_t c) { return string.concat((const char*)&c, 1) ? 1 : 0; }
+    size_t write(const uint8_t* buffer, size_t length) { return string.concat((const char*)buffer, length) ? length : 0; }
+  };
 };
 
 
-String HealthManager::getChipId() {
-  return String((uint32_t)ESP.getEfuseMac(), HEX);
+void HealthManager::readBootInfo() {
+  if (m_bootInfoRead) return;
+  m_bootInfoRead = true;
+
+  snprintf(m_chipId, sizeof(m_chipId), "%x", (uint32_t)ESP.getEfuseMac());
+  m_sketchSize = ESP.getSketchSize();  // hashes the running image
+  m_freeSketchSpace = ESP.getFreeSketchSpace();
+
+#if CONFIG_ESP_COREDUMP_ENABLE_TO_FLASH && CONFIG_ESP_COREDUMP_DATA_FORMAT_ELF
+  // The core dump partition keeps the last crash. Only trust it after a crash reset.
+  esp_reset_reason_t reason = esp_reset_reason();
+  bool crashed = reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT || reason == ESP_RST_WDT;
+  m_hasCrash = crashed && esp_core_dump_get_summary(&m_crash) == ESP_OK;
+#endif
 }
 
 void HealthManager::addHeapInfo(JsonObject& doc) {
@@ -65,21 +266,45 @@ void HealthManager::addHeapInfo(JsonObject& doc) {
 }
 
 void HealthManager::addWiFiInfo(JsonObject& doc) {
-  doc["ssid"] = WiFi.SSID();
-  doc["bssid"] = WiFi.BSSIDstr();
+  // From the driver into stack buffers: the WiFi class getters return Strings.
+  char text[33];
+  wifi_ap_record_t ap;
+  if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+    strlcpy(text, (const char*)ap.ssid, sizeof(text));
+    doc["ssid"] = text;
+    snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X", ap.bssid[0], ap.bssid[1], ap.bssid[2], ap.bssid[3], ap.bssid[4], ap.bssid[5]);
+    doc["bssid"] = text;
+  } else {
+    doc["ssid"] = "";
+    doc["bssid"] = "00:00:00:00:00:00";
+  }
   doc["rssi"] = WiFi.RSSI();
-  doc["ipAddress"] = WiFi.localIP().toString();
-  doc["subnetMask"] = WiFi.subnetMask().toString();
-  doc["gateway"] = WiFi.gatewayIP().toString();
-  doc["dns"] = WiFi.dnsIP().toString();
-  doc["macAddress"] = WiFi.macAddress();
+
+  const struct {
+    const char* key;
+    IPAddress address;
+  } addresses[] = {
+    { "ipAddress", WiFi.localIP() },
+    { "subnetMask", WiFi.subnetMask() },
+    { "gateway", WiFi.gatewayIP() },
+    { "dns", WiFi.dnsIP() },
+  };
+  for (const auto& entry : addresses) {
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", entry.address[0], entry.address[1], entry.address[2], entry.address[3]);
+    doc[entry.key] = text;
+  }
+
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  doc["macAddress"] = text;
   doc["channel"] = WiFi.channel();
 }
 
 void HealthManager::addSketchInfo(JsonObject& doc) {
   doc["cpuFreq"] = ESP.getCpuFreqMHz();
-  doc["sketchSize"] = ESP.getSketchSize();
-  doc["freeSketchSpace"] = ESP.getFreeSketchSpace();
+  doc["sketchSize"] = m_sketchSize;
+  doc["freeSketchSpace"] = m_freeSketchSpace;
   doc["flashChipSize"] = ESP.getFlashChipSize();
   doc["flashChipSpeed"] = ESP.getFlashChipSpeed();
 }
@@ -99,12 +324,366 @@ void HealthManager::addResetCause(JsonObject& doc) {
     default: doc["reason"] = "Unknown reset reason"; break;
   }
 
-  //doc["crashDetails"] = "" // Use something like https://github.com/krzychb/EspSaveCrash
+  if (Breadcrumbs::previousCount() == 0) return;  // power-on: nothing survived
+  JsonObject crash = doc["crashDetails"].to<JsonObject>();
+  addCrashDetails(crash);
+}
+
+void HealthManager::addCrashDetails(JsonObject& doc) {
+  // Breadcrumbs of the previous boot, oldest first: [ms since boot, tag, task, arg]
+  JsonArray trail = doc["breadcrumbs"].to<JsonArray>();
+  for (uint8_t i = 0; i < Breadcrumbs::previousCount(); i++) {
+    const Breadcrumb_t& crumb = Breadcrumbs::previous(i);
+    char tag[sizeof(crumb.tag) + 1] = {};
+    char task[sizeof(crumb.task) + 1] = {};
+    memcpy(tag, crumb.tag, sizeof(crumb.tag));
+    memcpy(task, crumb.task, sizeof(crumb.task));
+
+    JsonArray entry = trail.add<JsonArray>();
+    entry.add(crumb.time);
+    entry.add(tag);
+    entry.add(task);
+    entry.add(crumb.arg);
+  }
+
+#if CONFIG_ESP_COREDUMP_ENABLE_TO_FLASH && CONFIG_ESP_COREDUMP_DATA_FORMAT_ELF
+  if (!m_hasCrash) return;  // read by readBootInfo()
+
+  // Decode with: addr2line -pfiaC -e firmware.elf <pc> <backtrace>
+  char text[12];
+  m_crash.exc_task[sizeof(m_crash.exc_task) - 1] = '\0';
+  doc["task"] = m_crash.exc_task;
+  snprintf(text, sizeof(text), "0x%x", (unsigned)m_crash.exc_pc);
+  doc["pc"] = text;
+  char elf[17];
+  strlcpy(elf, (const char*)m_crash.app_elf_sha256, sizeof(elf));
+  doc["elf"] = elf;
+#if __XTENSA__
+  char backtrace[16 * 11];  // esp_core_dump_bt_info_t holds up to 16 addresses
+  size_t length = 0;
+  backtrace[0] = '\0';
+  for (uint32_t i = 0; i < m_crash.exc_bt_info.depth && length < sizeof(backtrace); i++) {
+    length += snprintf(backtrace + length, sizeof(backtrace) - length, i ? " 0x%x" : "0x%x", (unsigned)m_crash.exc_bt_info.bt[i]);
+  }
+  doc["backtrace"] = backtrace;
+  doc["backtraceCorrupted"] = m_crash.exc_bt_info.corrupted;
+  doc["cause"] = m_crash.ex_info.exc_cause;
+  snprintf(text, sizeof(text), "0x%x", (unsigned)m_crash.ex_info.exc_vaddr);
+  doc["vaddr"] = text;
+#else
+  doc["cause"] = m_crash.ex_info.mcause;
+  snprintf(text, sizeof(text), "0x%x", (unsigned)m_crash.ex_info.mtval);
+  doc["mtval"] = text;
+#endif
+#endif
+}
+
+uint32_t HealthManager::getPrevRunTime(TaskHandle_t handle) {
+  for (UBaseType_t i = 0; i < m_prevTaskCount; i++) {
+    if (m_prevRunTime[i].handle == handle) return m_prevRunTime[i].runTime;
+  }
+  return 0;  // new task: everything it ran is since the last report
+}
+
+void HealthManager::addTaskInfo(JsonArray& doc) {
+#if configUSE_TRACE_FACILITY
+  uint32_t totalRunTime = 0;
+  UBaseType_t count = uxTaskGetSystemState(m_taskStatus, HEALTH_MAX_TASKS, &totalRunTime);
+  if (count == 0) return;  // more than HEALTH_MAX_TASKS tasks
+
+#if configGENERATE_RUN_TIME_STATS
+  // Run time counters are in esp_timer microseconds and wrap after ~71 minutes,
+  // unsigned deltas stay correct as long as reports are closer than that.
+  uint32_t elapsed = (totalRunTime - m_prevTotalRunTime) * portNUM_PROCESSORS;
+#endif
+
+  for (UBaseType_t i = 0; i < count; i++) {
+    const TaskStatus_t& status = m_taskStatus[i];
+
+    JsonObject task = doc.add<JsonObject>();
+    task["name"] = status.pcTaskName;
+    task["priority"] = status.uxCurrentPriority;
+
+    BaseType_t core = xTaskGetCoreID(status.xHandle);
+    task["core"] = core == tskNO_AFFINITY ? -1 : core;
+    task["stackFree"] = status.usStackHighWaterMark;  // bytes, lowest since the task started
+
+#if configGENERATE_RUN_TIME_STATS
+    if (elapsed) {
+      uint32_t ran = status.ulRunTimeCounter - getPrevRunTime(status.xHandle);
+      task["cpu"] = roundf(ran * 1000.0f / elapsed) / 10.0f;  // percent of all cores, one decimal
+    }
+#endif
+  }
+
+#if configGENERATE_RUN_TIME_STATS
+  for (UBaseType_t i = 0; i < count; i++) {
+    m_prevRunTime[i] = { m_taskStatus[i].xHandle, m_taskStatus[i].ulRunTimeCounter };
+  }
+  m_prevTaskCount = count;
+  m_prevTotalRunTime = totalRunTime;
+#endif
+#endif
+}
+
+void HealthManager::setLatencyProfiler(LatencyProfiler* profiler) {
+  m_latencyProfiler = profiler;
+}
+
+void HealthManager::setOTAManager(OTAManager* otaManager) {
+  m_otaManager = otaManager;
+}
+
+void HealthManager::setMetricsSampler(MetricsSampler* sampler) {
+  m_metricsSampler = sampler;
+}
+
+void HealthManager::setJournal(FlashJournal* journal) {
+  m_journal = journal;
+}
+
+void HealthManager::setBootProfiler(BootProfiler* profiler) {
+  m_bootProfiler = profiler;
+}
+
+void HealthManager::begin() {
+  m_reportArena.begin();
+}
+
+void HealthManager::setCompact(bool compact) {
+  m_compact = compact;
+  m_sequence = 0;  // the first compact report is full and empties the table
+  if (!compact || m_sent) return;
+
+  m_sent = (SentValue_t*)heap_caps_calloc(HEALTH_SENT_MAX_VALUES, sizeof(SentValue_t), MALLOC_CAP_SPIRAM);
+  if (!m_sent) m_sent = (SentValue_t*)calloc(HEALTH_SENT_MAX_VALUES, sizeof(SentValue_t));
+  if (!m_sent) {
+    Serial.printf("[HealthManager.setCompact()]: Not enough memory, sending full reports\r\n");
+    m_compact = false;
+    return;
+  }
+  m_changesArena = new JsonArena(HEALTH_REPORT_ARENA_SIZE, HEALTH_REPORT_ARENA_SIZE);
+  m_changesArena->begin();
+}
+
+size_t HealthManager::appendKey(char* path, size_t length, const char* key) {
+  int added = snprintf(path + length, HEALTH_PATH_LENGTH - length, length ? "/%s" : "%s", key);
+  return added < 0 || length + added >= HEALTH_PATH_LENGTH ? 0 : length + added;
+}
+
+bool HealthManager::isSeries(const char* path) {
+  if (strcmp(path, "journal") == 0) return true;
+  const char* key = strrchr(path, '/');
+  return key && strncmp(path, "metrics/", 8) == 0 && strcmp(key, "/series") == 0;
+}
+
+uint32_t HealthManager::hash(const char* text) {
+  uint32_t hash = 2166136261u;  // FNV-1a
+  while (*text) hash = (hash ^ (uint8_t)*text++) * 16777619u;
+  return hash;
+}
+
+HealthManager::SentValue_t HealthManager::encode(JsonVariantConst value) {
+  SentValue_t encoded = {};
+  if (value.is<bool>()) {
+    encoded.type = SENT_OTHER;
+    encoded.value = value.as<bool>();
+  } else if (value.is<int64_t>()) {
+    encoded.type = SENT_INTEGER;
+    encoded.value = (uint32_t)value.as<int64_t>();  // low 32 bits, see hasChanged()
+  } else if (value.is<uint64_t>()) {
+    encoded.type = SENT_INTEGER;
+    encoded.value = (uint32_t)value.as<uint64_t>();
+  } else if (value.is<float>()) {
+    float number = value.as<float>();
+    encoded.type = SENT_FLOAT;
+    memcpy(&encoded.value, &number, sizeof(number));
+  } else {
+    const char* text = value.as<const char*>();
+    encoded.type = SENT_OTHER;
+    encoded.value = text ? hash(text) : 0;
+  }
+  return encoded;
+}
+
+void HealthManager::compare(JsonVariantConst value, char* path, size_t length, JsonDocument& changes) {
+  // path holds HEALTH_PATH_LENGTH characters, the first length of them in use.
+  if (length && isSeries(path)) {
+    setPath(changes, path, value);  // sent whole, not remembered
+  } else if (value.is<JsonObjectConst>()) {
+    for (JsonPairConst member : value.as<JsonObjectConst>()) {
+      size_t childLength = appendKey(path, length, member.key().c_str());
+      if (childLength) compare(member.value(), path, childLength, changes);
+      path[length] = '\0';
+    }
+  } else if (value.is<JsonArrayConst>()) {
+    size_t index = 0;
+    for (JsonVariantConst item : value.as<JsonArrayConst>()) {
+      const char* name = item["name"];  // tasks are matched by name, not position
+      char number[12];
+      snprintf(number, sizeof(number), "%u", (unsigned)index++);
+      size_t childLength = appendKey(path, length, name ? name : number);
+      if (childLength) compare(item, path, childLength, changes);
+      path[length] = '\0';
+    }
+  } else if (strcmp(path, "uptime") != 0) {
+    compareValue(path, value, changes);
+  }
+}
+
+void HealthManager::compareValue(const char* path, JsonVariantConst value, JsonDocument& changes) {
+  SentValue_t current = encode(value);
+  current.path = hash(path);  // paths are not kept: two with the same 29-bit hash share an entry
+  current.seen = 1;
+
+  // Linear probing. Entries are only ever removed all at once, so a free one ends the search.
+  uint32_t index = current.path % HEALTH_SENT_MAX_VALUES;
+  for (uint32_t probe = 0; probe < HEALTH_SENT_MAX_VALUES; probe++, index = (index + 1) % HEALTH_SENT_MAX_VALUES) {
+    SentValue_t& sent = m_sent[index];
+    if (sent.type != SENT_FREE && sent.path != current.path) continue;
+
+    if (sent.type != SENT_FREE) {
+      sent.seen = 1;
+      if (!hasChanged(path, current, sent)) return;
+    }
+    sent = current;
+    setPath(changes, path, value);
+    return;
+  }
+
+  m_untracked++;  // table full: sent every time
+  setPath(changes, path, value);
+}
+
+double HealthManager::deltaThreshold(const char* path) {
+  const char* key = strrchr(path, '/');
+  key = key ? key + 1 : path;
+
+  if (strcmp(key, "rssi") == 0) return HEALTH_DELTA_RSSI;
+  if (strcmp(key, "cpu") == 0) return HEALTH_DELTA_CPU_PERCENT;
+  if (strcmp(key, "stackFree") == 0) return HEALTH_DELTA_STACK_BYTES;
+  if (strncmp(path, "heap/", 5) == 0) return strstr(key, "Blocks") ? HEALTH_DELTA_HEAP_BLOCKS : HEALTH_DELTA_HEAP_BYTES;
+  return 0;  // any change
+}
+
+bool HealthManager::hasChanged(const char* path, const SentValue_t& value, const SentValue_t& sent) {
+  if (value.type != sent.type) return true;
+  if (value.type == SENT_OTHER) return value.value != sent.value;
+
+  double diff, before;
+  if (value.type == SENT_INTEGER) {
+    // Low 32 bits of both: the difference is right for signed and unsigned values.
+    diff = fabs((double)(int32_t)(value.value - sent.value));
+    before = (int32_t)sent.value;
+  } else {
+    float now, last;
+    memcpy(&now, &value.value, sizeof(now));
+    memcpy(&last, &sent.value, sizeof(last));
+    diff = fabs(now - last);
+    before = last;
+  }
+  if (diff == 0) return false;
+  // Latency statistics cover the last interval only and are never equal twice.
+  if (strncmp(path, "latency/", 8) == 0) return diff > HEALTH_DELTA_LATENCY_RATIO * fabs(before);
+  return diff >= deltaThreshold(path);
+}
+
+void HealthManager::setPath(JsonDocument& doc, const char* path, JsonVariantConst value) {
+  JsonObject node = doc.as<JsonObject>();
+  char key[HEALTH_PATH_LENGTH];  // copied into the document: a const char* key would be linked to this buffer
+
+  while (true) {
+    const char* slash = strchr(path, '/');
+    size_t length = min(slash ? (size_t)(slash - path) : strlen(path), sizeof(key) - 1);
+    memcpy(key, path, length);
+    key[length] = '\0';
+    if (!slash) break;
+
+    JsonObject child = node[key];
+    node = child.isNull() ? node[key].to<JsonObject>() : child;
+    path = slash + 1;
+  }
+
+  if (value.isNull()) {
+    node[key] = nullptr;
+  } else {
+    node[key] = value;
+  }
+}
+
+void HealthManager::addChanges(JsonDocument& report, JsonDocument& changes) {
+  bool full = m_sequence == 0 || (HEALTH_FULL_REPORT_EVERY && m_sequence % HEALTH_FULL_REPORT_EVERY == 0);
+  char path[HEALTH_PATH_LENGTH];
+  bool removed;
+
+  do {
+    if (full) memset(m_sent, 0, HEALTH_SENT_MAX_VALUES * sizeof(SentValue_t));
+    m_untracked = 0;
+
+    changes["seq"] = m_sequence;
+    if (full) changes["full"] = true;
+    changes["uptime"] = report["uptime"];
+
+    path[0] = '\0';
+    compare(report.as<JsonVariantConst>(), path, 0, changes);
+
+    // Values that disappeared, e.g. a task that ended, were not seen. Their paths are not
+    // kept, so the report is rebuilt as a full one, which replaces the state.
+    removed = false;
+    for (uint32_t i = 0; i < HEALTH_SENT_MAX_VALUES; i++) {
+      if (m_sent[i].type != SENT_FREE && !m_sent[i].seen) removed = true;
+      m_sent[i].seen = 0;
+    }
+    if (removed) {
+      changes.clear();
+      full = true;  // empties the table, so this pass finds nothing removed
+    }
+  } while (removed);
+
+  m_sequence++;
 }
 
 bool HealthManager::reportHealth(String& healthReport) {
-  JsonDocument doc;
-  doc["chipId"] = getChipId();
+  readBootInfo();
+
+  JsonDocument doc(&m_reportArena);
+  JsonDocument changes(m_compact ? m_changesArena : &m_reportArena);  // empty unless compact
+  {
+    ALLOC_GUARD_SCOPE("health");
+    buildReport(doc);
+    if (m_compact) addChanges(doc, changes);
+  }
+
+  uint32_t fallbacks = m_reportArena.stats().fallbacks + (m_changesArena ? m_changesArena->stats().fallbacks : 0);
+  if (fallbacks != m_fallbacks) {
+    Serial.printf("[HealthManager.reportHealth()]: %u blocks did not fit, raise HEALTH_REPORT_ARENA_SIZE\r\n", fallbacks - m_fallbacks);
+    m_fallbacks = fallbacks;
+  }
+  if (m_untracked && !m_untrackedLogged) {
+    Serial.printf("[HealthManager.reportHealth()]: %u values are always sent, raise HEALTH_SENT_MAX_VALUES\r\n", m_untracked);
+    m_untrackedLogged = true;
+  }
+
+  // The only allocation: the SDK's String, sized once. ArduinoJson's String writer would
+  // release the reserved buffer first, so the report is appended to it instead.
+  JsonDocument& report = m_compact ? changes : doc;
+  healthReport.reserve(healthReport.length() + measureJson(report));
+  StringAppender appender{ healthReport };
+  serializeJson(report, appender);
+  return true;
+}
+
+void HealthManager::addArenaInfo(JsonObject& doc, JsonArena* arena) {
+  JsonArenaStats_t stats = arena->stats();
+  doc["size"] = stats.size;
+  doc["psram"] = stats.psram;
+  doc["peak"] = stats.peak;
+  doc["fallbacks"] = stats.fallbacks;
+  doc["resets"] = stats.resets;
+}
+
+void HealthManager::buildReport(JsonDocument& doc) {
+  doc["chipId"] = m_chipId;
   doc["uptime"] = millis() / 1000;  // seconds
 
   // Add detailed heap information.
@@ -123,6 +702,55 @@ bool HealthManager::reportHealth(String& healthReport) {
   JsonObject resetInfo = doc["reset"].to<JsonObject>();
   addResetCause(resetInfo);
 
-  serializeJson(doc, healthReport);
-  return true;
+  // Arena of the short-lived JSON documents. Peak and heap fallbacks show whether JSON_ARENA_SIZE fits
+  JsonObject arena = doc["jsonArena"].to<JsonObject>();
+  addArenaInfo(arena, JsonArena::instance());
+
+  // Arena of the reports, peak of the previous ones. Shows whether HEALTH_REPORT_ARENA_SIZE fits
+  JsonObject healthArena = doc["healthArena"].to<JsonObject>();
+  addArenaInfo(healthArena, &m_reportArena);
+  if (m_changesArena) {
+    JsonObject changesArena = doc["changesArena"].to<JsonObject>();
+    addArenaInfo(changesArena, m_changesArena);
+  }
+
+  // Boot phase timings (ms), this boot first
+  if (m_bootProfiler) {
+    JsonArray boot = doc["boot"].to<JsonArray>();
+    m_bootProfiler->addBootInfo(boot);
+  }
+
+  // FreeRTOS tasks: CPU usage since the last report, stack high-water mark and core
+  JsonArray tasks = doc["tasks"].to<JsonArray>();
+  addTaskInfo(tasks);
+
+  // Latency distributions since the last report (microseconds)
+  if (m_latencyProfiler) {
+    JsonObject latency = doc["latency"].to<JsonObject>();
+    m_latencyProfiler->addLatencyInfo(latency);
+  }
+
+  // Heap, RSSI, reconnects and loop latency sampled since the last report
+  if (m_metricsSampler) {
+    JsonObject metrics = doc["metrics"].to<JsonObject>();
+    m_metricsSampler->addMetricsInfo(metrics);
+  }
+
+  // Next batch of samples and events recorded while offline
+  if (m_journal) {
+    JsonObject journal = doc["journal"].to<JsonObject>();
+    m_journal->addJournalInfo(journal);
+  }
+
+  // Background OTA update progress
+  if (m_otaManager) {
+    JsonObject ota = doc["ota"].to<JsonObject>();
+    m_otaManager->addOtaInfo(ota);
+  }
+
+#if ALLOC_GUARD
+  // Heap allocations on the guarded paths since boot
+  JsonObject allocGuard = doc["allocGuard"].to<JsonObject>();
+  AllocGuard::addAllocGuardInfo(allocGuard);
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <atomic>
+#include <esp_cpu.h>
+
+#ifndef LATENCY_PROFILER_MAX_PROBES
+#define LATENCY_PROFILER_MAX_PROBES  8  ///< Maximum number of named probes
+#endif
+
+/**
+ * @class LatencyHistogram
+ * @brief Fixed-size log-linear histogram of CPU cycle counts.
+ *
+ * Values below 8 get their own bucket. Above that every power of two is split into
+ * 8 linear sub-buckets, so any value is within 12.5% of its bucket bound. 240 buckets
+ * cover the whole 32-bit range in under 1 KB.
+ *
+ * One task records, any task may read. reset() only raises a flag; the recording task
+ * clears the counts on its next record(), so there is no lock on the hot path. Until then
+ * the readers treat the histogram as empty, so a probe that records rarely does not keep
+ * reporting the window before the reset.
+ */
+class LatencyHistogram {
+public:
+  static const uint8_t SUB_BUCKET_BITS = 3;
+  static const uint16_t BUCKET_COUNT = (32 - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+  LatencyHistogram();
+
+  /**
+     * @brief Record one duration. Recording task only.
+     * @param cycles Duration in CPU cycles.
+     */
+  inline void record(uint32_t cycles) {
+    if (m_resetRequested.load(std::memory_order_acquire)) clear();
+    m_counts[bucketIndex(cycles)]++;
+    m_count++;
+    if (cycles > m_max) m_max = cycles;
+    if (cycles > m_intervalMax.load(std::memory_order_relaxed)) m_intervalMax.store(cycles, std::memory_order_relaxed);
+  }
+
+  /**
+     * @brief Ask the recording task to start a new window.
+     */
+  void reset() { m_resetRequested.store(true, std::memory_order_release); }
+
+  /**
+     * @brief Largest duration since the previous call, independent of reset(). Any task.
+     * A value recorded at the same moment may be lost.
+     */
+  uint32_t takeIntervalMax() { return m_intervalMax.exchange(0, std::memory_order_relaxed); }
+
+  /**
+     * @brief Upper bound of the bucket holding the given percentile, in cycles.
+     * @param percentile Percentile in the range 0..100.
+     */
+  uint32_t percentile(float percentile) const;
+
+  uint32_t count() const { return isResetPending() ? 0 : m_count; }
+  uint32_t max() const { return isResetPending() ? 0 : m_max; }
+
+  static uint16_t bucketIndex(uint32_t value);
+  static uint32_t bucketUpperBound(uint16_t index);
+
+private:
+  void clear();
+  bool isResetPending() const { return m_resetRequested.load(std::memory_order_acquire); }
+
+  uint32_t m_counts[BUCKET_COUNT];
+  uint32_t m_count;
+  uint32_t m_max;
+  std::atomic<uint32_t> m_intervalMax;
+  std::atomic<bool> m_resetRequested;
+};
+
+/**
+ * @class LatencyProfiler
+ * @brief A small registry of named LatencyHistogram probes.
+ */
+class LatencyProfiler {
+public:
+  LatencyProfiler();
+
+  /**
+     * @brief Register a probe. Call during setup.
+     * @param name Probe name used as the JSON key. Must stay valid.
+     * @return Probe id, or -1 if the table is full.
+     */
+  int addProbe(const char* name);
+
+  /**
+     * @brief Record a duration for a probe.
+     * @param probe Probe id returned by addProbe().
+     * @param cycles Duration in CPU cycles.
+     */
+  inline void record(int probe, uint32_t cycles) {
+    if (probe >= 0 && probe < m_count) m_histograms[probe].record(cycles);
+  }
+
+  /**
+     * @brief Add count/p50/p99/max (in microseconds) of every probe to a JSON object.
+     * @param doc Target JSON object.
+     * @param reset Start a new window for every probe afterwards.
+     */
+  void addLatencyInfo(JsonObject& doc, bool reset = true);
+
+  /**
+     * @brief Largest duration of a probe since the previous call, in CPU cycles.
+     * @param probe Probe id returned by addProbe().
+     */
+  uint32_t takeIntervalMax(int probe) {
+    return probe >= 0 && probe < m_count ? m_histograms[probe].takeIntervalMax() : 0;
+  }
+
+private:
+  const char* m_names[LATENCY_PROFILER_MAX_PROBES];
+  LatencyHistogram m_histograms[LATENCY_PROFILER_MAX_PROBES];
+  uint8_t m_count;
+};
+
+/**
+ * @class ScopedLatency
+ * @brief Records the lifetime of the object into a LatencyProfiler probe.
+ *
+ * Uses the CPU cycle counter, which is per core: use it on tasks pinned to one core.
+ * The counter wraps after 2^32 cycles (about 17 seconds at 240 MHz).
+ */
+class ScopedLatency {
+public:
+  inline ScopedLatency(LatencyProfiler& profiler, int probe)
+    : m_profiler(profiler), m_probe(probe), m_start(esp_cpu_get_cycle_count()) {}
+  inline ~ScopedLatency() { m_profiler.record(m_probe, esp_cpu_get_cycle_count() - m_start); }
+
+private:
+  LatencyProfiler& m_profiler;
+  int m_probe;
+  uint32_t m_start;
+};
+
+LatencyHistogram::LatencyHistogram()
+  : m_intervalMax(0), m_resetRequested(false) {
+  clear();
+}
+
+uint16_t LatencyHistogram::bucketIndex(uint32_t value) {
+  if (value < (1UL << SUB_BUCKET_BITS)) return value;
+
+  uint8_t msb = 31 - __builtin_clz(value);
+  uint8_t shift = msb - SUB_BUCKET_BITS;
+  return ((shift + 1) << SUB_BUCKET_BITS) + ((value >> shift) & ((1UL << SUB_BUCKET_BITS) - 1));
+}
+
+uint32_t LatencyHistogram::bucketUpperBound(uint16_t index) {
+  if (index < (1UL << SUB_BUCKET_BITS)) return index;
+
+  uint8_t shift = (index >> SUB_BUCKET_BITS) - 1;
+  uint32_t base = (1UL << SUB_BUCKET_BITS) | (index & ((1UL << SUB_BUCKET_BITS) - 1));
+  uint64_t upper = ((uint64_t)(base + 1) << shift) - 1;
+  return upper > UINT32_MAX ? UINT32_MAX : (uint32_t)upper;
+}
+
+uint32_t LatencyHistogram::percentile(float percentile) const {
+  if (isResetPending() || m_count == 0) return 0;
+
+  uint32_t rank = (uint32_t)ceilf(m_count * percentile / 100.0f);
+  if (rank == 0) rank = 1;
+
+  uint32_t seen = 0;
+  for (uint16_t i = 0; i < BUCKET_COUNT; i++) {
+    seen += m_counts[i];
+    if (seen >= rank) return min(bucketUpperBound(i), m_max);
+  }
+  return m_max;
+}
+
+void LatencyHistogram::clear() {
+  memset(m_counts, 0, sizeof(m_counts));
+  m_count = 0;
+  m_max = 0;
+  m_resetRequested.store(false, std::memory_order_release);
+}
+
+LatencyProfiler::LatencyProfiler()
+  : m_count(0) {
+  memset(m_names, 0, sizeof(m_names));
+}
+
+int LatencyProfiler::addProbe(const char* name) {
+  if (m_count >= LATENCY_PROFILER_MAX_PROBES) return -1;
+  m_names[m_count] = name;
+  return m_count++;
+}
+
+void LatencyProfiler::addLatencyInfo(JsonObject& doc, bool reset) {
+  uint32_t cyclesPerUs = ESP.getCpuFreqMHz();
+
+  for (uint8_t i = 0; i < m_count; i++) {
+    LatencyHistogram& histogram = m_histograms[i];
+
+    JsonObject probe = doc[m_names[i]].to<JsonObject>();
+    probe["count"] = histogram.count();
+    probe["p50"] = histogram.percentile(50) / cyclesPerUs;
+    probe["p99"] = histogram.percentile(99) / cyclesPerUs;
+    probe["max"] = histogram.max() / cyclesPerUs;
+
+    if (reset) histogram.reset();
+  }
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <WiFi.h>
+#include <atomic>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include "LatencyProfiler.h"
+
+/**
+ * @struct MetricsSample_t
+ * @brief One sample of the periodic metrics. 16 bytes.
+ */
+struct MetricsSample_t {
+  uint32_t freeHeap;          ///< Free internal heap (bytes)
+  uint32_t largestFreeBlock;  ///< Largest free internal heap block (bytes)
+  uint32_t loopMaxUs;         ///< Longest network loop during the period (us)
+  int8_t rssi;                ///< WiFi RSSI (dBm), 0 while not connected
+  uint8_t reconnects;         ///< WiFi disconnects during the period
+};
+
+/**
+ * @class MetricsSampler
+ * @brief Samples heap, RSSI, WiFi reconnects and loop latency between health reports.
+ *
+ * An esp_timer takes a sample every METRICS_SAMPLE_PERIOD_MS into a ring of
+ * METRICS_RING_SIZE samples. Min/max/mean cover every sample since the last report, even
+ * when the ring wrapped. The series covers the samples still in the ring, downsampled to
+ * METRICS_SERIES_POINTS points that keep the worst value of each bucket (lowest heap and
+ * RSSI, longest loop, sum of reconnects).
+ *
+ * A sample costs a few microseconds on the esp_timer task. A sample taken while a report
+ * is built may replace the oldest sample in the series.
+ */
+class MetricsSampler {
+public:
+  MetricsSampler();
+
+  /**
+     * @brief Start sampling. WiFi disconnects are counted from now on.
+     * @param periodMs Sample period.
+     * @return True on success.
+     */
+  bool begin(uint32_t periodMs = METRICS_SAMPLE_PERIOD_MS);
+
+  /**
+     * @brief Take the loop latency from a profiler probe.
+     * @param profiler Profiler recording the loop.
+     * @param probe Probe id of the loop.
+     */
+  void setLoopProbe(LatencyProfiler* profiler, int probe);
+
+  /**
+     * @brief Add statistics and series since the last call to a JSON object and start a new window.
+     * @param doc Target JSON object.
+     */
+  void addMetricsInfo(JsonObject& doc);
+
+  /**
+     * @brief Most recent sample.
+     * @param sample Receives the sample.
+     * @return False if nothing was sampled yet.
+     */
+  bool latest(MetricsSample_t& sample);
+
+private:
+  enum Metric_t { FREE_HEAP, LARGEST_FREE_BLOCK, RSSI, RECONNECTS, LOOP_LATENCY, METRIC_COUNT };
+
+  struct MetricStats_t {
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    uint32_t count;
+  };
+
+  static void timerCallback(void* arg);
+  void sample();
+  static bool value(const MetricsSample_t& sample, uint8_t metric, int32_t& value);
+  void resetStats();
+
+  static const char* const METRIC_NAMES[METRIC_COUNT];
+
+  esp_timer_handle_t m_timer;
+  uint32_t m_periodMs;
+  LatencyProfiler* m_profiler;
+  int m_probe;
+  std::atomic<uint32_t> m_disconnects;  ///< WiFi disconnects since begin(), from the WiFi event task
+  uint32_t m_lastDisconnects;
+
+  portMUX_TYPE m_lock;
+  MetricsSample_t m_ring[METRICS_RING_SIZE];
+  uint16_t m_head;   ///< Next slot to write
+  uint16_t m_count;  ///< Samples in the ring since the last report
+  uint32_t m_total;  ///< Samples since the last report
+  bool m_sampled;    ///< At least one sample was taken
+  MetricStats_t m_stats[METRIC_COUNT];
+};
+
+const char* const MetricsSampler::METRIC_NAMES[METRIC_COUNT] = { "freeHeap", "largestFreeBlock", "rssi", "reconnects", "loopMaxUs" };
+
+MetricsSampler::MetricsSampler()
+  : m_timer(nullptr), m_periodMs(0), m_profiler(nullptr), m_probe(-1), m_disconnects(0), m_lastDisconnects(0),
+    m_lock(portMUX_INITIALIZER_UNLOCKED), m_head(0), m_count(0), m_total(0), m_sampled(false) {
+  resetStats();
+}
+
+bool MetricsSampler::begin(uint32_t periodMs) {
+  if (m_timer) return true;
+  m_periodMs = periodMs;
+
+  WiFi.onEvent([this](WiFiEvent_t event, WiFiEventInfo_t info) {
+    m_disconnects.fetch_add(1, std::memory_order_relaxed);
+  }, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+
+  esp_timer_create_args_t args = {};
+  args.callback = &MetricsSampler::timerCallback;
+  args.arg = this;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "metrics";
+  args.skip_unhandled_events = true;
+
+  if (esp_timer_create(&args, &m_timer) != ESP_OK || esp_timer_start_periodic(m_timer, (uint64_t)periodMs * 1000) != ESP_OK) {
+    Serial.printf("[MetricsSampler.begin()]: Timer start failed\r\n");
+    return false;
+  }
+  return true;
+}
+
+void MetricsSampler::setLoopProbe(LatencyProfiler* profiler, int probe) {
+  m_profiler = profiler;
+  m_probe = probe;
+}
+
+void MetricsSampler::timerCallback(void* arg) {
+  static_cast<MetricsSampler*>(arg)->sample();
+}
+
+void MetricsSampler::sample() {
+  MetricsSample_t sample;
+  sample.freeHeap = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+  sample.largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+  sample.loopMaxUs = m_profiler ? m_profiler->takeIntervalMax(m_probe) / ESP.getCpuFreqMHz() : 0;
+  sample.rssi = WiFi.isConnected() ? constrain(WiFi.RSSI(), -127, -1) : 0;
+
+  uint32_t disconnects = m_disconnects.load(std::memory_order_relaxed);
+  sample.reconnects = min(disconnects - m_lastDisconnects, (uint32_t)UINT8_MAX);
+  m_lastDisconnects = disconnects;
+
+  portENTER_CRITICAL(&m_lock);
+  m_ring[m_head] = sample;
+  m_head = (m_head + 1) % METRICS_RING_SIZE;
+  if (m_count < METRICS_RING_SIZE) m_count++;
+  m_total++;
+  m_sampled = true;
+
+  for (uint8_t metric = 0; metric < METRIC_COUNT; metric++) {
+    int32_t v;
+    if (!value(sample, metric, v)) continue;
+
+    MetricStats_t& stats = m_stats[metric];
+    if (v < stats.min) stats.min = v;
+    if (v > stats.max) stats.max = v;
+    stats.sum += v;
+    stats.count++;
+  }
+  portEXIT_CRITICAL(&m_lock);
+}
+
+bool MetricsSampler::value(const MetricsSample_t& sample, uint8_t metric, int32_t& value) {
+  switch (metric) {
+    case FREE_HEAP: value = sample.freeHeap; return true;
+    case LARGEST_FREE_BLOCK: value = sample.largestFreeBlock; return true;
+    case RSSI: value = sample.rssi; return sample.rssi != 0;
+    case RECONNECTS: value = sample.reconnects; return true;
+    case LOOP_LATENCY: value = sample.loopMaxUs; return true;
+    default: return false;
+  }
+}
+
+bool MetricsSampler::latest(MetricsSample_t& sample) {
+  portENTER_CRITICAL(&m_lock);
+  bool sampled = m_sampled;
+  sample = m_ring[(m_head + METRICS_RING_SIZE - 1) % METRICS_RING_SIZE];
+  portEXIT_CRITICAL(&m_lock);
+  return sampled;
+}
+
+void MetricsSampler::resetStats() {
+  for (MetricStats_t& stats : m_stats) stats = { INT32_MAX, INT32_MIN, 0, 0 };
+}
+
+void MetricsSampler::addMetricsInfo(JsonObject& doc) {
+  MetricStats_t stats[METRIC_COUNT];
+
+  portENTER_CRITICAL(&m_lock);
+  memcpy(stats, m_stats, sizeof(stats));
+  uint16_t count = m_count;
+  uint16_t first = (m_head + METRICS_RING_SIZE - count) % METRICS_RING_SIZE;
+  uint32_t total = m_total;
+  m_count = 0;
+  m_total = 0;
+  resetStats();
+  portEXIT_CRITICAL(&m_lock);
+
+  doc["period"] = m_periodMs;
+  doc["samples"] = total;
+  if (count == 0) return;
+
+  uint16_t points = min(count, (uint16_t)METRICS_SERIES_POINTS);
+  uint16_t step = (count + points - 1) / points;
+  doc["step"] = step;  // samples per series point
+
+  for (uint8_t metric = 0; metric < METRIC_COUNT; metric++) {
+    JsonObject entry = doc[METRIC_NAMES[metric]].to<JsonObject>();
+    if (stats[metric].count) {
+      entry["min"] = stats[metric].min;
+      entry["max"] = stats[metric].max;
+      entry["mean"] = (int32_t)lround((double)stats[metric].sum / stats[metric].count);
+    }
+    if (metric == RECONNECTS) entry["total"] = stats[metric].sum;
+    entry["series"].to<JsonArray>();
+  }
+
+  // One pass over the ring, one bucket of samples at a time, so no copy of the ring is needed.
+  for (uint16_t start = 0; start < count; start += step) {
+    uint16_t len = min(step, (uint16_t)(count - start));
+    int32_t worst[METRIC_COUNT] = { INT32_MAX, INT32_MAX, 0, 0, 0 };
+
+    for (uint16_t i = 0; i < len; i++) {
+      MetricsSample_t sample;
+      portENTER_CRITICAL(&m_lock);
+      sample = m_ring[(first + start + i) % METRICS_RING_SIZE];
+      portEXIT_CRITICAL(&m_lock);
+
+      for (uint8_t metric = 0; metric < METRIC_COUNT; metric++) {
+        int32_t v;
+        if (!value(sample, metric, v)) continue;
+        if (metric == RECONNECTS) worst[metric] += v;
+        else if (metric == LOOP_LATENCY) worst[metric] = max(worst[metric], v);
+        else if (metric == RSSI) worst[metric] = worst[metric] == 0 ? v : min(worst[metric], v);
+        else worst[metric] = min(worst[metric], v);
+      }
+    }
+
+    for (uint8_t metric = 0; metric < METRIC_COUNT; metric++) {
+      doc[METRIC_NAMES[metric]]["series"].add(worst[metric]);
+    }
+  }
+}
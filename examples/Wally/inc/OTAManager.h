@@ -4,8 +4,23 @@
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
 #include <HTTPClient.h>
-#include <Update.h>
+#include <ArduinoJson.h>
+#include <mbedtls/sha256.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <Breadcrumbs.h>
+#include <ProvTrace.h>
 #include "SemVer.h"
+#include "OtaSink.h"
+#include "OtaHttpSource.h"
+#include "OtaPartitionWriter.h"
+#include "OtaCheckpoint.h"
+#include "OtaPipeline.h"
+#include "OtaDecompressor.h"
+#include "OtaDeltaPatcher.h"
+#include "OtaImageVerifier.h"
+#include "OtaSignature.h"
+#include "OtaPeerCache.h"
 
 /**
  * @struct OtaUpdateResult_t
@@ -16,38 +31,192 @@ struct OtaUpdateResult_t {
   String message;  ///< Contains a message describing the result or any error
 };
 
+/**
+ * @enum OtaState_t
+ * @brief State of the background OTA task.
+ */
+enum OtaState_t {
+  OTA_IDLE,
+  OTA_DOWNLOADING,
+  OTA_VERIFYING,
+  OTA_REBOOTING,
+  OTA_FAILED,
+  OTA_CANCELLED
+};
+
+/**
+ * @struct OtaProgress_t
+ * @brief Progress of the current or last OTA update.
+ */
+struct OtaProgress_t {
+  OtaState_t state;
+  uint32_t received;  ///< Bytes downloaded so far
+  uint32_t total;     ///< Download size, 0 until known
+  char error[64];     ///< Reason of the last failure
+};
+
+/**
+ * @class OtaHashingSink
+ * @brief Pass-through sink that keeps a running SHA-256 of everything written.
+ */
+class OtaHashingSink : public OtaSink {
+public:
+  OtaHashingSink(mbedtls_sha256_context& sha, OtaSink& next)
+    : m_sha(sha), m_next(next) {}
+
+  bool write(const uint8_t* data, size_t len) override {
+    if (!m_next.write(data, len)) return false;
+    mbedtls_sha256_update(&m_sha, data, len);
+    return true;
+  }
+
+  String getError() const override { return m_next.getError(); }
+
+private:
+  mbedtls_sha256_context& m_sha;
+  OtaSink& m_next;
+};
+
 /**
  * @class OTAManager
  * @brief Manages Over-The-Air (OTA) updates for ESP32 devices.
  * 
  * This class provides functionality to handle firmware updates over the network.
+ * Images are downloaded in OTA_CHUNK_SIZE ranges. Progress is checkpointed in NVS, so
+ * an interrupted update continues where it stopped, also after a reboot. Flash writes
+ * run on a separate task (OtaPipeline) so they overlap with reception.
+ *
+ * gzip compressed images (gzip -9 -n firmware.bin) are inflated while streaming, and
+ * delta patches (extras/tools/ota_delta.py) are applied against the running firmware.
+ * Both resume after a dropped connection, but start over after a reboot because the
+ * inflater and patcher state is not persisted.
+ *
+ * The image header is checked before the first flash write, and the SHA-256 used for
+ * the signature check (OTA_SIGNING_PUBLIC_KEY) is computed while streaming.
+ *
+ * The update runs on its own low priority task (OtaTask), so SinricPro, buttons and
+ * relays keep working during a download of several minutes.
+ *
+ * With a peer cache set, a device on the LAN that runs the wanted version is tried
+ * first. Its image must match the SHA-256 published at "<url>.sha256" on the origin.
+ * Peer downloads are not checkpointed: that hash covers the whole image, so a partial
+ * peer transfer is never continued, neither from the peer nor from the origin.
  */
 class OTAManager {
 public:
+  OTAManager();
+
   /**
-     * @brief Initiates and manages the OTA update process.
+     * @brief Checks the version and starts the OTA update in the background.
      * 
      * @param url The URL of the firmware update file.
      * @param major Major version number of the new firmware.
      * @param minor Minor version number of the new firmware.
      * @param patch Patch version number of the new firmware.
      * @param forceUpdate If true, forces the update regardless of version.
-     * @return OtaUpdateResult_t Struct containing the result of the update attempt.
+     * @return OtaUpdateResult_t Success if the update was started. The outcome is reported by getProgress().
      */
   OtaUpdateResult_t handleOTAUpdate(const String &firmwareVersion, const String &url, int major, int minor, int patch, bool forceUpdate);
 
+  /**
+     * @brief Stop a running update. A full image continues from its checkpoint next time.
+     * @return False if no update is running.
+     */
+  bool cancel();
+
+  /**
+     * @brief True while the OTA task is running.
+     */
+  bool isRunning() const { return m_task != nullptr; }
+
+  /**
+     * @brief Snapshot of the current or last update.
+     */
+  OtaProgress_t getProgress();
+
+  /**
+     * @brief Adds the OTA progress to the health report.
+     */
+  void addOtaInfo(JsonObject &ota);
+
+  /**
+     * @brief Try LAN peers before the origin URL.
+     * @param peerCache Started peer cache.
+     */
+  void setPeerCache(OtaPeerCache *peerCache) { m_peerCache = peerCache; }
+
 private:
+  static void otaTaskEntry(void *arg);
+  void otaTask();
+  void setProgress(OtaState_t state, size_t received, size_t total);
+
   /**
      * @brief Starts the actual OTA update process.
      * 
      * @param url The URL of the firmware update file.
+     * @param version Version of the new firmware. Identifies the image for resuming.
      * @return String A message indicating the result of the update process.
      */
-  String startOtaUpdate(const String &url);
+  String startOtaUpdate(const String &url, const String &version);
+
+  /**
+     * @brief Download, verify and install an image from one source.
+     * 
+     * @param url Image URL.
+     * @param version Version of the new firmware.
+     * @param expectedSha256 SHA-256 the final image must have, nullptr to skip the check.
+     *        Such downloads come from untrusted peers and are not checkpointed.
+     * @return String Empty on success (after which the ESP32 restarts), otherwise the error.
+     */
+  String download(const String &url, const String &version, const uint8_t *expectedSha256);
+
+  /**
+     * @brief Read the hex SHA-256 published at "<url>.sha256" (sha256sum format).
+     * @return True on success.
+     */
+  bool fetchImageHash(const String &url, uint8_t *sha256);
+
+  /**
+     * @brief Continue from a stored checkpoint if it matches the image and the data in flash.
+     * @return True if the writer was positioned after a verified prefix.
+     */
+  bool resumeFromCheckpoint(const String &imageId, const String &url, mbedtls_sha256_context &sha);
+
+  /**
+     * @brief Persist the current position and prefix hash.
+     */
+  void saveCheckpoint(const String &imageId, const String &url, mbedtls_sha256_context &sha);
+
+  OtaHttpSource m_source;
+  OtaPartitionWriter m_writer;
+  OtaCheckpoint m_checkpoint;
+  OtaPipeline m_pipeline;
+  OtaDecompressor m_decompressor;
+  OtaDeltaPatcher m_patcher;
+  OtaImageVerifier m_verifier;
+  OtaSignature m_signature;
+  OtaPeerCache *m_peerCache;
+
+  String m_url;
+  String m_version;
+  TaskHandle_t m_task;
+  volatile bool m_cancelled;
+  portMUX_TYPE m_lock;
+  OtaProgress_t m_progress;
 };
 
+OTAManager::OTAManager()
+  : m_peerCache(nullptr), m_task(nullptr), m_cancelled(false), m_lock(portMUX_INITIALIZER_UNLOCKED), m_progress() {
+  m_source.setRateLimit(OTA_MAX_BYTES_PER_SEC);
+}
+
 OtaUpdateResult_t OTAManager::handleOTAUpdate(const String &firmwareVersion, const String &url, int major, int minor, int patch, bool forceUpdate) {
   OtaUpdateResult_t result = { false, "" };
+  if (isRunning()) {
+    result.message = "OTA update already in progress.";
+    return result;
+  }
+
   SemVer currentVersion = SemVer(firmwareVersion);
   SemVer newVersion = SemVer(String(major) + "." + String(minor) + "." + String(patch));
   bool updateAvailable = newVersion > currentVersion;
@@ -65,9 +234,16 @@ OtaUpdateResult_t OTAManager::handleOTAUpdate(const String &firmwareVersion, con
     if (updateAvailable) {
       Serial.println("[OTAManager.startOtaUpdate()]: Update available!");
     }
-    String resp = startOtaUpdate(url);
-    if (!resp.isEmpty()) {
-      result.message = resp;
+    m_url = url;
+    m_version = newVersion.toString();
+    m_cancelled = false;
+    m_source.setCancelled(false);
+    setProgress(OTA_DOWNLOADING, 0, 0);
+
+    if (xTaskCreatePinnedToCore(&OTAManager::otaTaskEntry, "OtaTask", OTA_TASK_STACK_SIZE, this, OTA_TASK_PRIORITY, &m_task, NETWORK_TASK_CORE) != pdPASS) {
+      m_task = nullptr;
+      setProgress(OTA_IDLE, 0, 0);
+      result.message = "OTA task creation failed.";
     } else {
       result.success = true;
     }
@@ -77,37 +253,294 @@ OtaUpdateResult_t OTAManager::handleOTAUpdate(const String &firmwareVersion, con
   return result;
 }
 
-String OTAManager::startOtaUpdate(const String &url) {
-  WiFiClientSecure client;
-  client.setInsecure();
+bool OTAManager::cancel() {
+  if (!isRunning()) return false;
+  Serial.printf("[OTAManager.cancel()]: Cancelling OTA update\n");
+  m_cancelled = true;
+  m_source.setCancelled(true);
+  return true;
+}
+
+void OTAManager::otaTaskEntry(void *arg) {
+  static_cast<OTAManager *>(arg)->otaTask();
+}
+
+void OTAManager::otaTask() {
+  String error = startOtaUpdate(m_url, m_version);  // restarts the ESP32 on success
+
+  OtaProgress_t progress = getProgress();
+  setProgress(m_cancelled ? OTA_CANCELLED : OTA_FAILED, progress.received, progress.total);
+  portENTER_CRITICAL(&m_lock);
+  strlcpy(m_progress.error, error.c_str(), sizeof(m_progress.error));
+  portEXIT_CRITICAL(&m_lock);
+
+  Serial.printf("[OTAManager.otaTask()]: OTA update %s: %s\n", m_cancelled ? "cancelled" : "failed", error.c_str());
+
+  m_task = nullptr;
+  vTaskDelete(NULL);
+}
+
+void OTAManager::setProgress(OtaState_t state, size_t received, size_t total) {
+  if (state != m_progress.state) {
+    BREADCRUMB("ota", state);
+    TRACE_INSTANT("otaState", state);
+  }
+
+  portENTER_CRITICAL(&m_lock);
+  m_progress.state = state;
+  m_progress.received = received;
+  m_progress.total = total;
+  if (state == OTA_DOWNLOADING) m_progress.error[0] = '\0';
+  portEXIT_CRITICAL(&m_lock);
+}
+
+OtaProgress_t OTAManager::getProgress() {
+  portENTER_CRITICAL(&m_lock);
+  OtaProgress_t progress = m_progress;
+  portEXIT_CRITICAL(&m_lock);
+  return progress;
+}
+
+void OTAManager::addOtaInfo(JsonObject &ota) {
+  static const char *states[] = { "idle", "downloading", "verifying", "rebooting", "failed", "cancelled" };
+  OtaProgress_t progress = getProgress();
+
+  ota["state"] = states[progress.state];
+  ota["received"] = progress.received;
+  ota["total"] = progress.total;
+  if (progress.error[0]) ota["error"] = progress.error;
+}
+
+bool OTAManager::resumeFromCheckpoint(const String &imageId, const String &url, mbedtls_sha256_context &sha) {
+  OtaCheckpoint_t checkpoint;
+  if (!m_source.supportsRange() || !m_checkpoint.load(imageId, url, checkpoint)) return false;
+  if (checkpoint.size != m_source.totalSize() || !m_writer.begin(checkpoint.size, checkpoint.offset)) return false;
+
+  // Make sure flash still holds what the checkpoint describes.
+  uint8_t digest[32];
+  mbedtls_sha256_context check;
+  mbedtls_sha256_init(&check);
+  mbedtls_sha256_clone(&check, &sha);
+  bool valid = m_writer.hashWritten(check) && mbedtls_sha256_finish(&check, digest) == 0 && memcmp(digest, checkpoint.sha256, sizeof(digest)) == 0;
+  mbedtls_sha256_free(&check);
+
+  if (!valid) {
+    Serial.printf("[OTAManager.resumeFromCheckpoint()]: Checkpoint does not match flash. Starting over.\n");
+    return false;
+  }
+
+  m_writer.hashWritten(sha);
+  Serial.printf("[OTAManager.resumeFromCheckpoint()]: Resuming at %u/%u bytes\n", checkpoint.offset, checkpoint.size);
+  return true;
+}
+
+void OTAManager::saveCheckpoint(const String &imageId, const String &url, mbedtls_sha256_context &sha) {
+  OtaCheckpoint_t checkpoint = {};
+  strlcpy(checkpoint.imageId, imageId.c_str(), sizeof(checkpoint.imageId));
+  checkpoint.source = OtaCheckpoint::hashUrl(url);
+  checkpoint.size = m_writer.size();
+  checkpoint.offset = m_writer.offset();
+
+  mbedtls_sha256_context prefix;
+  mbedtls_sha256_init(&prefix);
+  mbedtls_sha256_clone(&prefix, &sha);
+  mbedtls_sha256_finish(&prefix, checkpoint.sha256);
+  mbedtls_sha256_free(&prefix);
+
+  m_checkpoint.save(checkpoint);
+}
+
+bool OTAManager::fetchImageHash(const String &url, uint8_t *sha256) {
+  char text[128];
+  size_t length = 0;
+  if (!m_source.get(url + ".sha256", (uint8_t *)text, sizeof(text) - 1, length) || length < 64) return false;
 
-  HTTPClient https;
+  for (int i = 0; i < 32; i++) {
+    char hex[3] = { text[i * 2], text[i * 2 + 1], '\0' };
+    if (!isxdigit(hex[0]) || !isxdigit(hex[1])) return false;
+    sha256[i] = strtoul(hex, nullptr, 16);
+  }
+  return true;
+}
+
+String OTAManager::startOtaUpdate(const String &url, const String &version) {
   Serial.print("[OTAManager.startOtaUpdate()]: begin...\n");
-  if (!https.begin(client, url)) return "Unable to connect";
+  TRACE_SCOPE("otaUpdate");
+
+#ifdef OTA_SIGNING_PUBLIC_KEY
+  TRACE_BEGIN("otaSignature");
+  bool signatureFetched = m_signature.fetch(m_source, url);
+  TRACE_END("otaSignature");
+  if (!signatureFetched) return m_signature.getError();
+#else
+  Serial.printf("[OTAManager.startOtaUpdate()]: OTA_SIGNING_PUBLIC_KEY is not set, image signature is not checked\n");
+#endif
+
+  String peerUrl;
+  uint8_t expected[32];
+  TRACE_BEGIN("otaPeerFind");
+  bool peerFound = m_peerCache && m_peerCache->findPeer(version, peerUrl);
+  TRACE_END("otaPeerFind");
+  if (peerFound) {
+    if (fetchImageHash(url, expected)) {
+      String error = download(peerUrl, version, expected);
+      m_checkpoint.clear();  // the peer overwrote what an older origin checkpoint describes
+      if (m_cancelled) return error;
+
+      Serial.printf("[OTAManager.startOtaUpdate()]: Peer download failed: %s. Using %s\n", error.c_str(), url.c_str());
+    } else {
+      Serial.printf("[OTAManager.startOtaUpdate()]: No hash at %s.sha256, not using the peer\n", url.c_str());
+    }
+  }
+
+  return download(url, version, nullptr);
+}
+
+String OTAManager::download(const String &url, const String &version, const uint8_t *expectedSha256) {
+  Serial.printf("[OTAManager.download()]: %s\n", url.c_str());
+  TRACE_SCOPE("otaDownload");
+  if (!m_source.probe(url)) return m_source.getError();
+
+  size_t total = m_source.totalSize();
+  setProgress(OTA_DOWNLOADING, 0, total);
+  bool compressed = OtaDecompressor::isGzip(m_source.head(), OtaHttpSource::HEAD_LENGTH);
+  bool raw = !compressed && !OtaDeltaPatcher::isDelta(m_source.head(), OtaHttpSource::HEAD_LENGTH);
+  bool resumable = raw && !expectedSha256 && m_source.supportsRange();
+  String imageId = version + "/" + String(total);
+
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+
+  if (!resumable || !resumeFromCheckpoint(imageId, url, sha)) {
+    mbedtls_sha256_starts(&sha, 0);
+    if (!m_writer.begin(raw ? total : 0, 0)) {
+      mbedtls_sha256_free(&sha);
+      return m_writer.getError();
+    }
+  }
+
+  // pipeline -> [decompressor] -> [patcher] -> verifier -> hashing -> writer
+  OtaHashingSink hashing(sha, m_writer);
+  m_verifier.begin(hashing);
+  m_patcher.begin(m_verifier);
+  if (compressed && !m_decompressor.begin(m_patcher, total)) {
+    mbedtls_sha256_free(&sha);
+    return m_decompressor.getError();
+  }
+
+  // A resumed image has had its header checked before the reboot.
+  bool resumed = raw && m_writer.offset() > 0;
+  OtaSink &rawSink = resumed ? (OtaSink &)hashing : (OtaSink &)m_verifier;
+  OtaSink &first = compressed ? (OtaSink &)m_decompressor : raw ? rawSink : (OtaSink &)m_patcher;
+  if (!m_pipeline.begin(first)) {
+    m_decompressor.release();
+    mbedtls_sha256_free(&sha);
+    return m_pipeline.getError();
+  }
+
+  String error;
+  bool transferError = false;  // the checkpoint stays valid, everything else discards it
+  int retries = 0;
+  size_t received = raw ? m_writer.offset() : 0;  // position in the downloaded file
 
-  int httpCode = https.GET();
-  if (httpCode != HTTP_CODE_OK) return "GET... failed, error: " + https.errorToString(httpCode);
+  Serial.printf("[OTAManager.download()]: Beginning %s update..!\n", compressed ? "compressed" : raw ? "full" : "delta");
 
-  int contentLength = https.getSize();
-  Serial.printf("[OTAManager.startOtaUpdate()]: OTA size: %d bytes \n", contentLength);
-  if (contentLength == 0) return "There was no content length in the response";
+  while (received < total) {
+    if (m_cancelled) {
+      error = "OTA update cancelled";
+      transferError = true;
+      break;
+    }
+
+    size_t start = received;
+    bool ranged = m_source.supportsRange();
+    size_t length = ranged ? min(OTA_CHUNK_SIZE - start % OTA_CHUNK_SIZE, total - start) : total;
+    size_t delivered = 0;
+
+    TRACE_BEGIN("otaFetch", start / OTA_CHUNK_SIZE);
+    bool fetched = m_source.fetch(url, start, length, m_pipeline, delivered);
+    TRACE_END("otaFetch");
+    TRACE_BEGIN("otaDrain");
+    bool written = m_pipeline.drain();  // after this the writer offset and hash cover everything received
+    TRACE_END("otaDrain");
+    received += delivered;
+    setProgress(OTA_DOWNLOADING, received, total);
+
+    if (fetched && written) {
+      retries = 0;
+      // Chunk boundaries are sector aligned, so the writer can resume here after a reboot.
+      if (resumable && m_writer.offset() % SPI_FLASH_SEC_SIZE == 0) saveCheckpoint(imageId, url, sha);
+      Serial.printf("[OTAManager.download()]: %u/%u bytes\n", received, total);
+      continue;
+    }
 
-  Serial.printf("[OTAManager.startOtaUpdate()]: Beginning update..!\n");
-  bool canBegin = Update.begin(contentLength);
-  if (!canBegin) return "Not enough space to begin OTA";
+    if (!written) {
+      error = m_pipeline.getError();
+      break;
+    }
 
-  WiFiClient *stream = https.getStreamPtr();
-  size_t written = Update.writeStream(*stream);
-  if (written != contentLength) return "Written only : " + String(written) + "/" + String(contentLength) + ". Retry?";
+    // A server that ignored a range request is asked for the whole file from here on. A
+    // resumed download cannot start over: its pipeline skips the image header check. It
+    // fails and drops the checkpoint, the next attempt starts from 0.
+    bool rangeIgnored = ranged && !m_source.supportsRange();
+    if (rangeIgnored && resumed) {
+      error = m_source.getError();
+      break;
+    }
+    if (m_cancelled || (!m_source.retryable() && !rangeIgnored) || ++retries > OTA_MAX_RETRIES) {
+      error = m_source.getError();
+      transferError = true;
+      break;
+    }
 
-  Serial.println("[OTAManager.startOtaUpdate()]: startOtaUpdate()] Written : " + String(written) + " successfully");
+    Serial.printf("[OTAManager.download()]: %s. Retry %d/%d\n", m_source.getError().c_str(), retries, OTA_MAX_RETRIES);
+    delay(OTA_RETRY_DELAY_MS * retries);
+
+    if (!m_source.supportsRange()) {  // no way to continue, start over
+      received = 0;
+      resumable = false;
+      mbedtls_sha256_starts(&sha, 0);
+      m_writer.begin(raw ? total : 0, 0);
+      m_verifier.begin(hashing);
+      m_patcher.begin(m_verifier);
+      if (compressed) m_decompressor.begin(m_patcher, total);
+    }
+  }
+
+  TRACE_BEGIN("otaVerify");
+  m_pipeline.end();
+  if (error.isEmpty()) setProgress(OTA_VERIFYING, received, total);
+  if (compressed && error.isEmpty() && !m_decompressor.end()) error = m_decompressor.getError();
+  if (!raw && error.isEmpty() && !m_patcher.end()) error = m_patcher.getError();
+  m_decompressor.release();
+
+  uint8_t digest[32];
+  if (error.isEmpty()) mbedtls_sha256_finish(&sha, digest);
+  mbedtls_sha256_free(&sha);
+
+  if (error.isEmpty() && m_patcher.isPatching() && memcmp(digest, m_patcher.targetSha256(), sizeof(digest)) != 0) error = "Patched image hash mismatch";
+  if (error.isEmpty() && expectedSha256 && memcmp(digest, expectedSha256, sizeof(digest)) != 0) error = "Image hash mismatch";
+#ifdef OTA_SIGNING_PUBLIC_KEY
+  if (error.isEmpty() && !m_signature.verify(OTA_SIGNING_PUBLIC_KEY, digest)) error = m_signature.getError();
+#endif
+  m_source.end();
+  TRACE_END("otaVerify");
+  if (!error.isEmpty()) {
+    if (!transferError) m_checkpoint.clear();  // bad data, do not resume on top of it
+    return error;
+  }
 
-  if (!Update.end()) return "Error Occurred. Error #: " + String(Update.getError());
+  Serial.println("[OTAManager.download()]: Written : " + String(m_writer.offset()) + " successfully");
 
-  Serial.println("[OTAManager.startOtaUpdate()]: OTA done!");
-  if (!Update.isFinished()) return "Update not finished? Something went wrong!";
+  m_checkpoint.clear();
+  TRACE_BEGIN("otaFinalize");
+  bool finalized = m_writer.end();
+  TRACE_END("otaFinalize");
+  if (!finalized) return m_writer.getError();
 
-  Serial.println("[OTAManager.startOtaUpdate()]: Update successfully completed. Rebooting.");
+  setProgress(OTA_REBOOTING, received, total);
+  Serial.println("[OTAManager.download()]: Update successfully completed. Rebooting.");
   ESP.restart();
   return "";
 }
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+/**
+ * @struct OtaCheckpoint_t
+ * @brief Download progress of an OTA image, persisted in NVS.
+ */
+struct OtaCheckpoint_t {
+  char imageId[32];    ///< Identifies the image, e.g. "1.2.3/1310720" (version/size)
+  uint32_t source;     ///< OtaCheckpoint::hashUrl() of the URL the bytes came from
+  uint32_t size;       ///< Total image size
+  uint32_t offset;     ///< Bytes written to the partition (sector aligned)
+  uint8_t sha256[32];  ///< SHA-256 of the bytes [0, offset)
+};
+
+/**
+ * @class OtaCheckpoint
+ * @brief Loads, saves and clears the OTA download checkpoint.
+ *
+ * A checkpoint only resumes a download of the same image from the same URL. Bytes from
+ * another source (a LAN peer) are never continued, since their hash is only checked once
+ * the whole image has arrived.
+ */
+class OtaCheckpoint {
+public:
+  /**
+     * @brief Load the checkpoint for an image.
+     * @param imageId Image identifier.
+     * @param url URL the download continues from.
+     * @param checkpoint Receives the checkpoint.
+     * @return True if a checkpoint for this image and URL exists.
+     */
+  bool load(const String& imageId, const String& url, OtaCheckpoint_t& checkpoint);
+
+  /**
+     * @brief Persist a checkpoint.
+     */
+  bool save(const OtaCheckpoint_t& checkpoint);
+
+  /**
+     * @brief Remove any stored checkpoint.
+     */
+  void clear();
+
+  /**
+     * @brief FNV-1a hash identifying a download URL.
+     */
+  static uint32_t hashUrl(const String& url);
+
+private:
+  Preferences m_preferences;
+};
+
+bool OtaCheckpoint::load(const String& imageId, const String& url, OtaCheckpoint_t& checkpoint) {
+  if (!m_preferences.begin("ota", true)) return false;
+  size_t len = m_preferences.getBytes("checkpoint", &checkpoint, sizeof(checkpoint));
+  m_preferences.end();
+
+  if (len != sizeof(checkpoint)) return false;
+  checkpoint.imageId[sizeof(checkpoint.imageId) - 1] = '\0';
+  return imageId == checkpoint.imageId && checkpoint.source == hashUrl(url);
+}
+
+bool OtaCheckpoint::save(const OtaCheckpoint_t& checkpoint) {
+  if (!m_preferences.begin("ota", false)) return false;
+  bool success = m_preferences.putBytes("checkpoint", &checkpoint, sizeof(checkpoint)) == sizeof(checkpoint);
+  m_preferences.end();
+  return success;
+}
+
+void OtaCheckpoint::clear() {
+  if (!m_preferences.begin("ota", false)) return;
+  m_preferences.remove("checkpoint");
+  m_preferences.end();
+}
+
+uint32_t OtaCheckpoint::hashUrl(const String& url) {
+  uint32_t hash = 2166136261u;
+  for (const char* c = url.c_str(); *c; c++) hash = (hash ^ (uint8_t)*c) * 16777619u;
+  return hash;
+}
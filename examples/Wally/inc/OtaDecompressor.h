@@ -0,0 +1,284 @@
+#pragma once
+
+#include <Arduino.h>
+#include "rom/miniz.h"
+#include "esp_rom_crc.h"
+#include "OtaSink.h"
+
+/**
+ * @class OtaDecompressor
+ * @brief Inflates a gzip compressed image on the fly.
+ *
+ * Uses the inflater in the ESP32 ROM, so it adds almost no code. Memory is bounded by the
+ * deflate window (32 KB) plus the inflater state (~11 KB), allocated in begin() and released
+ * in release(). Decompressed data is pushed into the next sink as it becomes available.
+ * The gzip trailer (CRC-32 and size) is checked in end().
+ *
+ * The ROM inflater (miniz 1.15) reads up to 2 bytes past the code it decodes and does not
+ * give them back at the end of the stream, so the trailer never reaches it: its position is
+ * known from the compressed size.
+ */
+class OtaDecompressor : public OtaSink {
+public:
+  OtaDecompressor();
+  ~OtaDecompressor();
+
+  /**
+     * @brief Check for the gzip magic bytes.
+     */
+  static bool isGzip(const uint8_t* data, size_t len);
+
+  /**
+     * @brief Allocate the window and start a new stream.
+     * @param next Sink receiving the decompressed image.
+     * @param compressedSize Size of the whole gzip file, trailer included.
+     * @return True on success.
+     */
+  bool begin(OtaSink& next, size_t compressedSize);
+
+  bool write(const uint8_t* data, size_t len) override;
+  String getError() const override { return m_error; }
+
+  /**
+     * @brief Check that the stream is complete and the trailer matches.
+     * @return True on success.
+     */
+  bool end();
+
+  /**
+     * @brief Free the window and inflater state.
+     */
+  void release();
+
+  /**
+     * @brief Number of decompressed bytes produced so far.
+     */
+  size_t outputSize() const { return m_outputSize; }
+
+private:
+  enum State_t { GZIP_HEADER, GZIP_EXTRA_LENGTH, GZIP_EXTRA, GZIP_NAME, GZIP_COMMENT, GZIP_HEADER_CRC, DEFLATE, DONE };
+
+  static const size_t HEADER_LENGTH = 10;
+  static const size_t TRAILER_LENGTH = 8;
+
+  static const uint8_t FLAG_HCRC = 0x02;
+  static const uint8_t FLAG_EXTRA = 0x04;
+  static const uint8_t FLAG_NAME = 0x08;
+  static const uint8_t FLAG_COMMENT = 0x10;
+
+  size_t parseHeader(const uint8_t* data, size_t len);
+  size_t inflate(const uint8_t* data, size_t len);
+  void nextHeaderField();
+
+  OtaSink* m_next;
+  tinfl_decompressor* m_inflator;
+  uint8_t* m_window;
+  size_t m_windowOffset;
+
+  State_t m_state;
+  uint8_t m_flags;
+  uint8_t m_field[HEADER_LENGTH];     ///< fixed header / extra length bytes
+  size_t m_fieldLength;
+  size_t m_remaining;                 ///< bytes left in the current variable length field
+  uint8_t m_trailer[TRAILER_LENGTH];
+  size_t m_trailerLength;
+  size_t m_streamLength;              ///< header and deflate stream: everything but the trailer
+  size_t m_received;
+
+  uint32_t m_crc;
+  size_t m_outputSize;
+  String m_error;
+};
+
+OtaDecompressor::OtaDecompressor()
+  : m_next(nullptr), m_inflator(nullptr), m_window(nullptr) {}
+
+OtaDecompressor::~OtaDecompressor() {
+  release();
+}
+
+bool OtaDecompressor::isGzip(const uint8_t* data, size_t len) {
+  return len >= 2 && data[0] == 0x1f && data[1] == 0x8b;
+}
+
+bool OtaDecompressor::begin(OtaSink& next, size_t compressedSize) {
+  if (compressedSize < HEADER_LENGTH + TRAILER_LENGTH) {
+    m_error = "Compressed image is truncated";
+    return false;
+  }
+  if (!m_inflator) m_inflator = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+  if (!m_window) m_window = (uint8_t*)malloc(TINFL_LZ_DICT_SIZE);
+  if (!m_inflator || !m_window) {
+    m_error = "Not enough memory to decompress OTA";
+    release();
+    return false;
+  }
+
+  tinfl_init(m_inflator);
+  m_next = &next;
+  m_windowOffset = 0;
+  m_state = GZIP_HEADER;
+  m_flags = 0;
+  m_fieldLength = 0;
+  m_remaining = 0;
+  m_trailerLength = 0;
+  m_streamLength = compressedSize - TRAILER_LENGTH;
+  m_received = 0;
+  m_crc = 0;
+  m_outputSize = 0;
+  m_error = "";
+  return true;
+}
+
+void OtaDecompressor::release() {
+  free(m_inflator);
+  free(m_window);
+  m_inflator = nullptr;
+  m_window = nullptr;
+}
+
+bool OtaDecompressor::write(const uint8_t* data, size_t len) {
+  while (len > 0) {
+    size_t stream = m_received < m_streamLength ? min(len, m_streamLength - m_received) : 0;
+    size_t used;
+    if (stream == 0) {
+      used = min(len, TRAILER_LENGTH - m_trailerLength);
+      if (used == 0) {
+        m_error = "Unexpected data after compressed image";
+        return false;
+      }
+      memcpy(m_trailer + m_trailerLength, data, used);
+      m_trailerLength += used;
+    } else if (m_state == DEFLATE) {
+      used = inflate(data, stream);
+    } else if (m_state == DONE) {
+      m_error = "Unexpected data after compressed image";
+      return false;
+    } else {
+      used = parseHeader(data, stream);
+    }
+
+    if (!m_error.isEmpty()) return false;
+    data += used;
+    len -= used;
+    m_received += used;
+  }
+  return true;
+}
+
+size_t OtaDecompressor::parseHeader(const uint8_t* data, size_t len) {
+  size_t used = 0;
+
+  while (used < len && m_state != DEFLATE && m_error.isEmpty()) {
+    uint8_t b = data[used++];
+
+    switch (m_state) {
+      case GZIP_HEADER:
+        m_field[m_fieldLength++] = b;
+        if (m_fieldLength < HEADER_LENGTH) break;
+        if (m_field[0] != 0x1f || m_field[1] != 0x8b || m_field[2] != 8) {
+          m_error = "Unsupported compressed image";
+          break;
+        }
+        m_flags = m_field[3];
+        m_state = GZIP_EXTRA_LENGTH;
+        m_fieldLength = 0;
+        if (!(m_flags & FLAG_EXTRA)) nextHeaderField();
+        break;
+      case GZIP_EXTRA_LENGTH:
+        m_field[m_fieldLength++] = b;
+        if (m_fieldLength < 2) break;
+        m_remaining = m_field[0] | (m_field[1] << 8);
+        m_state = GZIP_EXTRA;
+        if (m_remaining == 0) nextHeaderField();
+        break;
+      case GZIP_EXTRA:
+        if (--m_remaining == 0) nextHeaderField();
+        break;
+      case GZIP_NAME:
+      case GZIP_COMMENT:
+        if (b == 0) nextHeaderField();
+        break;
+      case GZIP_HEADER_CRC:
+        if (--m_remaining == 0) nextHeaderField();
+        break;
+      default:
+        break;
+    }
+  }
+  return used;
+}
+
+void OtaDecompressor::nextHeaderField() {
+  // Advance to the next optional field that is present, in gzip order.
+  while (true) {
+    switch (m_state) {
+      case GZIP_EXTRA_LENGTH:
+      case GZIP_EXTRA:
+        m_state = GZIP_NAME;
+        if (m_flags & FLAG_NAME) return;
+        break;
+      case GZIP_NAME:
+        m_state = GZIP_COMMENT;
+        if (m_flags & FLAG_COMMENT) return;
+        break;
+      case GZIP_COMMENT:
+        m_state = GZIP_HEADER_CRC;
+        m_remaining = 2;
+        if (m_flags & FLAG_HCRC) return;
+        break;
+      default:
+        m_state = DEFLATE;
+        return;
+    }
+  }
+}
+
+size_t OtaDecompressor::inflate(const uint8_t* data, size_t len) {
+  size_t used = 0;
+
+  while (true) {
+    size_t inBytes = len - used;
+    size_t outBytes = TINFL_LZ_DICT_SIZE - m_windowOffset;
+
+    tinfl_status status = tinfl_decompress(m_inflator, data + used, &inBytes, m_window, m_window + m_windowOffset, &outBytes, TINFL_FLAG_HAS_MORE_INPUT);
+    used += inBytes;
+
+    if (outBytes) {
+      m_crc = esp_rom_crc32_le(m_crc, m_window + m_windowOffset, outBytes);
+      if (!m_next->write(m_window + m_windowOffset, outBytes)) {
+        m_error = m_next->getError();
+        return used;
+      }
+      m_windowOffset = (m_windowOffset + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+      m_outputSize += outBytes;
+    }
+
+    if (status == TINFL_STATUS_DONE) {
+      m_state = DONE;
+      return used;
+    }
+    if (status < 0) {
+      m_error = "Corrupt compressed image";
+      return used;
+    }
+    if (status == TINFL_STATUS_NEEDS_MORE_INPUT) return used;
+    // TINFL_STATUS_HAS_MORE_OUTPUT: window wrapped, keep going
+  }
+}
+
+bool OtaDecompressor::end() {
+  if (m_state != DONE || m_trailerLength != TRAILER_LENGTH) {
+    m_error = "Compressed image is truncated";
+    return false;
+  }
+
+  uint32_t crc = m_trailer[0] | (m_trailer[1] << 8) | (m_trailer[2] << 16) | ((uint32_t)m_trailer[3] << 24);
+  uint32_t size = m_trailer[4] | (m_trailer[5] << 8) | (m_trailer[6] << 16) | ((uint32_t)m_trailer[7] << 24);
+
+  if (crc != m_crc || size != (uint32_t)m_outputSize) {
+    m_error = "Compressed image checksum mismatch";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
+#include "OtaSink.h"
+
+/**
+ * @struct OtaDeltaHeader_t
+ * @brief Header of a delta patch, as written by extras/tools/ota_delta.py.
+ */
+struct OtaDeltaHeader_t {
+  char magic[4];           ///< "WDP1"
+  uint32_t oldSize;        ///< Size of the image the patch applies to
+  uint32_t newSize;        ///< Size of the patched image
+  uint8_t oldSha256[32];   ///< SHA-256 of the image the patch applies to
+  uint8_t newSha256[32];   ///< SHA-256 of the patched image
+} __attribute__((packed));
+
+/**
+ * @class OtaDeltaPatcher
+ * @brief Rebuilds a new image from the running firmware and a streamed delta patch.
+ *
+ * The patch is a sequence of bsdiff style records, each followed by its data:
+ *
+ *     diffLength (u32) extraLength (u32) seek (i32) diff[diffLength] extra[extraLength]
+ *
+ * diff bytes are added to the old image at the current old position, extra bytes are
+ * copied as they are, then the old position moves by seek. Unchanged code produces
+ * mostly zero diff bytes, so patches are usually served gzip compressed.
+ *
+ * Streams without the patch magic are passed through unchanged, so the patcher can sit
+ * behind the decompressor without knowing what the archive contains.
+ */
+class OtaDeltaPatcher : public OtaSink {
+public:
+  OtaDeltaPatcher();
+
+  /**
+     * @brief Check for the patch magic bytes.
+     */
+  static bool isDelta(const uint8_t* data, size_t len);
+
+  /**
+     * @brief Start a new stream.
+     * @param next Sink receiving the patched (or passed through) image.
+     */
+  void begin(OtaSink& next);
+
+  bool write(const uint8_t* data, size_t len) override;
+  String getError() const override { return m_error; }
+
+  /**
+     * @brief Check that the patch was applied completely.
+     * @return True on success, or if the stream was not a patch.
+     */
+  bool end();
+
+  /**
+     * @brief True once the stream has been recognised as a patch.
+     */
+  bool isPatching() const { return m_state != SNIFF && m_state != PASS_THROUGH; }
+
+  /**
+     * @brief Expected SHA-256 of the patched image. Valid while isPatching().
+     */
+  const uint8_t* targetSha256() const { return m_header.newSha256; }
+
+private:
+  enum State_t { SNIFF, PASS_THROUGH, HEADER, CONTROL, DIFF, EXTRA, DONE };
+
+  static const size_t CONTROL_LENGTH = 12;
+
+  size_t parseField(const uint8_t* data, size_t len, uint8_t* field, size_t fieldLength);
+  bool checkOldImage();
+  bool startRecord();
+  bool applyDiff(const uint8_t* data, size_t len);
+  bool emit(const uint8_t* data, size_t len);
+
+  OtaSink* m_next;
+  const esp_partition_t* m_running;
+  State_t m_state;
+
+  OtaDeltaHeader_t m_header;
+  uint8_t m_control[CONTROL_LENGTH];
+  size_t m_fieldLength;         ///< bytes collected of the header or control record
+
+  size_t m_diffRemaining;
+  size_t m_extraRemaining;
+  int32_t m_seek;
+  size_t m_oldPosition;
+  size_t m_outputSize;
+
+  uint8_t m_buffer[1024];       ///< old image data; the writer task stack is too small for it
+  String m_error;
+};
+
+OtaDeltaPatcher::OtaDeltaPatcher()
+  : m_next(nullptr), m_running(nullptr), m_state(SNIFF) {}
+
+bool OtaDeltaPatcher::isDelta(const uint8_t* data, size_t len) {
+  return len >= 4 && memcmp(data, "WDP1", 4) == 0;
+}
+
+void OtaDeltaPatcher::begin(OtaSink& next) {
+  m_next = &next;
+  m_state = SNIFF;
+  m_fieldLength = 0;
+  m_diffRemaining = 0;
+  m_extraRemaining = 0;
+  m_seek = 0;
+  m_oldPosition = 0;
+  m_outputSize = 0;
+  m_error = "";
+}
+
+bool OtaDeltaPatcher::write(const uint8_t* data, size_t len) {
+  while (len > 0) {
+    size_t used = len;
+
+    switch (m_state) {
+      case SNIFF:
+        used = parseField(data, len, (uint8_t*)&m_header, sizeof(m_header.magic));
+        if (m_fieldLength < sizeof(m_header.magic)) break;
+        if (isDelta((uint8_t*)&m_header, m_fieldLength)) {
+          m_state = HEADER;
+        } else {
+          m_state = PASS_THROUGH;
+          if (!m_next->write((uint8_t*)&m_header, m_fieldLength)) {
+            m_error = m_next->getError();
+            return false;
+          }
+        }
+        break;
+      case PASS_THROUGH:
+        if (!m_next->write(data, len)) {
+          m_error = m_next->getError();
+          return false;
+        }
+        break;
+      case HEADER:
+        used = parseField(data, len, (uint8_t*)&m_header, sizeof(m_header));
+        if (m_fieldLength < sizeof(m_header)) break;
+        if (!checkOldImage()) return false;
+        m_state = m_header.newSize ? CONTROL : DONE;
+        m_fieldLength = 0;
+        break;
+      case CONTROL:
+        used = parseField(data, len, m_control, sizeof(m_control));
+        if (m_fieldLength == sizeof(m_control) && !startRecord()) return false;
+        break;
+      case DIFF:
+        used = min(len, m_diffRemaining);
+        if (!applyDiff(data, used)) return false;
+        m_diffRemaining -= used;
+        break;
+      case EXTRA:
+        used = min(len, m_extraRemaining);
+        if (!emit(data, used)) return false;
+        m_extraRemaining -= used;
+        break;
+      case DONE:
+        m_error = "Unexpected data after patch";
+        return false;
+    }
+
+    data += used;
+    len -= used;
+
+    // Advance through the record, also for records without diff or extra data.
+    if (m_state == DIFF && m_diffRemaining == 0) m_state = EXTRA;
+    if (m_state == EXTRA && m_extraRemaining == 0) {
+      int64_t position = (int64_t)m_oldPosition + m_seek;
+      if (position < 0 || position > m_header.oldSize) {
+        m_error = "Corrupt patch: seek out of range";
+        return false;
+      }
+      m_oldPosition = position;
+      m_state = m_outputSize == m_header.newSize ? DONE : CONTROL;
+      m_fieldLength = 0;
+    }
+  }
+  return true;
+}
+
+size_t OtaDeltaPatcher::parseField(const uint8_t* data, size_t len, uint8_t* field, size_t fieldLength) {
+  size_t used = min(len, fieldLength - m_fieldLength);
+  memcpy(field + m_fieldLength, data, used);
+  m_fieldLength += used;
+  return used;
+}
+
+bool OtaDeltaPatcher::checkOldImage() {
+  m_running = esp_ota_get_running_partition();
+  if (!m_running || m_header.oldSize > m_running->size) {
+    m_error = "Patch does not match the running firmware";
+    return false;
+  }
+
+  Serial.printf("[OtaDeltaPatcher.checkOldImage()]: Patching %u bytes of %s into %u bytes\r\n", m_header.oldSize, m_running->label, m_header.newSize);
+
+  uint8_t digest[32];
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+
+  for (size_t pos = 0; pos < m_header.oldSize; pos += sizeof(m_buffer)) {
+    size_t len = min(sizeof(m_buffer), m_header.oldSize - pos);
+    if (esp_partition_read(m_running, pos, m_buffer, len) != ESP_OK) {
+      mbedtls_sha256_free(&sha);
+      m_error = "Flash read failed";
+      return false;
+    }
+    mbedtls_sha256_update(&sha, m_buffer, len);
+  }
+  mbedtls_sha256_finish(&sha, digest);
+  mbedtls_sha256_free(&sha);
+
+  if (memcmp(digest, m_header.oldSha256, sizeof(digest)) != 0) {
+    m_error = "Patch does not match the running firmware";
+    return false;
+  }
+  return true;
+}
+
+bool OtaDeltaPatcher::startRecord() {
+  uint32_t diffLength, extraLength;
+  memcpy(&diffLength, m_control, 4);
+  memcpy(&extraLength, m_control + 4, 4);
+  memcpy(&m_seek, m_control + 8, 4);
+
+  if (m_outputSize + diffLength + extraLength > m_header.newSize || m_oldPosition + diffLength > m_header.oldSize) {
+    m_error = "Corrupt patch: record out of range";
+    return false;
+  }
+
+  m_diffRemaining = diffLength;
+  m_extraRemaining = extraLength;
+  m_state = DIFF;
+  return true;
+}
+
+bool OtaDeltaPatcher::applyDiff(const uint8_t* data, size_t len) {
+  while (len > 0) {
+    size_t chunk = min(len, sizeof(m_buffer));
+    if (esp_partition_read(m_running, m_oldPosition, m_buffer, chunk) != ESP_OK) {
+      m_error = "Flash read failed";
+      return false;
+    }
+    for (size_t i = 0; i < chunk; i++) m_buffer[i] += data[i];
+    if (!emit(m_buffer, chunk)) return false;
+
+    m_oldPosition += chunk;
+    data += chunk;
+    len -= chunk;
+  }
+  return true;
+}
+
+bool OtaDeltaPatcher::emit(const uint8_t* data, size_t len) {
+  if (!m_next->write(data, len)) {
+    m_error = m_next->getError();
+    return false;
+  }
+  m_outputSize += len;
+  return true;
+}
+
+bool OtaDeltaPatcher::end() {
+  if (m_state == SNIFF && m_fieldLength > 0) {  // shorter than the magic, hand it on
+    m_state = PASS_THROUGH;
+    if (!m_next->write((uint8_t*)&m_header, m_fieldLength)) {
+      m_error = m_next->getError();
+      return false;
+    }
+  }
+  if (!isPatching()) return true;
+
+  if (m_state != DONE) {
+    m_error = "Patch is truncated";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,389 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+#include "OtaSink.h"
+
+/**
+ * @struct OtaHttpStats_t
+ * @brief Connection use of an OtaHttpSource since the last end().
+ */
+struct OtaHttpStats_t {
+  uint32_t requests;     ///< HTTP requests sent
+  uint32_t connections;  ///< TCP (and TLS) connections opened
+  uint32_t connectMs;    ///< Time spent connecting, including TLS handshakes
+};
+
+/**
+ * @class OtaHttpSource
+ * @brief Downloads byte ranges of an OTA image over HTTP(S) and pushes them into a sink.
+ *
+ * Uses "Range: bytes=a-b" requests so an interrupted transfer can continue where it
+ * stopped. Servers that ignore Range are supported, but can only be read from the start.
+ *
+ * All requests to the same server share one keep-alive connection, so the TLS handshake
+ * is paid once per update rather than once per range. The Arduino TLS client does not
+ * expose session tickets, so a dropped connection costs a full handshake. The server
+ * certificate is checked against OTA_TLS_FINGERPRINT (SHA-256, no chain validation) right
+ * after the handshake, before a request is sent, or against OTA_TLS_CA_CERT if one is set.
+ */
+class OtaHttpSource {
+public:
+  OtaHttpSource();
+
+  /**
+     * @brief Learn the image size, its first bytes and whether the server honours Range requests.
+     * @param url Image URL (http:// or https://).
+     * @return True on success.
+     */
+  bool probe(const String& url);
+
+  /**
+     * @brief Download [offset, offset + length) and push it into the sink.
+     * @param url Image URL.
+     * @param offset First byte to fetch.
+     * @param length Number of bytes to fetch.
+     * @param sink Receives the bytes as they arrive.
+     * @param delivered Number of bytes pushed into the sink, also on failure.
+     * @return True if all bytes were delivered.
+     */
+  bool fetch(const String& url, size_t offset, size_t length, OtaSink& sink, size_t& delivered);
+
+  /**
+     * @brief Download a small file, e.g. a signature, into memory.
+     * @param url File URL.
+     * @param buffer Receives the file.
+     * @param capacity Buffer size. Larger files are rejected.
+     * @param length Receives the file size.
+     * @return True on success.
+     */
+  bool get(const String& url, uint8_t* buffer, size_t capacity, size_t& length);
+
+  /**
+     * @brief Close the connection and log the connection statistics.
+     */
+  void end();
+
+  const OtaHttpStats_t& stats() const { return m_stats; }
+
+  /**
+     * @brief Limit the download rate of fetch().
+     * @param bytesPerSec Maximum rate, 0 for no limit.
+     */
+  void setRateLimit(uint32_t bytesPerSec) { m_rateLimit = bytesPerSec; }
+
+  /**
+     * @brief Make a running fetch() return early. Safe to call from another task.
+     */
+  void setCancelled(bool cancelled) { m_cancelled = cancelled; }
+
+  /**
+     * @brief Total image size learned by probe().
+     */
+  size_t totalSize() const { return m_totalSize; }
+
+  /**
+     * @brief True if the server answered the probe with 206 Partial Content, and every range
+     *        request since with the range asked for.
+     */
+  bool supportsRange() const { return m_supportsRange; }
+
+  /**
+     * @brief First bytes of the image learned by probe(), used to detect the image format.
+     */
+  const uint8_t* head() const { return m_head; }
+
+  static const size_t HEAD_LENGTH = 4;
+
+  /**
+     * @brief False if the last failure came from the sink, which a retry will not fix.
+     */
+  bool retryable() const { return m_retryable; }
+
+  String getError() const { return m_error; }
+
+private:
+  static const int ERROR_CERTIFICATE_MISMATCH = -100;
+
+  int request(const String& url, size_t offset, size_t length);
+  static bool parseContentRange(const String& header, size_t& start, size_t& total);
+  int connect(const String& url);
+  bool verifyServer(const String& url);
+  String describe(int httpCode);
+  NetworkClient& clientFor(const String& url);
+
+  WiFiClient m_plainClient;
+  WiFiClientSecure m_secureClient;
+  HTTPClient m_http;
+  uint8_t m_buffer[OTA_BUFFER_SIZE];
+  uint8_t m_head[HEAD_LENGTH];
+  size_t m_totalSize;
+  bool m_supportsRange;
+  bool m_retryable;
+  uint32_t m_rateLimit;
+  volatile bool m_cancelled;
+  String m_server;  ///< "host:port" the open connection belongs to
+  OtaHttpStats_t m_stats;
+  String m_error;
+};
+
+OtaHttpSource::OtaHttpSource()
+  : m_head(), m_totalSize(0), m_supportsRange(false), m_retryable(true), m_rateLimit(0), m_cancelled(false), m_stats() {
+#ifdef OTA_TLS_CA_CERT
+  m_secureClient.setCACert(OTA_TLS_CA_CERT);
+#else
+  m_secureClient.setInsecure();  // see OTA_TLS_FINGERPRINT
+#endif
+}
+
+NetworkClient& OtaHttpSource::clientFor(const String& url) {
+  if (url.startsWith("https://")) return m_secureClient;
+  return m_plainClient;
+}
+
+// Returns 0 once connected to a trusted server, otherwise the error code for request().
+int OtaHttpSource::connect(const String& url) {
+  // scheme://host[:port]/path
+  int hostStart = url.indexOf("://") + 3;
+  int pathStart = url.indexOf('/', hostStart);
+  String server = url.substring(hostStart, pathStart < 0 ? url.length() : pathStart);
+  int colon = server.indexOf(':');
+  String host = colon < 0 ? server : server.substring(0, colon);
+  uint16_t port = colon < 0 ? (url.startsWith("https://") ? 443 : 80) : server.substring(colon + 1).toInt();
+  server = host + ":" + String(port);
+
+  NetworkClient& client = clientFor(url);
+  if (client.connected() && server == m_server) return 0;  // keep-alive, verified when it was opened
+
+  m_plainClient.stop();
+  m_secureClient.stop();
+  m_server = "";
+
+  unsigned long started = millis();
+  if (!client.connect(host.c_str(), port)) return HTTPC_ERROR_CONNECTION_REFUSED;
+  m_stats.connections++;
+  m_stats.connectMs += millis() - started;
+
+  // Before the first request, so nothing is sent to a server that fails the pin.
+  if (!verifyServer(url)) return ERROR_CERTIFICATE_MISMATCH;
+
+  m_server = server;
+  return 0;
+}
+
+bool OtaHttpSource::verifyServer(const String& url) {
+#ifdef OTA_TLS_FINGERPRINT
+  if (url.startsWith("https://") && !m_secureClient.verify(OTA_TLS_FINGERPRINT, nullptr)) {
+    m_secureClient.stop();
+    m_server = "";
+    m_retryable = false;
+    return false;
+  }
+#endif
+  return true;
+}
+
+int OtaHttpSource::request(const String& url, size_t offset, size_t length) {
+  // Connect here rather than in HTTPClient, which reuses the connection if the server is the same.
+  int error = connect(url);
+  if (error) return error;
+  if (!m_http.begin(clientFor(url), url)) return HTTPC_ERROR_CONNECTION_REFUSED;
+
+  m_http.setReuse(true);
+  m_http.setTimeout(OTA_READ_TIMEOUT_MS);
+
+  const char* headers[] = { "Content-Range" };
+  m_http.collectHeaders(headers, 1);
+
+  if (length > 0) {
+    char range[48];
+    snprintf(range, sizeof(range), "bytes=%u-%u", offset, offset + length - 1);
+    m_http.addHeader("Range", range);
+  }
+
+  m_stats.requests++;
+  int httpCode = m_http.GET();
+
+  // HTTPClient reconnects by itself if the server closed the connection just before
+  // GET. Such a response is dropped unless that connection passes the pin as well.
+  if (httpCode > 0 && !verifyServer(url)) return ERROR_CERTIFICATE_MISMATCH;
+  return httpCode;
+}
+
+String OtaHttpSource::describe(int httpCode) {
+  if (httpCode == ERROR_CERTIFICATE_MISMATCH) return "Server certificate does not match OTA_TLS_FINGERPRINT";
+  return "GET... failed, error: " + (httpCode < 0 ? m_http.errorToString(httpCode) : String(httpCode));
+}
+
+bool OtaHttpSource::probe(const String& url) {
+  m_retryable = true;
+
+  int httpCode = request(url, 0, HEAD_LENGTH);
+
+  if (httpCode == HTTP_CODE_PARTIAL_CONTENT || httpCode == HTTP_CODE_OK) {
+    memset(m_head, 0, sizeof(m_head));
+    m_http.getStreamPtr()->readBytes(m_head, sizeof(m_head));
+  }
+
+  if (httpCode == HTTP_CODE_PARTIAL_CONTENT) {
+    size_t start;
+    if (!parseContentRange(m_http.header("Content-Range"), start, m_totalSize) || start != 0) m_totalSize = 0;
+    m_supportsRange = true;
+  } else if (httpCode == HTTP_CODE_OK) {
+    m_totalSize = m_http.getSize() > 0 ? m_http.getSize() : 0;
+    m_supportsRange = false;
+    m_http.getStreamPtr()->stop();  // do not download the whole body here
+  } else {
+    m_error = describe(httpCode);
+    m_http.end();
+    return false;
+  }
+
+  m_http.end();
+
+  if (m_totalSize == 0) {
+    m_error = "There was no content length in the response";
+    return false;
+  }
+
+  Serial.printf("[OtaHttpSource.probe()]: OTA size: %u bytes, range requests: %s\r\n", m_totalSize, m_supportsRange ? "yes" : "no");
+  return true;
+}
+
+bool OtaHttpSource::fetch(const String& url, size_t offset, size_t length, OtaSink& sink, size_t& delivered) {
+  delivered = 0;
+  m_retryable = true;
+
+  if (!m_supportsRange && offset != 0) {
+    m_error = "Server does not support range requests";
+    m_retryable = false;
+    return false;
+  }
+
+  int httpCode = request(url, offset, length);
+  if (httpCode != HTTP_CODE_PARTIAL_CONTENT && httpCode != HTTP_CODE_OK) {
+    m_error = describe(httpCode);
+    m_http.end();
+    return false;
+  }
+
+  // A proxy or cache may ignore Range on any request, not only the probe. Its body starts
+  // at byte 0, which must not be written at offset.
+  size_t start = 0, total = m_totalSize;
+  bool ranged = httpCode == HTTP_CODE_PARTIAL_CONTENT;
+  if ((offset != 0 && !ranged) || (ranged && (!parseContentRange(m_http.header("Content-Range"), start, total) || start != offset || total != m_totalSize))) {
+    m_error = ranged ? "Server sent another range: " + m_http.header("Content-Range") : "Server ignored the range request";
+    m_retryable = false;
+    m_supportsRange = false;  // start over with whole-file requests
+    m_http.getStreamPtr()->stop();
+    m_http.end();
+    return false;
+  }
+
+  NetworkClient* stream = m_http.getStreamPtr();
+  unsigned long started = millis();
+  unsigned long lastData = started;
+
+  while (delivered < length) {
+    if (m_cancelled) {
+      m_error = "OTA update cancelled";
+      m_retryable = false;
+      stream->stop();
+      m_http.end();
+      return false;
+    }
+
+    size_t available = stream->available();
+    if (available == 0) {
+      if (!stream->connected() || millis() - lastData > OTA_READ_TIMEOUT_MS) break;
+      delay(1);
+      continue;
+    }
+
+    int read = stream->read(m_buffer, min(available, min(sizeof(m_buffer), length - delivered)));
+    if (read <= 0) continue;
+    lastData = millis();
+
+    if (!sink.write(m_buffer, read)) {
+      m_error = sink.getError();
+      m_retryable = false;
+      stream->stop();
+      m_http.end();
+      return false;
+    }
+    delivered += read;
+
+    if (m_rateLimit) {
+      unsigned long due = (uint64_t)delivered * 1000 / m_rateLimit;
+      unsigned long elapsed = millis() - started;
+      if (due > elapsed) delay(due - elapsed);
+      lastData = millis();
+    }
+  }
+
+  if (delivered < length) {
+    m_error = "Connection lost after " + String(offset + delivered) + " bytes";
+    stream->stop();
+    m_http.end();
+    return false;
+  }
+
+  // A server without Range support keeps sending; drop the rest of the body.
+  if (httpCode == HTTP_CODE_OK && (size_t)m_http.getSize() > length) stream->stop();
+
+  m_http.end();
+  return true;
+}
+
+bool OtaHttpSource::parseContentRange(const String& header, size_t& start, size_t& total) {
+  // Content-Range: bytes 0-3/1310720
+  unsigned long first, last, size;
+  if (sscanf(header.c_str(), "bytes %lu-%lu/%lu", &first, &last, &size) != 3 || first > last || last >= size) return false;
+  start = first;
+  total = size;
+  return true;
+}
+
+bool OtaHttpSource::get(const String& url, uint8_t* buffer, size_t capacity, size_t& length) {
+  length = 0;
+  m_retryable = true;
+
+  int httpCode = request(url, 0, 0);
+  if (httpCode != HTTP_CODE_OK) {
+    m_error = describe(httpCode);
+    m_http.end();
+    return false;
+  }
+
+  int size = m_http.getSize();
+  if (size <= 0 || (size_t)size > capacity) {
+    m_error = "Unexpected size " + String(size);
+    m_http.getStreamPtr()->stop();
+    m_http.end();
+    return false;
+  }
+
+  length = m_http.getStreamPtr()->readBytes(buffer, size);
+  m_http.end();
+
+  if (length != (size_t)size) {
+    m_error = "Connection lost after " + String(length) + " bytes";
+    return false;
+  }
+  return true;
+}
+
+void OtaHttpSource::end() {
+  m_http.end();
+  m_plainClient.stop();
+  m_secureClient.stop();
+  m_server = "";
+
+  if (m_stats.requests) {
+    Serial.printf("[OtaHttpSource.end()]: %u requests over %u connections, %u ms connecting\r\n",
+                  m_stats.requests, m_stats.connections, m_stats.connectMs);
+  }
+  m_stats = {};
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_image_format.h>
+#include <esp_app_desc.h>
+#include <hal/efuse_hal.h>
+#include "OtaSink.h"
+
+/**
+ * @class OtaImageVerifier
+ * @brief Checks the ESP image header before anything is written to flash.
+ *
+ * Holds back the first bytes of the image until the image header, the first segment
+ * header and the application description are complete, then rejects images built for
+ * another chip or chip revision. A wrong image fails with the first network buffer
+ * instead of in esp_ota_set_boot_partition() after the whole download.
+ */
+class OtaImageVerifier : public OtaSink {
+public:
+  /**
+     * @brief Start a new image.
+     * @param next Sink receiving the image once the header is accepted.
+     */
+  void begin(OtaSink& next);
+
+  bool write(const uint8_t* data, size_t len) override;
+  String getError() const override { return m_error; }
+
+private:
+  static const size_t HEADER_LENGTH = sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t);
+
+  bool checkHeader();
+
+  OtaSink* m_next;
+  uint8_t m_header[HEADER_LENGTH];
+  size_t m_headerLength;
+  bool m_accepted;
+  String m_error;
+};
+
+void OtaImageVerifier::begin(OtaSink& next) {
+  m_next = &next;
+  m_headerLength = 0;
+  m_accepted = false;
+  m_error = "";
+}
+
+bool OtaImageVerifier::write(const uint8_t* data, size_t len) {
+  if (!m_accepted) {
+    size_t used = min(len, HEADER_LENGTH - m_headerLength);
+    memcpy(m_header + m_headerLength, data, used);
+    m_headerLength += used;
+    data += used;
+    len -= used;
+
+    if (m_headerLength < HEADER_LENGTH) return true;
+    if (!checkHeader()) return false;
+    m_accepted = true;
+
+    if (!m_next->write(m_header, m_headerLength)) {
+      m_error = m_next->getError();
+      return false;
+    }
+  }
+
+  if (len && !m_next->write(data, len)) {
+    m_error = m_next->getError();
+    return false;
+  }
+  return true;
+}
+
+bool OtaImageVerifier::checkHeader() {
+  esp_image_header_t image;
+  esp_app_desc_t app;
+  memcpy(&image, m_header, sizeof(image));
+  memcpy(&app, m_header + sizeof(image) + sizeof(esp_image_segment_header_t), sizeof(app));
+
+  if (image.magic != ESP_IMAGE_HEADER_MAGIC || image.segment_count == 0 || image.segment_count > ESP_IMAGE_MAX_SEGMENTS) {
+    m_error = "Not an ESP32 firmware image";
+    return false;
+  }
+
+  if (image.chip_id != CONFIG_IDF_FIRMWARE_CHIP_ID) {
+    m_error = "Image is for chip id " + String(image.chip_id) + ", this is " + String(CONFIG_IDF_FIRMWARE_CHIP_ID);
+    return false;
+  }
+
+  unsigned revision = efuse_hal_chip_revision();
+  if (revision < image.min_chip_rev_full || (image.max_chip_rev_full != 0xFFFF && revision > image.max_chip_rev_full)) {
+    m_error = "Image does not support chip revision " + String(revision);
+    return false;
+  }
+
+  if (app.magic_word != ESP_APP_DESC_MAGIC_WORD) {
+    m_error = "Image has no application description";
+    return false;
+  }
+
+  app.project_name[sizeof(app.project_name) - 1] = '\0';
+  app.version[sizeof(app.version) - 1] = '\0';
+  Serial.printf("[OtaImageVerifier.checkHeader()]: %s %s, built with %s\r\n", app.project_name, app.version, app.idf_ver);
+  return true;
+}
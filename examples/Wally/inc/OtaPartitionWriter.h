@@ -0,0 +1,160 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <spi_flash_mmap.h>
+#include <mbedtls/sha256.h>
+#include "OtaSink.h"
+
+/**
+ * @class OtaPartitionWriter
+ * @brief Writes a firmware image into the next OTA partition.
+ *
+ * Unlike Update, writing can start at any sector aligned offset, so a download can
+ * resume after a reboot. Sectors are erased just before they are first written. The
+ * partition only becomes bootable in end(), after ESP-IDF has validated the image.
+ */
+class OtaPartitionWriter : public OtaSink {
+public:
+  OtaPartitionWriter();
+
+  /**
+     * @brief Select the next OTA partition and prepare to write.
+     * @param imageSize Total image size in bytes, 0 if not known up front (compressed image).
+     * @param offset Sector aligned offset to continue from. 0 starts a new image.
+     * @return True on success.
+     */
+  bool begin(size_t imageSize, size_t offset = 0);
+
+  bool write(const uint8_t* data, size_t len) override;
+  String getError() const override { return m_error; }
+
+  /**
+     * @brief Hash the bytes already in flash, [0, offset()). Used to validate a resumed download.
+     * @param sha Initialised SHA-256 context to update.
+     * @return True on success.
+     */
+  bool hashWritten(mbedtls_sha256_context& sha);
+
+  /**
+     * @brief Validate the complete image and make it the boot partition.
+     * @return True on success.
+     */
+  bool end();
+
+  /**
+     * @brief Number of bytes written so far (including a resumed prefix).
+     */
+  size_t offset() const { return m_offset; }
+
+  /**
+     * @brief Total image size given to begin(), the partition size if it was not known.
+     */
+  size_t size() const { return m_size; }
+
+  /**
+     * @brief The partition being written, nullptr before begin().
+     */
+  const esp_partition_t* partition() const { return m_partition; }
+
+private:
+  const esp_partition_t* m_partition;
+  size_t m_size;
+  bool m_sizeKnown;
+  size_t m_offset;
+  size_t m_erasedUpTo;  ///< First byte that has not been erased yet (sector aligned)
+  String m_error;
+};
+
+OtaPartitionWriter::OtaPartitionWriter()
+  : m_partition(nullptr), m_size(0), m_sizeKnown(false), m_offset(0), m_erasedUpTo(0) {}
+
+bool OtaPartitionWriter::begin(size_t imageSize, size_t offset) {
+  m_partition = esp_ota_get_next_update_partition(NULL);
+  if (!m_partition) {
+    m_error = "No OTA partition";
+    return false;
+  }
+
+  if (imageSize > m_partition->size) {
+    m_error = "Not enough space to begin OTA";
+    return false;
+  }
+
+  m_sizeKnown = imageSize != 0;
+  m_size = m_sizeKnown ? imageSize : m_partition->size;
+
+  if (offset % SPI_FLASH_SEC_SIZE != 0 || offset > m_size) {
+    m_error = "Invalid resume offset";
+    return false;
+  }
+
+  m_offset = offset;
+  m_erasedUpTo = offset;
+  m_error = "";
+
+  Serial.printf("[OtaPartitionWriter.begin()]: Writing %u bytes to %s from offset %u\r\n", imageSize, m_partition->label, offset);
+  return true;
+}
+
+bool OtaPartitionWriter::write(const uint8_t* data, size_t len) {
+  if (!m_partition) {
+    m_error = "Writer not started";
+    return false;
+  }
+
+  if (m_offset + len > m_size) {
+    m_error = m_sizeKnown ? "Image larger than announced" : "Image larger than partition";
+    return false;
+  }
+
+  while (m_offset + len > m_erasedUpTo) {
+    esp_err_t err = esp_partition_erase_range(m_partition, m_erasedUpTo, SPI_FLASH_SEC_SIZE);
+    if (err != ESP_OK) {
+      m_error = "Flash erase failed: " + String(esp_err_to_name(err));
+      return false;
+    }
+    m_erasedUpTo += SPI_FLASH_SEC_SIZE;
+  }
+
+  esp_err_t err = esp_partition_write(m_partition, m_offset, data, len);
+  if (err != ESP_OK) {
+    m_error = "Flash write failed: " + String(esp_err_to_name(err));
+    return false;
+  }
+
+  m_offset += len;
+  return true;
+}
+
+bool OtaPartitionWriter::hashWritten(mbedtls_sha256_context& sha) {
+  uint8_t buffer[1024];
+  size_t pos = 0;
+
+  while (pos < m_offset) {
+    size_t len = min(sizeof(buffer), m_offset - pos);
+    if (esp_partition_read(m_partition, pos, buffer, len) != ESP_OK) {
+      m_error = "Flash read failed";
+      return false;
+    }
+    mbedtls_sha256_update(&sha, buffer, len);
+    pos += len;
+  }
+  return true;
+}
+
+bool OtaPartitionWriter::end() {
+  if (m_offset == 0 || (m_sizeKnown && m_offset != m_size)) {
+    m_error = "Written only : " + String(m_offset) + "/" + String(m_size) + ". Retry?";
+    return false;
+  }
+
+  // Validates the image (segments, checksum, appended SHA-256) before switching.
+  esp_err_t err = esp_ota_set_boot_partition(m_partition);
+  if (err != ESP_OK) {
+    m_error = "Error Occurred. Error #: " + String(esp_err_to_name(err));
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <ESPmDNS.h>
+#include <WebServer.h>
+#include <esp_ota_ops.h>
+#include <esp_image_format.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * @class OtaPeerCache
+ * @brief Shares the running firmware with other devices on the LAN.
+ *
+ * Serves the image in the running partition at http://<ip>:OTA_PEER_CACHE_PORT/firmware.bin
+ * (with Range support) and advertises it as mDNS service _wally-ota._tcp with its
+ * version in the TXT record. The running image was verified when it was installed.
+ *
+ * A device that needs the same version downloads it from a peer first. Peers are not
+ * trusted: OTAManager checks the result against the hash published next to the origin
+ * URL and falls back to the origin on any failure.
+ */
+class OtaPeerCache {
+public:
+  OtaPeerCache();
+
+  /**
+     * @brief Start serving and advertising the running image. Call once WiFi is connected.
+     * @param version Version of the running firmware.
+     * @return True on success.
+     */
+  bool begin(const String& version);
+
+  /**
+     * @brief Look for a peer that serves an image version.
+     * @param version Wanted version.
+     * @param url Receives the image URL on the peer.
+     * @return True if a peer was found.
+     */
+  bool findPeer(const String& version, String& url);
+
+private:
+  static void serverTaskEntry(void* arg);
+  void serverTask();
+  void handleFirmware();
+  bool measureImage();
+
+  WebServer m_server;
+  const esp_partition_t* m_running;
+  size_t m_imageSize;
+  String m_version;
+  TaskHandle_t m_task;
+  uint8_t m_buffer[1460];  ///< one TCP segment
+};
+
+OtaPeerCache::OtaPeerCache()
+  : m_server(OTA_PEER_CACHE_PORT), m_running(nullptr), m_imageSize(0), m_task(nullptr) {}
+
+bool OtaPeerCache::begin(const String& version) {
+  if (m_task) return true;
+  m_version = version;
+
+  if (xTaskCreatePinnedToCore(&OtaPeerCache::serverTaskEntry, "OtaPeerTask", OTA_PEER_TASK_STACK_SIZE, this, OTA_PEER_TASK_PRIORITY, &m_task, NETWORK_TASK_CORE) != pdPASS) {
+    m_task = nullptr;
+    Serial.printf("[OtaPeerCache.begin()]: Task creation failed\r\n");
+    return false;
+  }
+  return true;
+}
+
+bool OtaPeerCache::measureImage() {
+  m_running = esp_ota_get_running_partition();
+  if (!m_running) return false;
+
+  // Walks the segments and the appended hash, which gives the exact image length.
+  esp_partition_pos_t position = { m_running->address, m_running->size };
+  esp_image_metadata_t metadata;
+  if (esp_image_verify(ESP_IMAGE_VERIFY_SILENT, &position, &metadata) != ESP_OK) return false;
+
+  m_imageSize = metadata.image_len;
+  return true;
+}
+
+void OtaPeerCache::serverTaskEntry(void* arg) {
+  static_cast<OtaPeerCache*>(arg)->serverTask();
+}
+
+void OtaPeerCache::serverTask() {
+  if (!measureImage()) {
+    Serial.printf("[OtaPeerCache.serverTask()]: Running image is not valid, not sharing it\r\n");
+    m_task = nullptr;
+    vTaskDelete(NULL);
+    return;
+  }
+
+  const char* headers[] = { "Range" };
+  m_server.collectHeaders(headers, 1);
+  m_server.on("/firmware.bin", HTTP_GET, [this]() { handleFirmware(); });
+  m_server.begin();
+
+  String hostname = "wally-" + String((uint32_t)ESP.getEfuseMac(), HEX);
+  if (MDNS.begin(hostname.c_str())) {
+    MDNS.addService("wally-ota", "tcp", OTA_PEER_CACHE_PORT);
+    MDNS.addServiceTxt("wally-ota", "tcp", "version", m_version.c_str());
+    MDNS.addServiceTxt("wally-ota", "tcp", "size", String(m_imageSize).c_str());
+  }
+
+  Serial.printf("[OtaPeerCache.serverTask()]: Sharing %s (%u bytes) at http://%s:%d/firmware.bin\r\n",
+                m_version.c_str(), m_imageSize, WiFi.localIP().toString().c_str(), OTA_PEER_CACHE_PORT);
+
+  while (true) {
+    m_server.handleClient();
+    delay(2);
+  }
+}
+
+void OtaPeerCache::handleFirmware() {
+  size_t start = 0;
+  size_t end = m_imageSize - 1;
+  int code = 200;
+
+  // Range: bytes=a-b, bytes=a- or bytes=-n (the last n bytes)
+  String range = m_server.header("Range");
+  if (range.startsWith("bytes=")) {
+    int dash = range.indexOf('-');
+    bool hasEnd = dash > 0 && (size_t)dash + 1 < range.length();
+    if (dash == 6) {
+      size_t suffix = hasEnd ? range.substring(dash + 1).toInt() : 0;
+      start = suffix ? m_imageSize - min(suffix, m_imageSize) : m_imageSize;  // "bytes=-0" is unsatisfiable
+    } else {
+      start = range.substring(6, dash).toInt();
+      if (hasEnd) end = min((size_t)range.substring(dash + 1).toInt(), end);
+    }
+    if (start > end) {
+      m_server.sendHeader("Content-Range", "bytes */" + String(m_imageSize));
+      m_server.send(416);
+      return;
+    }
+    code = 206;
+    m_server.sendHeader("Content-Range", "bytes " + String(start) + "-" + String(end) + "/" + String(m_imageSize));
+  }
+
+  m_server.sendHeader("Accept-Ranges", "bytes");
+  m_server.setContentLength(end - start + 1);
+  m_server.send(code, "application/octet-stream", "");
+
+  NetworkClient client = m_server.client();
+  for (size_t pos = start; pos <= end && client.connected();) {
+    size_t len = min(sizeof(m_buffer), end + 1 - pos);
+    if (esp_partition_read(m_running, pos, m_buffer, len) != ESP_OK) break;
+    if (client.write(m_buffer, len) != len) break;
+    pos += len;
+  }
+}
+
+bool OtaPeerCache::findPeer(const String& version, String& url) {
+  int count = MDNS.queryService("wally-ota", "tcp");
+
+  for (int i = 0; i < count; i++) {
+    if (MDNS.address(i) == WiFi.localIP() || MDNS.txt(i, "version") != version) continue;
+
+    url = "http://" + MDNS.address(i).toString() + ":" + String(MDNS.port(i)) + "/firmware.bin";
+    Serial.printf("[OtaPeerCache.findPeer()]: %s has version %s\r\n", MDNS.hostname(i).c_str(), version.c_str());
+    return true;
+  }
+  return false;
+}
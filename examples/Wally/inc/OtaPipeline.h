@@ -0,0 +1,239 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "OtaSink.h"
+
+/**
+ * @struct OtaPipelineStats_t
+ * @brief Throughput and per-stage stall times of an OtaPipeline run.
+ */
+struct OtaPipelineStats_t {
+  uint32_t bytes;          ///< Bytes passed through the pipeline
+  uint32_t elapsedMs;      ///< Wall time between begin() and end()
+  uint32_t readerStallMs;  ///< Network side waiting for a free buffer (flash bound)
+  uint32_t writerBusyMs;   ///< Flash side writing downstream (erase, write, hash)
+  uint32_t writerStallMs;  ///< Flash side waiting for data (network bound)
+};
+
+/**
+ * @class OtaPipeline
+ * @brief Overlaps network reception with flash erase/write.
+ *
+ * The pipeline is a sink for the network reader (the calling task). Data is copied into
+ * a pool of pre-allocated buffers that a separate writer task hands to the downstream
+ * sink, so a sector erase no longer stops the download and the TCP window stays open.
+ */
+class OtaPipeline : public OtaSink {
+public:
+  OtaPipeline();
+  ~OtaPipeline();
+
+  /**
+     * @brief Allocate the buffer pool and start the writer task.
+     * @param downstream Sink the writer task writes into.
+     * @return True on success.
+     */
+  bool begin(OtaSink& downstream);
+
+  /**
+     * @brief Queue bytes for the writer task. Reader side only.
+     * @return False once the downstream sink has failed.
+     */
+  bool write(const uint8_t* data, size_t len) override;
+
+  /**
+     * @brief Hand over the partially filled buffer and wait until the writer is idle.
+     * @return False if the downstream sink has failed.
+     */
+  bool drain();
+
+  /**
+     * @brief Stop the writer task and release the buffers.
+     */
+  void end();
+
+  String getError() const override { return m_error; }
+
+  const OtaPipelineStats_t& stats() const { return m_stats; }
+
+private:
+  static const uint8_t DRAIN_MARKER = 0xFF;
+  static const uint8_t STOP_MARKER = 0xFE;
+
+  static void writerTaskEntry(void* arg);
+  void writerTask();
+  bool submit();
+  bool acquire();
+
+  OtaSink* m_downstream;
+  uint8_t* m_pool;
+  size_t m_lengths[OTA_PIPELINE_BUFFERS];
+  QueueHandle_t m_free;    ///< indices of empty buffers
+  QueueHandle_t m_filled;  ///< indices of full buffers (and markers)
+  TaskHandle_t m_writer;
+  TaskHandle_t m_reader;
+  int m_current;           ///< buffer being filled by the reader, -1 if none
+  volatile bool m_failed;
+  String m_error;
+
+  OtaPipelineStats_t m_stats;
+  int64_t m_startedAt;
+  int64_t m_readerStallUs;
+  int64_t m_writerBusyUs;
+  int64_t m_writerStallUs;
+};
+
+OtaPipeline::OtaPipeline()
+  : m_downstream(nullptr), m_pool(nullptr), m_free(nullptr), m_filled(nullptr), m_writer(nullptr), m_reader(nullptr), m_current(-1), m_failed(false) {
+  memset(&m_stats, 0, sizeof(m_stats));
+}
+
+OtaPipeline::~OtaPipeline() {
+  end();
+}
+
+bool OtaPipeline::begin(OtaSink& downstream) {
+  end();
+
+  m_downstream = &downstream;
+  m_reader = xTaskGetCurrentTaskHandle();
+  m_current = -1;
+  m_failed = false;
+  m_error = "";
+  memset(&m_stats, 0, sizeof(m_stats));
+  m_readerStallUs = m_writerBusyUs = m_writerStallUs = 0;
+
+  m_pool = (uint8_t*)malloc(OTA_PIPELINE_BUFFERS * OTA_BUFFER_SIZE);
+  m_free = xQueueCreate(OTA_PIPELINE_BUFFERS, sizeof(uint8_t));
+  m_filled = xQueueCreate(OTA_PIPELINE_BUFFERS + 1, sizeof(uint8_t));  // + 1 for a marker
+  if (!m_pool || !m_free || !m_filled) {
+    m_error = "OTA pipeline allocation failed";
+    end();
+    return false;
+  }
+
+  for (uint8_t i = 0; i < OTA_PIPELINE_BUFFERS; i++) xQueueSend(m_free, &i, 0);
+
+  if (xTaskCreate(&OtaPipeline::writerTaskEntry, "OtaWriterTask", OTA_WRITER_TASK_STACK_SIZE, this, OTA_WRITER_TASK_PRIORITY, &m_writer) != pdPASS) {
+    m_writer = nullptr;
+    m_error = "OTA writer task creation failed";
+    end();
+    return false;
+  }
+
+  m_startedAt = esp_timer_get_time();
+  return true;
+}
+
+bool OtaPipeline::write(const uint8_t* data, size_t len) {
+  while (len > 0) {
+    if (m_failed) return false;
+    if (m_current < 0 && !acquire()) return false;
+
+    size_t copy = min(len, (size_t)OTA_BUFFER_SIZE - m_lengths[m_current]);
+    memcpy(m_pool + m_current * OTA_BUFFER_SIZE + m_lengths[m_current], data, copy);
+    m_lengths[m_current] += copy;
+    data += copy;
+    len -= copy;
+    m_stats.bytes += copy;
+
+    if (m_lengths[m_current] == OTA_BUFFER_SIZE && !submit()) return false;
+  }
+  return !m_failed;
+}
+
+bool OtaPipeline::drain() {
+  if (!m_writer) return false;
+  if (m_current >= 0 && m_lengths[m_current] > 0) submit();
+
+  uint8_t marker = DRAIN_MARKER;
+  xQueueSend(m_filled, &marker, portMAX_DELAY);
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);  // writer has handled everything before the marker
+
+  return !m_failed;
+}
+
+void OtaPipeline::end() {
+  if (m_writer) {
+    drain();
+    uint8_t marker = STOP_MARKER;
+    xQueueSend(m_filled, &marker, portMAX_DELAY);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    m_writer = nullptr;
+
+    m_stats.elapsedMs = (esp_timer_get_time() - m_startedAt) / 1000;
+    m_stats.readerStallMs = m_readerStallUs / 1000;
+    m_stats.writerBusyMs = m_writerBusyUs / 1000;
+    m_stats.writerStallMs = m_writerStallUs / 1000;
+
+    Serial.printf("[OtaPipeline.end()]: %u bytes in %u ms (%u KB/s). Network waited %u ms for flash, flash busy %u ms, flash waited %u ms for network\r\n",
+                  m_stats.bytes, m_stats.elapsedMs, m_stats.elapsedMs ? m_stats.bytes / m_stats.elapsedMs : 0,
+                  m_stats.readerStallMs, m_stats.writerBusyMs, m_stats.writerStallMs);
+  }
+
+  if (m_free) vQueueDelete(m_free);
+  if (m_filled) vQueueDelete(m_filled);
+  free(m_pool);
+  m_free = m_filled = nullptr;
+  m_pool = nullptr;
+  m_current = -1;
+}
+
+bool OtaPipeline::acquire() {
+  uint8_t index;
+  int64_t waitStart = esp_timer_get_time();
+  while (xQueueReceive(m_free, &index, pdMS_TO_TICKS(100)) != pdTRUE) {
+    if (m_failed) return false;
+  }
+  m_readerStallUs += esp_timer_get_time() - waitStart;
+
+  m_current = index;
+  m_lengths[index] = 0;
+  return true;
+}
+
+bool OtaPipeline::submit() {
+  uint8_t index = m_current;
+  m_current = -1;
+  return xQueueSend(m_filled, &index, portMAX_DELAY) == pdTRUE;
+}
+
+void OtaPipeline::writerTaskEntry(void* arg) {
+  static_cast<OtaPipeline*>(arg)->writerTask();
+}
+
+void OtaPipeline::writerTask() {
+  uint8_t index;
+
+  while (true) {
+    int64_t waitStart = esp_timer_get_time();
+    xQueueReceive(m_filled, &index, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+
+    if (index == STOP_MARKER) {
+      xTaskNotifyGive(m_reader);
+      vTaskDelete(NULL);
+      return;
+    }
+
+    if (index == DRAIN_MARKER) {
+      xTaskNotifyGive(m_reader);
+      continue;
+    }
+
+    m_writerStallUs += now - waitStart;
+
+    // After a failure keep recycling buffers so the reader never blocks.
+    if (!m_failed && !m_downstream->write(m_pool + index * OTA_BUFFER_SIZE, m_lengths[index])) {
+      m_error = m_downstream->getError();
+      m_failed = true;
+    }
+    m_writerBusyUs += esp_timer_get_time() - now;
+
+    xQueueSend(m_free, &index, portMAX_DELAY);
+  }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Arduino.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/error.h>
+#include "OtaHttpSource.h"
+
+/**
+ * @class OtaSignature
+ * @brief Verifies the detached signature of an OTA image.
+ *
+ * The signature is downloaded from "<image url>.sig" before the image, so a missing one
+ * fails early. It signs the SHA-256 of the final image (after decompression or patching),
+ * which the OTA manager computes while streaming:
+ *
+ *     openssl dgst -sha256 -sign ota_private.pem -out firmware.bin.sig firmware.bin
+ *
+ * RSA (PKCS#1 v1.5) and ECDSA keys are supported. See OTA_SIGNING_PUBLIC_KEY.
+ */
+class OtaSignature {
+public:
+  OtaSignature();
+
+  /**
+     * @brief Download the signature for an image.
+     * @param source Source used for the image.
+     * @param url Image URL.
+     * @return True on success.
+     */
+  bool fetch(OtaHttpSource& source, const String& url);
+
+  /**
+     * @brief Check the signature against the image hash.
+     * @param publicKey PEM encoded public key.
+     * @param sha256 SHA-256 of the image.
+     * @return True if the signature is valid.
+     */
+  bool verify(const char* publicKey, const uint8_t* sha256);
+
+  String getError() const { return m_error; }
+
+private:
+  uint8_t m_signature[MBEDTLS_PK_SIGNATURE_MAX_SIZE];
+  size_t m_length;
+  String m_error;
+};
+
+OtaSignature::OtaSignature()
+  : m_length(0) {}
+
+bool OtaSignature::fetch(OtaHttpSource& source, const String& url) {
+  m_length = 0;
+  if (!source.get(url + ".sig", m_signature, sizeof(m_signature), m_length)) {
+    m_error = "Signature download failed: " + source.getError();
+    return false;
+  }
+  return true;
+}
+
+bool OtaSignature::verify(const char* publicKey, const uint8_t* sha256) {
+  mbedtls_pk_context pk;
+  mbedtls_pk_init(&pk);
+
+  int ret = mbedtls_pk_parse_public_key(&pk, (const unsigned char*)publicKey, strlen(publicKey) + 1);
+  if (ret == 0) ret = mbedtls_pk_verify(&pk, MBEDTLS_MD_SHA256, sha256, 32, m_signature, m_length);
+  mbedtls_pk_free(&pk);
+
+  if (ret != 0) {
+    char message[64];
+    mbedtls_strerror(ret, message, sizeof(message));
+    m_error = "Signature verification failed: " + String(message);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @class OtaSink
+ * @brief A stage in the OTA data path that consumes a stream of bytes.
+ *
+ * Sources push downloaded bytes into a sink, sinks may transform them and push them
+ * further down (verification, decompression, flash write).
+ */
+class OtaSink {
+public:
+  virtual ~OtaSink() {}
+
+  /**
+     * @brief Consume the next bytes of the stream.
+     * @return True on success. On failure getError() describes the problem.
+     */
+  virtual bool write(const uint8_t* data, size_t len) = 0;
+
+  /**
+     * @brief Describes the last failure.
+     */
+  virtual String getError() const = 0;
+};
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <Arduino.h>
+#include "SinricPro.h"
+#include "SinricProSwitch.h"
+
+#define EVENT_QUEUE_MAX_DEVICES  4  ///< Maximum number of devices tracked by PowerStateEventQueue
+
+/**
+ * @class PowerStateEventQueue
+ * @brief Per-device outbound queue for power state events.
+ *
+ * Each device has a single slot holding the latest local state, so any number of toggles
+ * collapses into one event. A toggle that ends where the cloud already is cancels out.
+ * Pending events survive disconnects and are sent in one batch from SinricPro.onConnected().
+ * While connected, events are paced by a token bucket so bursts stay within the server
+ * rate limit. Queueing an event does not touch the heap.
+ */
+class PowerStateEventQueue {
+public:
+  /**
+     * @brief Constructor for PowerStateEventQueue.
+     * @param maxEventsPerSecond Maximum number of events sent per second.
+     */
+  PowerStateEventQueue(uint8_t maxEventsPerSecond = EVENT_QUEUE_MAX_EVENTS_PER_SEC);
+
+  /**
+     * @brief Register a device. The id must stay valid for the lifetime of the queue. Call from setup().
+     * @return True on success, false if the device table is full.
+     */
+  bool addDevice(const char* deviceId);
+
+  /**
+     * @brief Change the rate limit.
+     * @param maxEventsPerSecond Maximum number of events sent per second.
+     */
+  void setMaxEventsPerSecond(uint8_t maxEventsPerSecond);
+
+  /**
+     * @brief Queue a local power state change, replacing any pending state for the device.
+     * @return True if the device is known.
+     */
+  bool enqueue(const char* deviceId, bool state);
+
+  /**
+     * @brief Record a state the cloud already knows (e.g. set by onPowerState). Drops any pending event.
+     */
+  void confirm(const char* deviceId, bool state);
+
+  /**
+     * @brief Send every pending event now. Call from SinricPro.onConnected().
+     */
+  void flush();
+
+  /**
+     * @brief Send pending events within the rate limit. Call from loop().
+     */
+  void handle();
+
+  /**
+     * @brief Number of devices with an unsent state.
+     */
+  uint8_t pendingCount() const;
+
+private:
+  struct Slot_t {
+    const char* deviceId;
+    SinricProSwitch* device;     ///< looked up once, SinricPro[] builds a String
+    bool pending;                ///< state has not reached the cloud yet
+    bool state;                  ///< latest local state
+    bool known;                  ///< cloudState is valid
+    bool cloudState;             ///< last state the cloud acknowledged
+    unsigned long nextAttempt;   ///< do not retry before this time (millis)
+  };
+
+  Slot_t* findSlot(const char* deviceId);
+  bool send(Slot_t& slot);
+  void refill();
+
+  Slot_t m_slots[EVENT_QUEUE_MAX_DEVICES];
+  uint8_t m_count;
+  uint8_t m_maxEventsPerSecond;
+  uint32_t m_tokens;             ///< available tokens, scaled by 1000
+  unsigned long m_lastRefill;
+};
+
+PowerStateEventQueue::PowerStateEventQueue(uint8_t maxEventsPerSecond)
+  : m_count(0), m_maxEventsPerSecond(maxEventsPerSecond ? maxEventsPerSecond : 1), m_lastRefill(0) {
+  memset(m_slots, 0, sizeof(m_slots));
+  m_tokens = m_maxEventsPerSecond * 1000;
+}
+
+bool PowerStateEventQueue::addDevice(const char* deviceId) {
+  if (findSlot(deviceId)) return true;
+  if (m_count >= EVENT_QUEUE_MAX_DEVICES) return false;
+
+  SinricProSwitch& device = SinricPro[deviceId];
+  m_slots[m_count].deviceId = deviceId;
+  m_slots[m_count].device = &device;
+  m_count++;
+  return true;
+}
+
+void PowerStateEventQueue::setMaxEventsPerSecond(uint8_t maxEventsPerSecond) {
+  m_maxEventsPerSecond = maxEventsPerSecond ? maxEventsPerSecond : 1;
+  m_tokens = min(m_tokens, (uint32_t)m_maxEventsPerSecond * 1000);
+}
+
+bool PowerStateEventQueue::enqueue(const char* deviceId, bool state) {
+  Slot_t* slot = findSlot(deviceId);
+  if (!slot) return false;
+
+  slot->state = state;
+  slot->pending = !(slot->known && slot->cloudState == state);
+  return true;
+}
+
+void PowerStateEventQueue::confirm(const char* deviceId, bool state) {
+  Slot_t* slot = findSlot(deviceId);
+  if (!slot) return;
+
+  slot->state = state;
+  slot->known = true;
+  slot->cloudState = state;
+  slot->pending = false;
+}
+
+void PowerStateEventQueue::flush() {
+  uint8_t sent = 0;
+  for (uint8_t i = 0; i < m_count; i++) {
+    if (m_slots[i].pending && send(m_slots[i])) sent++;
+  }
+  if (sent) Serial.printf("[PowerStateEventQueue.flush()]: Sent %u queued event(s)\r\n", sent);
+}
+
+void PowerStateEventQueue::handle() {
+  if (!SinricPro.isConnected()) return;
+  refill();
+
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < m_count && m_tokens >= 1000; i++) {
+    Slot_t& slot = m_slots[i];
+    if (!slot.pending || (long)(now - slot.nextAttempt) < 0) continue;
+
+    m_tokens -= 1000;
+    send(slot);
+  }
+}
+
+uint8_t PowerStateEventQueue::pendingCount() const {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < m_count; i++) {
+    if (m_slots[i].pending) count++;
+  }
+  return count;
+}
+
+PowerStateEventQueue::Slot_t* PowerStateEventQueue::findSlot(const char* deviceId) {
+  for (uint8_t i = 0; i < m_count; i++) {
+    if (strcmp(m_slots[i].deviceId, deviceId) == 0) return &m_slots[i];
+  }
+  return nullptr;
+}
+
+bool PowerStateEventQueue::send(Slot_t& slot) {
+  // Rejected while offline or by the SDK's own event limiter: keep it and back off.
+  if (!slot.device->sendPowerStateEvent(slot.state)) {
+    slot.nextAttempt = millis() + EVENT_QUEUE_RETRY_INTERVAL_MS;
+    return false;
+  }
+
+  slot.known = true;
+  slot.cloudState = slot.state;
+  slot.pending = false;
+  return true;
+}
+
+void PowerStateEventQueue::refill() {
+  unsigned long now = millis();
+  uint32_t elapsed = now - m_lastRefill;
+  m_lastRefill = now;
+
+  uint32_t capacity = (uint32_t)m_maxEventsPerSecond * 1000;
+  uint32_t added = min(elapsed, (uint32_t)1000) * m_maxEventsPerSecond;  // 1 token per (1000 / rate) ms
+  m_tokens = min(m_tokens + added, capacity);
+}
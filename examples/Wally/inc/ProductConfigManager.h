@@ -10,6 +10,8 @@
 #include <ArduinoJson.h>
 #include <Preferences.h>
 #include "SPIFFS.h"
+#include <ProvTrace.h>
+#include <JsonArena.h>
 
 /**
  * @struct ProductConfig_t
@@ -52,11 +54,12 @@ public:
   bool loadConfig();
 
   /**
-     * @brief Saves the configuration to the file system.
-     * @param doc JsonDocument containing the configuration to save.
+     * @brief Checks a configuration and saves it to the file system as it is.
+     * @param json Configuration JSON, e.g. the decrypted provisioning payload.
+     * @param length Length of json.
      * @return bool True if saving was successful, false otherwise.
      */
-  bool saveJsonConfig(const JsonDocument &doc);
+  bool saveConfig(const char *json, size_t length);
 
   /**
      * @brief Clears the configuration from the file system and memory.
@@ -74,6 +77,7 @@ ProductConfigManager::ProductConfigManager(ProductConfig_t &config)
 ProductConfigManager::~ProductConfigManager() {}
 
 bool ProductConfigManager::loadConfig() {
+  TRACE_SCOPE("configLoad");
   Serial.printf("[ProductConfigManager.loadConfig()]: Loading config...\r\n");
 
   if (!SPIFFS.exists(PRODUCT_CONFIG_FILE)) {
@@ -87,7 +91,7 @@ bool ProductConfigManager::loadConfig() {
     return false;
   }
 
-  JsonDocument doc;
+  JsonDocument doc(JsonArena::instance());
   DeserializationError err = deserializeJson(doc, configFile);
 
   if (err) {
@@ -122,44 +126,48 @@ bool ProductConfigManager::loadConfig() {
   return true;
 }
 
-bool ProductConfigManager::saveJsonConfig(const JsonDocument &doc) {
-  Serial.printf("[ProductConfigManager.saveJsonConfig()]: Saving config...\r\n");
+bool ProductConfigManager::saveConfig(const char *json, size_t length) {
+  TRACE_SCOPE("configSave");
+  Serial.printf("[ProductConfigManager.saveConfig()]: Saving config (%u bytes)...\r\n", length);
 
-  String appKey = doc[F("credentials")][F("appkey")] | "";
-  String appSecret = doc[F("credentials")][F("appsecret")] | "";
-
-  if (appKey.length() == 0 || appSecret.length() == 0) {
-    Serial.printf("[ProductConfigManager.saveJsonConfig()]: Failed! Invalid configurations!\r\n");
+  JsonDocument doc(JsonArena::instance());
+  DeserializationError err = deserializeJson(doc, json, length);
+  if (err) {
+    Serial.printf("[ProductConfigManager.saveConfig()]: deserializeJson() failed: %s\r\n", err.c_str());
     return false;
   }
 
-  Serial.printf("[ProductConfigManager.saveJsonConfig()]: config: \r\n");
-  serializeJsonPretty(doc, Serial);
+  const char *appKey = doc[F("credentials")][F("appkey")] | "";
+  const char *appSecret = doc[F("credentials")][F("appsecret")] | "";
+
+  if (appKey[0] == '\0' || appSecret[0] == '\0') {
+    Serial.printf("[ProductConfigManager.saveConfig()]: Failed! Invalid configurations!\r\n");
+    return false;
+  }
 
   // Remove existing config file if it exists
   if (SPIFFS.exists(PRODUCT_CONFIG_FILE)) {
-    Serial.printf("[ProductConfigManager.saveJsonConfig()]: Removing existing config file..\r\n");
+    Serial.printf("[ProductConfigManager.saveConfig()]: Removing existing config file..\r\n");
     SPIFFS.remove(PRODUCT_CONFIG_FILE);
   }
 
   File configFile = SPIFFS.open(PRODUCT_CONFIG_FILE, FILE_WRITE);
 
   if (!configFile) {
-    Serial.printf("[ProductConfigManager.saveJsonConfig] Open config file failed!!!\r\n");
+    Serial.printf("[ProductConfigManager.saveConfig] Open config file failed!!!\r\n");
     return false;
   }
 
-  // Write JSON to file
-  String jsonStr;
-  serializeJson(doc, jsonStr);
-  size_t bytesWritten = configFile.print(jsonStr);
+  // Write the JSON as received: loadConfig() parses it again, no need to serialize it here.
+  size_t bytesWritten = configFile.write(reinterpret_cast<const uint8_t *>(json), length);
   configFile.close();
 
-  Serial.printf("[ProductConfigManager.saveJsonConfig] Bytes written: %u\r\n", bytesWritten);
+  Serial.printf("[ProductConfigManager.saveConfig] Bytes written: %u\r\n", bytesWritten);
+  if (bytesWritten != length) return false;
 
   // Update config struct with new values
-  strlcpy(config.appKey, appKey.c_str(), sizeof(config.appKey));
-  strlcpy(config.appSecret, appSecret.c_str(), sizeof(config.appSecret));
+  strlcpy(config.appKey, appKey, sizeof(config.appKey));
+  strlcpy(config.appSecret, appSecret, sizeof(config.appSecret));
 
   strlcpy(config.switch_1_id, doc[F("devices")][0][F("id")] | "", sizeof(config.switch_1_id));
   strlcpy(config.switch_1_name, doc[F("devices")][0][F("name")] | "", sizeof(config.switch_1_name));
@@ -167,12 +175,13 @@ bool ProductConfigManager::saveJsonConfig(const JsonDocument &doc) {
   strlcpy(config.switch_2_id, doc[F("devices")][1][F("id")] | "", sizeof(config.switch_2_id));
   strlcpy(config.switch_2_name, doc[F("devices")][1][F("name")] | "", sizeof(config.switch_2_name));
 
-  Serial.printf("[ProductConfigManager.saveJsonConfig()]: success!\r\n");
+  Serial.printf("[ProductConfigManager.saveConfig()]: success!\r\n");
 
   return true;
 }
 
 bool ProductConfigManager::clear() {
+  TRACE_SCOPE("configClear");
   Serial.printf("[ProductConfigManager.clear()]: Clear config...");
 
   // Remove config file from file system
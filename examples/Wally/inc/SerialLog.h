@@ -0,0 +1,25 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdarg.h>
+
+#define SERIAL_LOG_BUFFER_SIZE  192  ///< Longer messages are truncated
+
+/**
+ * @brief Serial.printf() without the heap.
+ *
+ * Print::printf() formats into a 64 byte stack buffer and mallocs a bigger one for longer
+ * messages. This one formats into SERIAL_LOG_BUFFER_SIZE bytes of stack and truncates, so
+ * it can be used on the allocation-free paths (see AllocGuard.h).
+ */
+void serialPrintf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+void serialPrintf(const char* format, ...) {
+  char buffer[SERIAL_LOG_BUFFER_SIZE];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (length <= 0) return;
+  Serial.write((const uint8_t*)buffer, min((size_t)length, sizeof(buffer) - 1));
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+/**
+ * @class SpscQueue
+ * @brief Lock-free, fixed-size, single-producer/single-consumer queue.
+ *
+ * Safe to push from an ISR and pop from a task (or between two tasks) as long as
+ * there is exactly one producer and exactly one consumer. No heap is used.
+ *
+ * @tparam T Item type. Must be trivially copyable.
+ * @tparam N Capacity. Must be a power of two. One slot is kept free.
+ */
+template <typename T, size_t N>
+class SpscQueue {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+  /**
+     * @brief Push an item. Producer side only.
+     * @return True on success, false if the queue is full.
+     */
+  inline bool push(const T& item) {
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t next = (tail + 1) & (N - 1);
+    if (next == m_head.load(std::memory_order_acquire)) return false;
+
+    m_items[tail] = item;
+    m_tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  /**
+     * @brief Pop an item. Consumer side only.
+     * @return True if an item was returned, false if the queue is empty.
+     */
+  inline bool pop(T& item) {
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) return false;
+
+    item = m_items[head];
+    m_head.store((head + 1) & (N - 1), std::memory_order_release);
+    return true;
+  }
+
+  /**
+     * @brief Check whether the queue is empty.
+     */
+  inline bool empty() const {
+    return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+  }
+
+private:
+  T m_items[N];
+  std::atomic<size_t> m_head{ 0 };  ///< Next slot to read. Written by the consumer.
+  std::atomic<size_t> m_tail{ 0 };  ///< Next slot to write. Written by the producer.
+};
@@ -4,6 +4,7 @@
 #include <WiFi.h>
 #include "FS.h"
 #include "SPIFFS.h" 
+#include <ProvTrace.h>
 
 struct WifiSettings_t {
   char primarySSID[32];        ///< Primary SSID of the WiFi network.
@@ -297,6 +298,8 @@ bool WiFiManager::connectToWiFi() {
 }
 
 bool WiFiManager::connectToWiFi(const char* wifi_ssid, const char* wifi_password) {
+  TRACE_SCOPE("wifiConnect");
+
 #if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 0, 0))
   WiFi.setMinSecurity(WIFI_AUTH_WEP);  // https://github.com/espressif/arduino-esp32/blob/master/docs/source/troubleshooting.rst
 #endif
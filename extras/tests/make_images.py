@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""
+Write sample base/target firmware pairs for test_ota_delta.
+
+    python3 make_images.py build/
+
+This writes base.bin, the "running" firmware, and one <case>.bin target per case. The
+images are deterministic, so a failure reproduces with the same patch bytes.
+"""
+
+import os
+import random
+import sys
+
+
+def firmware(rng, size):
+    """Random "code" with repeated blocks and zero padding, roughly like a real image."""
+    image = bytearray()
+    blocks = []
+    while len(image) < size:
+        kind = rng.random()
+        if blocks and kind < 0.3:
+            image += rng.choice(blocks)
+        elif kind < 0.4:
+            image += bytes(rng.randrange(16, 256))
+        else:
+            block = bytes(rng.getrandbits(8) for _ in range(rng.randrange(32, 512)))
+            blocks.append(block)
+            image += block
+    return bytes(image[:size])
+
+
+def edit(rng, base):
+    """A new build: functions grow and shrink, so code after them moves, and constants change."""
+    target = bytearray(base)
+    for _ in range(12):
+        pos = rng.randrange(len(target))
+        action = rng.random()
+        if action < 0.4:
+            target[pos:pos] = bytes(rng.getrandbits(8) for _ in range(rng.randrange(1, 300)))
+        elif action < 0.7:
+            del target[pos:pos + rng.randrange(1, 300)]
+        else:
+            for i in range(pos, min(pos + 64, len(target)), 4):
+                target[i] = (target[i] + 1) & 0xFF
+    return bytes(target)
+
+
+def main():
+    out = sys.argv[1]
+    os.makedirs(out, exist_ok=True)
+    rng = random.Random(0x57A11)
+
+    base = firmware(rng, 96 * 1024)
+    images = {
+        "base": base,
+        "edit": edit(rng, base),
+        "same": base,
+        "grow": base + firmware(rng, 8 * 1024),
+        "shrink": base[4096:60000],
+        "unrelated": firmware(rng, 32 * 1024),
+        "empty": b"",
+    }
+    for name, data in images.items():
+        with open(os.path.join(out, name + ".bin"), "wb") as f:
+            f.write(data)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,452 @@
+#pragma once
+
+// Just enough of the Arduino core to compile the example's managers on the host.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <type_traits>
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define ESP_ARDUINO_VERSION_VAL(major, minor, patch) ((major << 16) | (minor << 8) | (patch))
+#define ESP_ARDUINO_VERSION ESP_ARDUINO_VERSION_VAL(3, 1, 3)
+
+#define ARDUINO_ISR_ATTR
+#define F(string) (string)
+
+#define LOW           0x0
+#define HIGH          0x1
+#define INPUT         0x01
+#define OUTPUT        0x03
+#define INPUT_PULLUP  0x05
+#define CHANGE        0x03
+
+#define DEC 10
+#define HEX 16
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch) ((major << 16) | (minor << 8) | (patch))
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(5, 3, 2)
+
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t length = strlen(src);
+  if (size) {
+    size_t n = length < size - 1 ? length : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return length;
+}
+#endif
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+/**
+ * @brief Arduino-ESP32 String: up to 11 characters in the object, longer ones on the heap in
+ * 16 byte steps. Assigning a null pointer frees the buffer, assigning "" keeps it.
+ */
+class String {
+public:
+  String(const char* value = "") { if (value) copy(value, strlen(value)); }
+  String(const std::string& value) { copy(value.c_str(), value.length()); }
+  String(const String& other) { *this = other; }
+  String(String&& other) { move(other); }
+  explicit String(char c) { char text[2] = { c, '\0' }; copy(text, 1); }
+  explicit String(int value, unsigned char base = 10) { number((long long)value, base); }
+  explicit String(unsigned value, unsigned char base = 10) { number((unsigned long long)value, base); }
+  explicit String(long value, unsigned char base = 10) { number((long long)value, base); }
+  explicit String(unsigned long value, unsigned char base = 10) { number((unsigned long long)value, base); }
+  explicit String(long long value, unsigned char base = 10) { number(value, base); }
+  explicit String(unsigned long long value, unsigned char base = 10) { number(value, base); }
+  explicit String(double value, unsigned int decimals = 2) {
+    char text[40];
+    copy(text, snprintf(text, sizeof(text), "%.*f", decimals, value));
+  }
+  ~String() { invalidate(); }
+
+  String& operator=(const String& other) {
+    if (this == &other) return *this;
+    if (other.m_heap || other.m_sso) copy(other.c_str(), other.m_length);
+    else invalidate();
+    return *this;
+  }
+  String& operator=(String&& other) {
+    if (this != &other) move(other);
+    return *this;
+  }
+  String& operator=(const char* value) {
+    if (value) copy(value, strlen(value));
+    else invalidate();
+    return *this;
+  }
+
+  bool reserve(unsigned int size) {
+    if (capacity() >= size) {
+      if (!m_heap && !m_sso) {
+        m_sso = true;
+        m_small[0] = '\0';
+      }
+      return true;
+    }
+    if (size < sizeof(m_small)) {
+      m_sso = true;
+      m_small[0] = '\0';
+      return true;
+    }
+    unsigned int allocated = (size + 16) & ~0xf;
+    char* buffer = (char*)realloc(m_heap, allocated);
+    if (!buffer) return false;
+    if (!m_heap) {
+      memcpy(buffer, c_str(), m_length + 1);
+      m_sso = false;
+    }
+    m_heap = buffer;
+    m_capacity = allocated - 1;
+    return true;
+  }
+
+  const char* c_str() const { return m_heap ? m_heap : m_sso ? m_small : ""; }
+  unsigned int length() const { return m_length; }
+  bool isEmpty() const { return m_length == 0; }
+  void clear() { setLength(0); }
+
+  bool concat(const char* value, unsigned int length) {
+    if (!value) return false;
+    if (!length) return true;
+    if (!reserve(m_length + length)) return false;
+    memmove(buffer() + m_length, value, length);
+    setLength(m_length + length);
+    return true;
+  }
+  bool concat(const char* value) { return value && concat(value, strlen(value)); }
+  bool concat(const String& value) { return concat(value.c_str(), value.m_length); }
+  bool concat(char c) { return concat(&c, 1); }
+  template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, char>::value>::type>
+  bool concat(T value) { return concat(String(value)); }
+
+  template <typename T>
+  String& operator+=(const T& value) {
+    concat(value);
+    return *this;
+  }
+
+  bool equals(const char* other) const { return strcmp(c_str(), other ? other : "") == 0; }
+  bool equals(const String& other) const { return m_length == other.m_length && equals(other.c_str()); }
+  bool operator==(const String& other) const { return equals(other); }
+  bool operator==(const char* other) const { return equals(other); }
+  bool operator!=(const String& other) const { return !equals(other); }
+  bool operator!=(const char* other) const { return !equals(other); }
+  bool operator<(const String& other) const { return strcmp(c_str(), other.c_str()) < 0; }
+  char operator[](unsigned int index) const { return index < m_length ? c_str()[index] : '\0'; }
+  char charAt(unsigned int index) const { return (*this)[index]; }
+
+  bool startsWith(const String& prefix) const { return prefix.m_length <= m_length && strncmp(c_str(), prefix.c_str(), prefix.m_length) == 0; }
+  bool endsWith(const String& suffix) const { return suffix.m_length <= m_length && strcmp(c_str() + m_length - suffix.m_length, suffix.c_str()) == 0; }
+  int indexOf(char c, unsigned int from = 0) const {
+    const char* found = from < m_length ? strchr(c_str() + from, c) : nullptr;
+    return found ? found - c_str() : -1;
+  }
+  int indexOf(const String& text, unsigned int from = 0) const {
+    const char* found = from <= m_length ? strstr(c_str() + from, text.c_str()) : nullptr;
+    return found ? found - c_str() : -1;
+  }
+  int lastIndexOf(char c) const {
+    const char* found = strrchr(c_str(), c);
+    return found ? found - c_str() : -1;
+  }
+  String substring(unsigned int from, unsigned int to = (unsigned int)-1) const {
+    if (to > m_length) to = m_length;
+    if (from >= to) return String();
+    String result;
+    result.copy(c_str() + from, to - from);
+    return result;
+  }
+  void remove(unsigned int index, unsigned int count = (unsigned int)-1) {
+    if (index >= m_length) return;
+    if (count > m_length - index) count = m_length - index;
+    memmove(buffer() + index, c_str() + index + count, m_length - index - count);
+    setLength(m_length - count);
+  }
+  void getBytes(unsigned char* buffer, unsigned int size, unsigned int index = 0) const {
+    if (!size || !buffer) return;
+    unsigned int length = index < m_length ? min2(size - 1, m_length - index) : 0;
+    memcpy(buffer, c_str() + index, length);
+    buffer[length] = '\0';
+  }
+  long toInt() const { return atol(c_str()); }
+  float toFloat() const { return atof(c_str()); }
+  void trim() {
+    unsigned int start = 0, end = m_length;
+    while (start < end && isspace((unsigned char)c_str()[start])) start++;
+    while (end > start && isspace((unsigned char)c_str()[end - 1])) end--;
+    memmove(buffer(), c_str() + start, end - start);
+    if (m_heap || m_sso) setLength(end - start);
+  }
+
+private:
+  static unsigned int min2(unsigned int a, unsigned int b) { return a < b ? a : b; }
+  unsigned int capacity() const { return m_heap ? m_capacity : sizeof(m_small) - 1; }
+  char* buffer() { return m_heap ? m_heap : m_small; }
+  void setLength(unsigned int length) {
+    m_length = length;
+    if (m_heap || m_sso) buffer()[length] = '\0';
+  }
+  void copy(const char* value, unsigned int length) {
+    if (!reserve(length)) {
+      invalidate();
+      return;
+    }
+    memmove(buffer(), value, length);
+    setLength(length);
+  }
+  template <typename T>
+  void number(T value, unsigned char base) {
+    char text[72];
+    char* end = text + sizeof(text) - 1;
+    char* p = end;
+    *p = '\0';
+    bool negative = std::is_signed<T>::value && value < 0;
+    unsigned long long rest = negative ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    do {
+      unsigned digit = rest % base;
+      *--p = digit < 10 ? '0' + digit : 'a' + digit - 10;
+      rest /= base;
+    } while (rest);
+    if (negative) *--p = '-';
+    copy(p, end - p);
+  }
+  void invalidate() {
+    free(m_heap);
+    m_heap = nullptr;
+    m_sso = false;
+    m_capacity = 0;
+    m_length = 0;
+  }
+  void move(String& other) {
+    invalidate();
+    if (other.m_heap) {
+      m_heap = other.m_heap;
+      m_capacity = other.m_capacity;
+      m_length = other.m_length;
+      other.m_heap = nullptr;
+      other.invalidate();
+    } else if (other.m_sso) {
+      copy(other.m_small, other.m_length);
+    }
+  }
+
+  char* m_heap = nullptr;
+  unsigned int m_capacity = 0;
+  unsigned int m_length = 0;
+  bool m_sso = false;
+  char m_small[12];
+};
+
+class StringSumHelper : public String {
+public:
+  StringSumHelper(const String& value) : String(value) {}
+  StringSumHelper(const char* value) : String(value) {}
+};
+
+inline StringSumHelper operator+(const String& lhs, const String& rhs) {
+  StringSumHelper sum(lhs);
+  sum.concat(rhs);
+  return sum;
+}
+inline StringSumHelper operator+(const String& lhs, const char* rhs) {
+  StringSumHelper sum(lhs);
+  sum.concat(rhs);
+  return sum;
+}
+inline StringSumHelper operator+(const char* lhs, const String& rhs) {
+  StringSumHelper sum(lhs);
+  sum.concat(rhs);
+  return sum;
+}
+inline StringSumHelper operator+(const String& lhs, char rhs) {
+  StringSumHelper sum(lhs);
+  sum.concat(rhs);
+  return sum;
+}
+
+/**
+ * @brief Print with the Arduino-ESP32 printf(): 64 bytes on the stack, longer messages malloc.
+ */
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t written = 0;
+    while (written < size && write(buffer[written])) written++;
+    return written;
+  }
+  size_t write(const char* text) { return text ? write((const uint8_t*)text, strlen(text)) : 0; }
+  size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+
+  size_t print(const char* text) { return write(text); }
+  size_t print(const String& text) { return write(text.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, char>::value>::type>
+  size_t print(T value) {
+    char text[32];
+    if (std::is_floating_point<T>::value) snprintf(text, sizeof(text), "%.2f", (double)value);
+    else if (std::is_signed<T>::value) snprintf(text, sizeof(text), "%lld", (long long)value);
+    else snprintf(text, sizeof(text), "%llu", (unsigned long long)value);
+    return write(text);
+  }
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T& value) { return print(value) + println(); }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    char small[64];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+    if (length < 0) return 0;
+    if ((size_t)length < sizeof(small)) return write((const uint8_t*)small, length);
+
+    char* large = (char*)malloc(length + 1);
+    if (!large) return 0;
+    va_start(args, format);
+    vsnprintf(large, length + 1, format, args);
+    va_end(args);
+    size_t written = write((const uint8_t*)large, length);
+    free(large);
+    return written;
+  }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual size_t readBytes(char* buffer, size_t length) {
+    size_t count = 0;
+    int c;
+    while (count < length && (c = read()) >= 0) buffer[count++] = (char)c;
+    return count;
+  }
+  size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+  void setTimeout(unsigned long timeout) {}
+};
+
+/**
+ * @brief Serial output goes to stdout when verbose is set.
+ */
+struct HostSerial : public Stream {
+  void begin(unsigned long baud) {}
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    if (verbose) fwrite(buffer, 1, size, stdout);
+    return size;
+  }
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  operator bool() const { return true; }
+
+  bool verbose = false;
+};
+
+inline HostSerial Serial;
+
+class IPAddress {
+public:
+  IPAddress() : m_address(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : m_address(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+  IPAddress(uint32_t address) : m_address(address) {}
+  uint8_t operator[](int index) const { return m_address >> (index * 8); }
+  operator uint32_t() const { return m_address; }
+  bool operator==(const IPAddress& other) const { return m_address == other.m_address; }
+  bool operator!=(const IPAddress& other) const { return m_address != other.m_address; }
+  bool fromString(const char* text) {
+    unsigned a, b, c, d;
+    if (sscanf(text, "%u.%u.%u.%u", &a, &b, &c, &d) != 4) return false;
+    *this = IPAddress(a, b, c, d);
+    return true;
+  }
+  bool fromString(const String& text) { return fromString(text.c_str()); }
+  String toString() const {
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    return String(text);
+  }
+
+private:
+  uint32_t m_address;
+};
+
+template <typename T, typename L>
+inline typename std::common_type<T, L>::type min(const T& a, const L& b) { return b < a ? b : a; }
+
+template <typename T, typename L>
+inline typename std::common_type<T, L>::type max(const T& a, const L& b) { return a < b ? b : a; }
+
+inline unsigned long millis() { return esp_timer_get_time() / 1000; }
+inline unsigned long micros() { return esp_timer_get_time(); }
+inline void delay(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms)); }
+inline void yield() { std::this_thread::yield(); }
+
+// GPIOs: levels in memory. hostSetPin() changes an input and runs its interrupt handler
+// on the calling thread, as the GPIO ISR would.
+inline int hostPinLevel[64];
+inline void (*hostPinHandler[64])(void*);
+inline void* hostPinArg[64];
+
+inline void pinMode(uint8_t pin, uint8_t mode) {
+  if (mode == INPUT_PULLUP) hostPinLevel[pin] = HIGH;
+}
+inline void digitalWrite(uint8_t pin, uint8_t level) { hostPinLevel[pin] = level; }
+inline int digitalRead(uint8_t pin) { return hostPinLevel[pin]; }
+inline void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode) {
+  hostPinArg[pin] = arg;
+  hostPinHandler[pin] = handler;
+}
+inline void detachInterrupt(uint8_t pin) { hostPinHandler[pin] = nullptr; }
+inline void hostSetPin(uint8_t pin, int level) {
+  if (hostPinLevel[pin] == level) return;
+  hostPinLevel[pin] = level;
+  if (hostPinHandler[pin]) hostPinHandler[pin](hostPinArg[pin]);
+}
+
+/**
+ * @brief Chip information of an ESP32-D0WD with 4 MB flash and no PSRAM.
+ */
+class EspClass {
+public:
+  uint32_t getFreeHeap() { return 150000; }
+  uint32_t getHeapSize() { return 300000; }
+  uint32_t getMinFreeHeap() { return 120000; }
+  uint32_t getMaxAllocHeap() { return 110000; }
+  uint32_t getFreePsram() { return 0; }
+  uint32_t getCpuFreqMHz() { return 240; }
+  uint64_t getEfuseMac() { return 0x0000A1B2C3D4E5F6ULL; }
+  uint32_t getSketchSize() { return 1310720; }
+  uint32_t getFreeSketchSpace() { return 1966080; }
+  uint32_t getFlashChipSize() { return 4194304; }
+  uint32_t getFlashChipSpeed() { return 80000000; }
+  const char* getSdkVersion() { return "v5.3.2"; }
+  [[noreturn]] void restart() { esp_restart(); }
+};
+
+inline EspClass ESP;
+
+inline uint32_t getCpuFrequencyMhz() { return ESP.getCpuFreqMHz(); }
@@ -0,0 +1,19 @@
+#pragma once
+
+// No peers on the host network.
+
+#include <Arduino.h>
+
+class MDNSResponder {
+public:
+  bool begin(const char* hostname) { return false; }
+  bool addService(const char* service, const char* protocol, uint16_t port) { return false; }
+  bool addServiceTxt(const char* service, const char* protocol, const char* key, const char* value) { return false; }
+  int queryService(const char* service, const char* protocol) { return 0; }
+  IPAddress address(int index) { return IPAddress(); }
+  String txt(int index, const char* key) { return String(); }
+  String hostname(int index) { return String(); }
+  uint16_t port(int index) { return 0; }
+};
+
+inline MDNSResponder MDNS;
@@ -0,0 +1,92 @@
+#pragma once
+
+// Files in a map. A File works on a copy and writes it back on close().
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+class File : public Stream {
+public:
+  File() {}
+  File(std::map<std::string, std::vector<uint8_t>>* files, std::mutex* lock, const std::string& path, bool write)
+    : m_files(files), m_lock(lock), m_path(path), m_write(write), m_open(true) {
+    std::lock_guard<std::mutex> guard(*m_lock);
+    if (!write) m_data = (*m_files)[path];
+  }
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    if (!m_open || !m_write) return 0;
+    m_data.insert(m_data.end(), buffer, buffer + size);
+    return size;
+  }
+  using Print::write;
+
+  int available() override { return m_open ? (int)(m_data.size() - m_position) : 0; }
+  int read() override { return available() ? m_data[m_position++] : -1; }
+  int peek() override { return available() ? m_data[m_position] : -1; }
+  size_t read(uint8_t* buffer, size_t size) {
+    size = min(size, (size_t)available());
+    memcpy(buffer, m_data.data() + m_position, size);
+    m_position += size;
+    return size;
+  }
+  size_t size() const { return m_data.size(); }
+
+  void close() {
+    if (m_open && m_write) {
+      std::lock_guard<std::mutex> guard(*m_lock);
+      (*m_files)[m_path] = m_data;
+    }
+    m_open = false;
+  }
+  operator bool() const { return m_open; }
+
+private:
+  std::map<std::string, std::vector<uint8_t>>* m_files = nullptr;
+  std::mutex* m_lock = nullptr;
+  std::string m_path;
+  std::vector<uint8_t> m_data;
+  size_t m_position = 0;
+  bool m_write = false;
+  bool m_open = false;
+};
+
+class FS {
+public:
+  File open(const char* path, const char* mode = FILE_READ) {
+    bool write = mode[0] != 'r';
+    if (!write && !exists(path)) return File();
+    return File(&files, &m_lock, path, write);
+  }
+  File open(const String& path, const char* mode = FILE_READ) { return open(path.c_str(), mode); }
+  bool exists(const char* path) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    return files.count(path) > 0;
+  }
+  bool exists(const String& path) { return exists(path.c_str()); }
+  bool remove(const char* path) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    return files.erase(path) > 0;
+  }
+  bool remove(const String& path) { return remove(path.c_str()); }
+
+  std::map<std::string, std::vector<uint8_t>> files;  ///< host only: contents by path
+
+private:
+  std::mutex m_lock;
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
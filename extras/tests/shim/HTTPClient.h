@@ -0,0 +1,35 @@
+#pragma once
+
+#include <Arduino.h>
+#include "WiFiClientSecure.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED  (-1)
+#define HTTPC_ERROR_CONNECTION_LOST     (-5)
+#define HTTPC_ERROR_READ_TIMEOUT        (-11)
+
+typedef enum {
+  HTTP_CODE_OK = 200,
+  HTTP_CODE_PARTIAL_CONTENT = 206,
+  HTTP_CODE_RANGE_NOT_SATISFIABLE = 416,
+} t_http_codes;
+
+class HTTPClient {
+public:
+  bool begin(NetworkClient& client, const String& url) {
+    m_client = &client;
+    return true;
+  }
+  void end() {}
+  void setReuse(bool reuse) {}
+  void setTimeout(uint16_t timeout) {}
+  void collectHeaders(const char* headers[], size_t count) {}
+  void addHeader(const String& name, const String& value) {}
+  int GET() { return HTTPC_ERROR_CONNECTION_REFUSED; }
+  int getSize() { return -1; }
+  String header(const char* name) { return String(); }
+  NetworkClient* getStreamPtr() { return m_client; }
+  static String errorToString(int error) { return String("connection refused"); }
+
+private:
+  NetworkClient* m_client = nullptr;
+};
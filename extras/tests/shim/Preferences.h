@@ -0,0 +1,51 @@
+#pragma once
+
+// NVS in a map, shared by all Preferences objects.
+
+#include <Arduino.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+inline std::map<std::string, std::vector<uint8_t>> hostNvs;
+inline std::mutex hostNvsLock;
+
+class Preferences {
+public:
+  bool begin(const char* name, bool readOnly = false) {
+    m_namespace = name;
+    return true;
+  }
+  void end() {}
+
+  size_t putBytes(const char* key, const void* value, size_t length) {
+    std::lock_guard<std::mutex> lock(hostNvsLock);
+    hostNvs[m_namespace + "/" + key].assign((const uint8_t*)value, (const uint8_t*)value + length);
+    return length;
+  }
+  size_t getBytes(const char* key, void* buffer, size_t length) {
+    std::lock_guard<std::mutex> lock(hostNvsLock);
+    auto it = hostNvs.find(m_namespace + "/" + key);
+    if (it == hostNvs.end() || it->second.size() > length) return 0;
+    memcpy(buffer, it->second.data(), it->second.size());
+    return it->second.size();
+  }
+  bool remove(const char* key) {
+    std::lock_guard<std::mutex> lock(hostNvsLock);
+    return hostNvs.erase(m_namespace + "/" + key) > 0;
+  }
+
+  size_t putUShort(const char* key, uint16_t value) { return putBytes(key, &value, sizeof(value)); }
+  size_t putULong(const char* key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+  uint16_t getUShort(const char* key, uint16_t value = 0) { return get(key, value); }
+  uint32_t getULong(const char* key, uint32_t value = 0) { return get(key, value); }
+
+private:
+  template <typename T>
+  T get(const char* key, T value) {
+    T stored;
+    return getBytes(key, &stored, sizeof(stored)) == sizeof(stored) ? stored : value;
+  }
+
+  std::string m_namespace;
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "FS.h"
+
+class SPIFFSFS : public fs::FS {
+public:
+  bool begin(bool formatOnFail = false) { return true; }
+  void end() {}
+  bool format() {
+    files.clear();
+    return true;
+  }
+};
+
+inline SPIFFSFS SPIFFS;
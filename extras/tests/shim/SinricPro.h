@@ -0,0 +1,98 @@
+#pragma once
+
+// The SDK surface the example uses. Nothing goes over the network: handle() delivers the
+// requests the tests post with hostPost(), on the task that calls it, like the SDK does.
+
+#include <Arduino.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include "SinricProSwitch.h"
+
+#define SINRICPRO_VERSION "3.5.0"
+
+typedef enum { HOST_REQUEST_NONE, HOST_REQUEST_POWER_STATE, HOST_REQUEST_HEALTH } HostRequest_t;
+
+class SinricProClass {
+public:
+  using ConnectedCallback = std::function<void(void)>;
+  using PongCallback = std::function<void(uint32_t)>;
+  using HealthCallback = std::function<bool(String& healthReport)>;
+  using SettingCallback = std::function<bool(const String& id, const String& value)>;
+  using OTAUpdateCallback = std::function<bool(const String& url, int major, int minor, int patch, bool forceUpdate)>;
+
+  SinricProSwitch& operator[](const char* deviceId) {
+    for (auto& device : m_devices) {
+      if (device.deviceId == deviceId) return device;
+    }
+    return m_devices.emplace_back(deviceId);
+  }
+
+  void onConnected(ConnectedCallback callback) { m_onConnected = callback; }
+  void onDisconnected(ConnectedCallback callback) { m_onDisconnected = callback; }
+  void onPong(PongCallback callback) { m_onPong = callback; }
+  void onReportHealth(HealthCallback callback) { m_onReportHealth = callback; }
+  void onSetSetting(SettingCallback callback) { m_onSetSetting = callback; }
+  void onOTAUpdate(OTAUpdateCallback callback) { m_onOTAUpdate = callback; }
+  void setResponseMessage(String&& message) { m_responseMessage = std::move(message); }
+  void restoreDeviceStates(bool restore) {}
+
+  void begin(const char* appKey, const char* appSecret) { m_begun = true; }
+  bool isConnected() { return m_connected; }
+
+  void handle() {
+    if (m_begun && !m_connected) {
+      m_connected = true;
+      if (m_onConnected) m_onConnected();
+    }
+    if (m_onPong) m_onPong(0);
+
+    switch (m_request.load()) {
+      case HOST_REQUEST_POWER_STATE: {
+        SinricProSwitch& device = m_devices[m_device];
+        bool state = m_state;
+        m_result = device.powerStateCallback(device.deviceId, state);
+        break;
+      }
+      case HOST_REQUEST_HEALTH:
+        healthReport = "";  // keeps the buffer, like the SDK's reused response
+        m_result = m_onReportHealth(healthReport);
+        break;
+      default:
+        return;
+    }
+    m_request = HOST_REQUEST_NONE;
+  }
+
+  /**
+   * @brief Post a request for the next handle() call and wait until it has been handled.
+   * @return The callback's result.
+   */
+  bool hostPost(HostRequest_t request, size_t device = 0, bool state = false) {
+    m_device = device;
+    m_state = state;
+    m_request = request;
+    while (m_request.load() != HOST_REQUEST_NONE) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    return m_result;
+  }
+
+  String healthReport;  ///< host only: the last report, reserve() it before counting allocations
+
+private:
+  std::deque<SinricProSwitch> m_devices;  // stable addresses, the event queue keeps pointers
+  ConnectedCallback m_onConnected;
+  ConnectedCallback m_onDisconnected;
+  PongCallback m_onPong;
+  HealthCallback m_onReportHealth;
+  SettingCallback m_onSetSetting;
+  OTAUpdateCallback m_onOTAUpdate;
+  String m_responseMessage;
+  bool m_begun = false;
+  bool m_connected = false;
+  std::atomic<int> m_request{ HOST_REQUEST_NONE };
+  size_t m_device = 0;
+  bool m_state = false;
+  bool m_result = false;
+};
+
+inline SinricProClass SinricPro;
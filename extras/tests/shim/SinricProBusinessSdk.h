@@ -0,0 +1,23 @@
+#pragma once
+
+// The SDK without BLE provisioning: the tests start with a provisioned device.
+
+#include <Arduino.h>
+#include <functional>
+#include "ProvSettings.h"
+#include "Breadcrumbs.h"
+#include "ProvTrace.h"
+#include "JsonArena.h"
+
+class WiFiProv {
+public:
+  using WiFiCredentialsCallback = std::function<bool(const char* ssid, const char* password)>;
+  using CloudCredentialsCallback = std::function<bool(const char* config, size_t length)>;
+  using LoopCallback = std::function<void(int state)>;
+
+  WiFiProv(const String& retailItemId) {}
+  bool beginProvision() { return false; }
+  void onWiFiCredentials(WiFiCredentialsCallback cb) {}
+  void onCloudCredentials(CloudCredentialsCallback cb) {}
+  void loop(LoopCallback cb) {}
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+
+/**
+ * @brief A switch that records the events it sends instead of building SDK messages.
+ */
+class SinricProSwitch {
+public:
+  using PowerStateCallback = std::function<bool(const String& deviceId, bool& state)>;
+
+  SinricProSwitch(const char* deviceId) : deviceId(deviceId) {}
+
+  void onPowerState(PowerStateCallback callback) { powerStateCallback = callback; }
+  bool sendPowerStateEvent(bool state, const char* cause = "PHYSICAL_INTERACTION") {
+    lastEventState = state;
+    events.fetch_add(1);
+    return true;
+  }
+
+  String deviceId;                     ///< host only: built when the device is registered
+  PowerStateCallback powerStateCallback;
+  std::atomic<uint32_t> events{ 0 };   ///< host only: power state events sent
+  std::atomic<bool> lastEventState{ false };
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include "WiFiClientSecure.h"
+
+typedef enum { HTTP_ANY, HTTP_GET, HTTP_POST } HTTPMethod;
+
+class WebServer {
+public:
+  using Handler = std::function<void(void)>;
+
+  WebServer(int port) {}
+  void collectHeaders(const char* headers[], size_t count) {}
+  void on(const char* uri, HTTPMethod method, Handler handler) {}
+  void begin() {}
+  void handleClient() {}
+  String header(const char* name) { return String(); }
+  void sendHeader(const String& name, const String& value, bool first = false) {}
+  void setContentLength(size_t length) {}
+  void send(int code, const char* contentType = nullptr, const String& content = String()) {}
+  NetworkClient client() { return NetworkClient(); }
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+// A station that connects at once. Event handlers run on the calling thread.
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+#include "esp_wifi.h"
+
+typedef enum {
+  ARDUINO_EVENT_WIFI_STA_CONNECTED = 4,
+  ARDUINO_EVENT_WIFI_STA_DISCONNECTED = 5,
+  ARDUINO_EVENT_WIFI_STA_GOT_IP = 7,
+  ARDUINO_EVENT_MAX = 64,
+} arduino_event_id_t;
+typedef arduino_event_id_t WiFiEvent_t;
+
+typedef union {
+  struct {
+    uint8_t reason;
+  } wifi_sta_disconnected;
+} WiFiEventInfo_t;
+
+typedef enum { WL_IDLE_STATUS = 0, WL_CONNECTED = 3, WL_DISCONNECTED = 6 } wl_status_t;
+
+class WiFiClass {
+public:
+  using EventHandler = std::function<void(WiFiEvent_t event, WiFiEventInfo_t info)>;
+
+  int onEvent(EventHandler handler, WiFiEvent_t event = ARDUINO_EVENT_MAX) {
+    m_handlers.push_back({ handler, event });
+    return (int)m_handlers.size();
+  }
+
+  wl_status_t begin(const char* ssid, const char* password) {
+    hostWiFiConnected = true;
+    emit(ARDUINO_EVENT_WIFI_STA_CONNECTED, {});
+    emit(ARDUINO_EVENT_WIFI_STA_GOT_IP, {});
+    return WL_CONNECTED;
+  }
+  bool disconnect() {
+    if (!hostWiFiConnected) return false;
+    hostWiFiConnected = false;
+    WiFiEventInfo_t info = {};
+    info.wifi_sta_disconnected.reason = WIFI_REASON_BEACON_TIMEOUT;
+    emit(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, info);
+    return true;
+  }
+
+  wl_status_t status() { return hostWiFiConnected ? WL_CONNECTED : WL_DISCONNECTED; }
+  bool isConnected() { return hostWiFiConnected; }
+  bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress()) { return true; }
+  void setMinSecurity(wifi_auth_mode_t mode) {}
+  bool setSleep(bool enabled) { return true; }
+  bool setAutoReconnect(bool enabled) { return true; }
+
+  int8_t RSSI() { return hostWiFiConnected ? hostAccessPoint.rssi : 0; }
+  uint8_t channel() { return hostAccessPoint.primary; }
+  IPAddress localIP() { return IPAddress(192, 168, 1, 42); }
+  IPAddress subnetMask() { return IPAddress(255, 255, 255, 0); }
+  IPAddress gatewayIP() { return IPAddress(192, 168, 1, 1); }
+  IPAddress dnsIP(uint8_t index = 0) { return IPAddress(192, 168, 1, 1); }
+  uint8_t* macAddress(uint8_t* mac) {
+    static const uint8_t address[6] = { 0xF6, 0xE5, 0xD4, 0xC3, 0xB2, 0xA1 };
+    memcpy(mac, address, sizeof(address));
+    return mac;
+  }
+
+private:
+  void emit(WiFiEvent_t event, WiFiEventInfo_t info) {
+    for (auto& entry : m_handlers) {
+      if (entry.event == ARDUINO_EVENT_MAX || entry.event == event) entry.handler(event, info);
+    }
+  }
+
+  struct Entry {
+    EventHandler handler;
+    WiFiEvent_t event;
+  };
+  std::vector<Entry> m_handlers;
+};
+
+inline WiFiClass WiFi;
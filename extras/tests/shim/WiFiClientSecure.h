@@ -0,0 +1,31 @@
+#pragma once
+
+// Clients without a network: every connection is refused.
+
+#include <Arduino.h>
+
+class NetworkClient : public Stream {
+public:
+  virtual ~NetworkClient() {}
+  virtual int connect(const char* host, uint16_t port) { return 0; }
+  virtual uint8_t connected() { return 0; }
+  virtual void stop() {}
+  size_t write(uint8_t c) override { return 0; }
+  size_t write(const uint8_t* buffer, size_t size) override { return 0; }
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  virtual int read(uint8_t* buffer, size_t size) { return -1; }
+  using Stream::read;
+  operator bool() { return connected(); }
+};
+
+typedef NetworkClient WiFiClient;
+
+class WiFiClientSecure : public NetworkClient {
+public:
+  void setCACert(const char* certificate) {}
+  void setInsecure() {}
+  bool verify(const char* fingerprint, const char* domain) { return false; }
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+// A crash summary the tests fill in, riscv layout.
+
+#include <stdint.h>
+#include <string.h>
+#include "esp_err.h"
+
+typedef struct {
+  uint32_t bt[16];
+  uint32_t depth;
+  bool corrupted;
+} esp_core_dump_bt_info_t;
+
+typedef struct {
+  uint32_t mcause;
+  uint32_t mtval;
+  uint32_t ra;
+  uint32_t sp;
+  uint32_t exc_a[8];
+} esp_core_dump_summary_extra_info_t;
+
+typedef struct {
+  uint32_t exc_tcb;
+  char exc_task[16];
+  uint32_t exc_pc;
+  esp_core_dump_bt_info_t exc_bt_info;
+  uint32_t core_dump_version;
+  uint8_t app_elf_sha256[65];
+  esp_core_dump_summary_extra_info_t ex_info;
+} esp_core_dump_summary_t;
+
+inline bool hostCoreDump = false;
+inline esp_core_dump_summary_t hostCoreDumpSummary;
+
+inline esp_err_t esp_core_dump_get_summary(esp_core_dump_summary_t* summary) {
+  if (!hostCoreDump) return ESP_ERR_NOT_FOUND;
+  *summary = hostCoreDumpSummary;
+  return ESP_OK;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "host_clock.h"
+
+/**
+ * @brief A 240 MHz cycle counter.
+ */
+inline uint32_t esp_cpu_get_cycle_count() { return (uint32_t)(hostMicros() * 240); }
@@ -0,0 +1,43 @@
+#pragma once
+
+// The heap of a board without PSRAM: SPIRAM requests fail, the others go to malloc.
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT      (1 << 2)
+#define MALLOC_CAP_DMA       (1 << 3)
+#define MALLOC_CAP_SPIRAM    (1 << 10)
+#define MALLOC_CAP_INTERNAL  (1 << 11)
+#define MALLOC_CAP_DEFAULT   (1 << 12)
+
+typedef struct {
+  size_t total_free_bytes;
+  size_t total_allocated_bytes;
+  size_t largest_free_block;
+  size_t minimum_free_bytes;
+  size_t allocated_blocks;
+  size_t free_blocks;
+  size_t total_blocks;
+} multi_heap_info_t;
+
+inline void* heap_caps_malloc(size_t size, uint32_t caps) { return caps & MALLOC_CAP_SPIRAM ? nullptr : malloc(size); }
+inline void* heap_caps_calloc(size_t count, size_t size, uint32_t caps) { return caps & MALLOC_CAP_SPIRAM ? nullptr : calloc(count, size); }
+inline void heap_caps_free(void* ptr) { free(ptr); }
+
+inline void* heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps) {
+  void* ptr = nullptr;
+  if (caps & MALLOC_CAP_SPIRAM || posix_memalign(&ptr, alignment, size) != 0) return nullptr;
+  return ptr;
+}
+
+inline size_t heap_caps_get_free_size(uint32_t caps) { return caps & MALLOC_CAP_SPIRAM ? 0 : 150000; }
+inline size_t heap_caps_get_largest_free_block(uint32_t caps) { return caps & MALLOC_CAP_SPIRAM ? 0 : 110000; }
+
+inline void heap_caps_get_info(multi_heap_info_t* info, uint32_t caps) {
+  if (caps & MALLOC_CAP_SPIRAM) {
+    *info = {};
+    return;
+  }
+  *info = { 150000, 150000, 110000, 120000, 900, 40, 940 };
+}
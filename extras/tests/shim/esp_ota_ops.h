@@ -0,0 +1,21 @@
+#pragma once
+
+#include "esp_partition.h"
+
+/**
+ * @brief The partition the "running" firmware lives in; tests fill in its data.
+ */
+inline esp_partition_t hostRunningPartition = { "ota_0", 0x1E0000, {}, 0x10000 };
+inline esp_partition_t hostUpdatePartition = { "ota_1", 0x1E0000, {}, 0x1F0000 };
+
+inline const esp_partition_t* esp_ota_get_running_partition() {
+  return &hostRunningPartition;
+}
+
+inline const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start) {
+  return &hostUpdatePartition;
+}
+
+inline esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+  return ESP_FAIL;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+// Partitions backed by host memory. Writes can only clear bits, like NOR flash.
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "esp_err.h"
+#include "spi_flash_mmap.h"
+
+typedef enum { ESP_PARTITION_TYPE_APP = 0, ESP_PARTITION_TYPE_DATA = 1 } esp_partition_type_t;
+typedef enum { ESP_PARTITION_SUBTYPE_ANY = 0xFF } esp_partition_subtype_t;
+
+struct esp_partition_t {
+  const char* label;
+  uint32_t size;
+  std::vector<uint8_t> data;   ///< host only: flash contents
+  uint32_t address;
+};
+
+/**
+ * @brief Data partitions esp_partition_find_first() looks through, the tests add theirs.
+ */
+inline esp_partition_t* hostDataPartitions[4];
+
+inline esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* dst, size_t size) {
+  if (!partition || offset + size > partition->data.size()) return ESP_FAIL;
+  memcpy(dst, partition->data.data() + offset, size);
+  return ESP_OK;
+}
+
+inline esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* src, size_t size) {
+  if (!partition || offset + size > partition->data.size()) return ESP_FAIL;
+  uint8_t* flash = const_cast<uint8_t*>(partition->data.data()) + offset;
+  for (size_t i = 0; i < size; i++) flash[i] &= ((const uint8_t*)src)[i];
+  return ESP_OK;
+}
+
+inline esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+  if (!partition || offset + size > partition->data.size() || offset % 4096 || size % 4096) return ESP_FAIL;
+  memset(const_cast<uint8_t*>(partition->data.data()) + offset, 0xFF, size);
+  return ESP_OK;
+}
+
+inline const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label) {
+  for (esp_partition_t* partition : hostDataPartitions) {
+    if (partition && (!label || strcmp(partition->label, label) == 0)) return partition;
+  }
+  return nullptr;
+}
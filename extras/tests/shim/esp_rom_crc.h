@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* data, uint32_t length) {
+  crc = ~crc;
+  while (length--) {
+    crc ^= *data++;
+    for (int i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+inline uint16_t esp_rom_crc16_le(uint16_t crc, const uint8_t* data, uint32_t length) {
+  crc = ~crc;
+  while (length--) {
+    crc ^= *data++;
+    for (int i = 0; i < 8; i++) crc = (crc >> 1) ^ (0x8408 & -(crc & 1));
+  }
+  return ~crc;
+}
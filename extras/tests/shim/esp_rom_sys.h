@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdarg.h>
+
+inline int esp_rom_printf(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int length = vprintf(format, args);
+  va_end(args);
+  return length;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// Reset reason and restart. A restart ends the test.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_err.h"
+
+typedef enum {
+  ESP_RST_UNKNOWN,
+  ESP_RST_POWERON,
+  ESP_RST_EXT,
+  ESP_RST_SW,
+  ESP_RST_PANIC,
+  ESP_RST_INT_WDT,
+  ESP_RST_TASK_WDT,
+  ESP_RST_WDT,
+  ESP_RST_DEEPSLEEP,
+  ESP_RST_BROWNOUT,
+  ESP_RST_SDIO,
+} esp_reset_reason_t;
+
+typedef void (*shutdown_handler_t)(void);
+
+inline esp_reset_reason_t hostResetReason = ESP_RST_POWERON;
+
+inline esp_reset_reason_t esp_reset_reason() { return hostResetReason; }
+inline esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) { return ESP_OK; }
+
+[[noreturn]] inline void esp_restart() {
+  printf("FAIL: esp_restart()\n");
+  fflush(stdout);
+  _Exit(3);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+// esp_timer: callbacks run on an "esp_timer" task, one at a time, as with ESP_TIMER_TASK.
+
+#include <stdint.h>
+#include <mutex>
+#include <condition_variable>
+#include "esp_err.h"
+#include "host_clock.h"
+#include "freertos/FreeRTOS.h"
+
+typedef void (*esp_timer_cb_t)(void* arg);
+typedef enum { ESP_TIMER_TASK, ESP_TIMER_ISR } esp_timer_dispatch_t;
+
+typedef struct {
+  esp_timer_cb_t callback;
+  void* arg;
+  esp_timer_dispatch_t dispatch_method;
+  const char* name;
+  bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+struct esp_timer {
+  esp_timer_create_args_t args;
+  int64_t due;
+  uint64_t period;
+  bool armed;
+  bool used;
+};
+typedef esp_timer* esp_timer_handle_t;
+
+inline esp_timer hostTimers[32];
+inline std::mutex hostTimerLock;
+inline std::condition_variable hostTimerChanged;
+inline TaskHandle_t hostTimerTask = nullptr;
+
+inline int64_t esp_timer_get_time() { return hostMicros(); }
+
+inline void hostTimerRun(void*) {
+  std::unique_lock<std::mutex> lock(hostTimerLock);
+  while (true) {
+    esp_timer* next = nullptr;
+    for (esp_timer& timer : hostTimers) {
+      if (timer.used && timer.armed && (!next || timer.due < next->due)) next = &timer;
+    }
+    if (!next) {
+      hostTimerChanged.wait(lock);
+      continue;
+    }
+    if (hostMicros() < next->due) {
+      hostTimerChanged.wait_until(lock, hostTimePoint(next->due));
+      continue;
+    }
+
+    if (next->period) {
+      next->due += next->period;
+      if (next->args.skip_unhandled_events && next->due < hostMicros()) next->due = hostMicros() + next->period;
+    } else {
+      next->armed = false;
+    }
+    esp_timer_create_args_t args = next->args;
+    lock.unlock();
+    args.callback(args.arg);
+    lock.lock();
+  }
+}
+
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+  std::lock_guard<std::mutex> lock(hostTimerLock);
+  if (!hostTimerTask) xTaskCreatePinnedToCore(hostTimerRun, "esp_timer", 4096, nullptr, 22, &hostTimerTask, 0);
+  for (esp_timer& timer : hostTimers) {
+    if (timer.used) continue;
+    timer = { *args, 0, 0, false, true };
+    *handle = &timer;
+    return ESP_OK;
+  }
+  return ESP_ERR_NO_MEM;
+}
+
+inline esp_err_t hostTimerStart(esp_timer_handle_t timer, uint64_t timeout, uint64_t period) {
+  std::lock_guard<std::mutex> lock(hostTimerLock);
+  if (timer->armed) return ESP_ERR_INVALID_STATE;
+  timer->due = hostMicros() + timeout;
+  timer->period = period;
+  timer->armed = true;
+  hostTimerChanged.notify_all();
+  return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout) { return hostTimerStart(timer, timeout, 0); }
+inline esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) { return hostTimerStart(timer, period, period); }
+
+inline esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  std::lock_guard<std::mutex> lock(hostTimerLock);
+  if (!timer->armed) return ESP_ERR_INVALID_STATE;
+  timer->armed = false;
+  hostTimerChanged.notify_all();
+  return ESP_OK;
+}
+
+inline esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  std::lock_guard<std::mutex> lock(hostTimerLock);
+  timer->used = false;
+  timer->armed = false;
+  return ESP_OK;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "esp_err.h"
+
+typedef enum {
+  WIFI_AUTH_OPEN = 0,
+  WIFI_AUTH_WEP,
+  WIFI_AUTH_WPA_PSK,
+  WIFI_AUTH_WPA2_PSK,
+} wifi_auth_mode_t;
+
+typedef enum {
+  WIFI_REASON_UNSPECIFIED = 1,
+  WIFI_REASON_BEACON_TIMEOUT = 200,
+} wifi_err_reason_t;
+
+typedef struct {
+  uint8_t bssid[6];
+  uint8_t ssid[33];
+  uint8_t primary;
+  int8_t rssi;
+  wifi_auth_mode_t authmode;
+} wifi_ap_record_t;
+
+/**
+ * @brief The access point the host "station" is associated with.
+ */
+inline wifi_ap_record_t hostAccessPoint = { { 0x24, 0x0A, 0xC4, 0x12, 0x34, 0x56 }, "host-network", 6, -58, WIFI_AUTH_WPA2_PSK };
+inline bool hostWiFiConnected = false;
+
+inline esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t* ap) {
+  if (!hostWiFiConnected) return ESP_FAIL;
+  *ap = hostAccessPoint;
+  return ESP_OK;
+}
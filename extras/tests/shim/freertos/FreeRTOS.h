@@ -0,0 +1,340 @@
+#pragma once
+
+// FreeRTOS on std::thread. Tasks are detached threads with a notification value, queues and
+// mutexes a std::mutex and condition variable each. Nothing allocates once a task or queue
+// exists, so waiting, notifying and sending can be used after the allocation check is armed.
+// Critical sections are a recursive spinlock per portMUX_TYPE.
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include <sched.h>
+#include <pthread.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "host_clock.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdTRUE   1
+#define pdFALSE  0
+#define pdPASS   pdTRUE
+#define pdFAIL   pdFALSE
+
+#define configTICK_RATE_HZ              1000
+#define configMAX_TASK_NAME_LEN         16
+#define configUSE_TRACE_FACILITY        1
+#define configGENERATE_RUN_TIME_STATS   1
+#define portNUM_PROCESSORS              2
+#define portTICK_PERIOD_MS              1
+#define portMAX_DELAY                   0xFFFFFFFFUL
+#define pdMS_TO_TICKS(ms)               ((TickType_t)(ms))
+#define tskNO_AFFINITY                  0x7FFFFFFF
+#define portYIELD_FROM_ISR(...)         do { } while (0)
+#define taskYIELD()                     std::this_thread::yield()
+
+// ---- critical sections ------------------------------------------------------------------
+
+typedef struct {
+  uint32_t owner;
+  uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED  { 0, 0 }
+
+inline uint32_t hostThreadId() {
+  static std::atomic<uint32_t> next(1);
+  thread_local uint32_t id = next.fetch_add(1);
+  return id;
+}
+
+inline void hostEnterCritical(portMUX_TYPE* mux) {
+  uint32_t self = hostThreadId();
+  if (__atomic_load_n(&mux->owner, __ATOMIC_ACQUIRE) == self) {
+    mux->count++;
+    return;
+  }
+  uint32_t expected = 0;
+  while (!__atomic_compare_exchange_n(&mux->owner, &expected, self, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    expected = 0;
+    sched_yield();
+  }
+  mux->count = 1;
+}
+
+inline void hostExitCritical(portMUX_TYPE* mux) {
+  if (--mux->count == 0) __atomic_store_n(&mux->owner, 0, __ATOMIC_RELEASE);
+}
+
+#define portENTER_CRITICAL(mux)       hostEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)        hostExitCritical(mux)
+#define portENTER_CRITICAL_SAFE(mux)  hostEnterCritical(mux)
+#define portEXIT_CRITICAL_SAFE(mux)   hostExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux)   hostEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)    hostExitCritical(mux)
+
+// ---- waiting ----------------------------------------------------------------------------
+
+/**
+ * @brief Wait on a condition for up to ticks (ms of firmware time). True once ready() holds.
+ */
+template <typename Ready>
+inline bool hostWait(std::unique_lock<std::mutex>& lock, std::condition_variable& changed, TickType_t ticks, Ready ready) {
+  if (ticks == portMAX_DELAY) {
+    changed.wait(lock, ready);
+    return true;
+  }
+  return changed.wait_until(lock, hostTimePoint(hostMicros() + (int64_t)ticks * 1000), ready);
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_until(hostTimePoint(hostMicros() + (int64_t)ticks * 1000));
+}
+
+inline TickType_t xTaskGetTickCount() { return (TickType_t)(hostMicros() / 1000); }
+
+// ---- tasks ------------------------------------------------------------------------------
+
+typedef enum { eRunning, eReady, eBlocked, eSuspended, eDeleted, eInvalid } eTaskState;
+typedef enum { eNoAction, eSetBits, eIncrement, eSetValueWithOverwrite, eSetValueWithoutOverwrite } eNotifyAction;
+
+struct HostTask {
+  char name[configMAX_TASK_NAME_LEN];
+  UBaseType_t priority;
+  BaseType_t core;
+  bool used;
+  std::mutex lock;
+  std::condition_variable changed;
+  uint32_t notifyValue;
+  bool notifyPending;
+};
+typedef HostTask* TaskHandle_t;
+
+typedef struct {
+  TaskHandle_t xHandle;
+  const char* pcTaskName;
+  UBaseType_t xTaskNumber;
+  eTaskState eCurrentState;
+  UBaseType_t uxCurrentPriority;
+  UBaseType_t uxBasePriority;
+  uint32_t ulRunTimeCounter;
+  void* pxStackBase;
+  uint32_t usStackHighWaterMark;
+  BaseType_t xCoreID;
+} TaskStatus_t;
+
+inline HostTask hostTasks[32];
+inline std::mutex hostTasksLock;
+inline thread_local HostTask* hostCurrentTask = nullptr;
+inline UBaseType_t hostExtraTasks = 0;  ///< Made-up tasks uxTaskGetSystemState() adds to the real ones
+
+inline HostTask* hostNewTask(const char* name, UBaseType_t priority, BaseType_t core) {
+  std::lock_guard<std::mutex> guard(hostTasksLock);
+  for (HostTask& task : hostTasks) {
+    if (task.used) continue;
+    strncpy(task.name, name, sizeof(task.name) - 1);
+    task.name[sizeof(task.name) - 1] = '\0';
+    task.priority = priority;
+    task.core = core;
+    task.notifyValue = 0;
+    task.notifyPending = false;
+    task.used = true;
+    return &task;
+  }
+  return nullptr;
+}
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+  if (!hostCurrentTask) hostCurrentTask = hostNewTask("main", 1, 1);  // a thread the test started
+  return hostCurrentTask;
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackSize, void* arg,
+                                          UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+  HostTask* task = hostNewTask(name, priority, core);
+  if (!task) return pdFAIL;
+  if (handle) *handle = task;
+  std::thread([=]() {
+    hostCurrentTask = task;
+    function(arg);
+  }).detach();
+  return pdPASS;
+}
+
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackSize, void* arg, UBaseType_t priority, TaskHandle_t* handle) {
+  return xTaskCreatePinnedToCore(function, name, stackSize, arg, priority, handle, tskNO_AFFINITY);
+}
+
+inline void vTaskDelete(TaskHandle_t task) {
+  if (task && task != hostCurrentTask) return;  // other threads cannot be stopped, only tasks ending themselves
+  {
+    std::lock_guard<std::mutex> guard(hostTasksLock);
+    if (hostCurrentTask) hostCurrentTask->used = false;
+  }
+  pthread_exit(nullptr);
+}
+
+inline char* pcTaskGetName(TaskHandle_t task) {
+  return (task ? task : xTaskGetCurrentTaskHandle())->name;
+}
+
+inline BaseType_t xTaskGetCoreID(TaskHandle_t task) { return task->core; }
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) { return 1024; }
+
+inline UBaseType_t uxTaskGetNumberOfTasks() {
+  std::lock_guard<std::mutex> guard(hostTasksLock);
+  UBaseType_t count = hostExtraTasks;
+  for (const HostTask& task : hostTasks) count += task.used;
+  return count;
+}
+
+/**
+ * @brief The tasks created so far and hostExtraTasks made-up ones with 15 character names.
+ * 0 if they do not all fit, like FreeRTOS.
+ */
+inline UBaseType_t uxTaskGetSystemState(TaskStatus_t* status, UBaseType_t size, uint32_t* totalRunTime) {
+  static HostTask extra[64];
+  uint32_t now = (uint32_t)hostMicros();
+  UBaseType_t count = 0;
+
+  std::lock_guard<std::mutex> guard(hostTasksLock);
+  for (UBaseType_t i = 0; i < 32 + hostExtraTasks && i < 32 + 64; i++) {
+    HostTask* task = i < 32 ? &hostTasks[i] : &extra[i - 32];
+    if (i < 32 && !task->used) continue;
+    if (i >= 32) {
+      snprintf(task->name, sizeof(task->name), "extraTask%06u", i - 32);
+      task->priority = 1;
+      task->core = i % 2;
+    }
+    if (count == size) return 0;
+    status[count] = { task, task->name, count, eBlocked, task->priority, task->priority, now / (count + 2), nullptr, 1000 + count * 4, task->core };
+    count++;
+  }
+  if (totalRunTime) *totalRunTime = now;
+  return count;
+}
+
+// ---- notifications ----------------------------------------------------------------------
+
+inline BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+  std::lock_guard<std::mutex> guard(task->lock);
+  switch (action) {
+    case eSetBits: task->notifyValue |= value; break;
+    case eIncrement: task->notifyValue++; break;
+    case eSetValueWithOverwrite: task->notifyValue = value; break;
+    case eSetValueWithoutOverwrite:
+      if (task->notifyPending) return pdFAIL;
+      task->notifyValue = value;
+      break;
+    case eNoAction: break;
+  }
+  task->notifyPending = true;
+  task->changed.notify_all();
+  return pdPASS;
+}
+
+inline BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t* woken) {
+  if (woken) *woken = pdFALSE;
+  return xTaskNotify(task, value, action);
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task) { return xTaskNotify(task, 0, eIncrement); }
+
+inline BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t* value, TickType_t ticks) {
+  HostTask* task = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(task->lock);
+  if (!task->notifyPending) task->notifyValue &= ~clearOnEntry;
+  if (!hostWait(lock, task->changed, ticks, [&]() { return task->notifyPending; })) return pdFALSE;
+  if (value) *value = task->notifyValue;
+  task->notifyValue &= ~clearOnExit;
+  task->notifyPending = false;
+  return pdTRUE;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  HostTask* task = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(task->lock);
+  hostWait(lock, task->changed, ticks, [&]() { return task->notifyValue != 0; });
+  uint32_t value = task->notifyValue;
+  if (value) task->notifyValue = clearOnExit ? 0 : value - 1;
+  task->notifyPending = false;
+  return value;
+}
+
+// ---- queues and semaphores --------------------------------------------------------------
+
+struct HostQueue {
+  std::mutex lock;
+  std::condition_variable changed;
+  uint8_t* items;
+  UBaseType_t length;
+  UBaseType_t itemSize;
+  UBaseType_t head;
+  UBaseType_t count;
+};
+typedef HostQueue* QueueHandle_t;
+typedef HostQueue* SemaphoreHandle_t;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  HostQueue* queue = new HostQueue();
+  queue->items = itemSize ? new uint8_t[length * itemSize] : nullptr;
+  queue->length = length;
+  queue->itemSize = itemSize;
+  queue->head = 0;
+  queue->count = 0;
+  return queue;
+}
+
+inline void vQueueDelete(QueueHandle_t queue) {
+  delete[] queue->items;
+  delete queue;
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!hostWait(lock, queue->changed, ticks, [&]() { return queue->count < queue->length; })) return pdFALSE;
+  if (queue->itemSize) memcpy(queue->items + (queue->head + queue->count) % queue->length * queue->itemSize, item, queue->itemSize);
+  queue->count++;
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+inline BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken) {
+  if (woken) *woken = pdFALSE;
+  return xQueueSend(queue, item, 0);
+}
+
+#define xQueueSendToBack xQueueSend
+
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!hostWait(lock, queue->changed, ticks, [&]() { return queue->count > 0; })) return pdFALSE;
+  if (queue->itemSize) memcpy(item, queue->items + queue->head * queue->itemSize, queue->itemSize);
+  queue->head = (queue->head + 1) % queue->length;
+  queue->count--;
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> guard(queue->lock);
+  return queue->count;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return xQueueCreate(1, 0); }
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+  SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+  mutex->count = 1;
+  return mutex;
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) { return xQueueReceive(semaphore, nullptr, ticks); }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) { return xQueueSend(semaphore, nullptr, 0); }
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore) { vQueueDelete(semaphore); }
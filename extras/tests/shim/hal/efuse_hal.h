@@ -0,0 +1,3 @@
+#pragma once
+
+inline unsigned efuse_hal_chip_revision() { return 301; }
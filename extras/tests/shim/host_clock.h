@@ -0,0 +1,26 @@
+#pragma once
+
+// Time since start for esp_timer, millis() and the FreeRTOS waits. hostTimeScale makes the
+// firmware's time run faster than the host's, e.g. to fill a metrics series quickly.
+
+#include <stdint.h>
+#include <chrono>
+
+inline uint32_t hostTimeScale = 1;
+
+inline std::chrono::steady_clock::time_point hostStart() {
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return start;
+}
+
+inline int64_t hostMicros() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now() - hostStart()).count() * hostTimeScale;
+}
+
+/**
+ * @brief Host time point at which the firmware clock reads the given microseconds.
+ */
+inline std::chrono::steady_clock::time_point hostTimePoint(int64_t micros) {
+  return hostStart() + std::chrono::microseconds(micros / hostTimeScale);
+}
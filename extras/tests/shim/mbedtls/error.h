@@ -0,0 +1,5 @@
+#pragma once
+
+#include <stdio.h>
+
+inline void mbedtls_strerror(int error, char* buffer, size_t length) { snprintf(buffer, length, "mbedtls error %d", error); }
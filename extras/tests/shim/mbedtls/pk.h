@@ -0,0 +1,21 @@
+#pragma once
+
+// Declarations only: the tests do not check signatures.
+
+#include <stddef.h>
+
+#define MBEDTLS_PK_SIGNATURE_MAX_SIZE  1024
+
+typedef enum { MBEDTLS_MD_SHA256 = 9 } mbedtls_md_type_t;
+
+typedef struct {
+  void* info;
+} mbedtls_pk_context;
+
+inline void mbedtls_pk_init(mbedtls_pk_context* pk) { pk->info = nullptr; }
+inline void mbedtls_pk_free(mbedtls_pk_context* pk) {}
+inline int mbedtls_pk_parse_public_key(mbedtls_pk_context* pk, const unsigned char* key, size_t length) { return -1; }
+inline int mbedtls_pk_verify(mbedtls_pk_context* pk, mbedtls_md_type_t md, const unsigned char* hash, size_t hashLength,
+                             const unsigned char* signature, size_t length) {
+  return -1;
+}
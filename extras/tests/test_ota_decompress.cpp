@@ -0,0 +1,142 @@
+/**
+ * Inflates a gzip image with the firmware's OtaDecompressor, on the miniz 1.15 inflater the
+ * ESP32 ROM has (shim/rom/miniz.h), and compares the result with the original byte for byte.
+ *
+ *     test_ota_decompress image.bin image.bin.gz
+ *
+ * The image is fed in several chunkings: the inflater reads ahead of the deflate stream, so
+ * where the gzip trailer starts relative to a write() matters. Broken images must be rejected.
+ */
+
+#include <stdlib.h>
+#include <functional>
+#include <random>
+#include <vector>
+#include "OtaDecompressor.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                                  \
+  do {                                                         \
+    if (!(condition)) {                                        \
+      printf("FAIL %s:%d: %s: ", __FILE__, __LINE__, #condition); \
+      printf(__VA_ARGS__);                                     \
+      printf("\n");                                            \
+      failures++;                                              \
+    }                                                          \
+  } while (0)
+
+class CollectingSink : public OtaSink {
+public:
+  bool write(const uint8_t* data, size_t len) override {
+    m_data.insert(m_data.end(), data, data + len);
+    return true;
+  }
+  String getError() const override { return ""; }
+
+  Bytes m_data;
+};
+
+struct Result_t {
+  bool ok;
+  Bytes output;
+  String error;
+};
+
+static Bytes readFile(const char* path) {
+  Bytes data;
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    printf("Cannot open %s\n", path);
+    exit(2);
+  }
+  uint8_t buffer[4096];
+  size_t len;
+  while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0) data.insert(data.end(), buffer, buffer + len);
+  fclose(file);
+  return data;
+}
+
+/**
+ * Run one image through a fresh decompressor, cut into chunks of the sizes chunk() returns.
+ */
+template <typename Chunker>
+static Result_t inflate(const Bytes& image, Chunker chunk) {
+  OtaDecompressor decompressor;
+  CollectingSink sink;
+  Result_t result;
+
+  result.ok = decompressor.begin(sink, image.size());
+  for (size_t pos = 0; pos < image.size() && result.ok;) {
+    size_t len = min(chunk(), image.size() - pos);
+    result.ok = decompressor.write(image.data() + pos, len);
+    pos += len;
+  }
+  if (result.ok) result.ok = decompressor.end();
+  result.error = decompressor.getError();
+  result.output = sink.m_data;
+  return result;
+}
+
+static void checkRejected(const char* what, const Bytes& image, const char* error) {
+  Result_t result = inflate(image, [&]() { return image.size(); });
+  CHECK(!result.ok, "%s was accepted", what);
+  CHECK(strstr(result.error.c_str(), error), "%s: got \"%s\", expected \"%s\"", what, result.error.c_str(), error);
+}
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    printf("Usage: %s image.bin image.bin.gz\n", argv[0]);
+    return 2;
+  }
+  Serial.verbose = getenv("VERBOSE") != nullptr;
+
+  const Bytes original = readFile(argv[1]);
+  const Bytes image = readFile(argv[2]);
+
+  // Chunked the way the HTTP client and a slow link would, and split around the trailer.
+  std::mt19937 rng(1);
+  std::vector<std::pair<String, std::function<size_t()>>> chunkings = {
+    { "whole", [&]() { return image.size(); } },
+    { "1 byte", []() { return (size_t)1; } },
+    { "7 bytes", []() { return (size_t)7; } },
+    { "4 KB", []() { return (size_t)4096; } },
+    { "random", [&]() { return (size_t)(rng() % 4096 + 1); } },
+  };
+  for (size_t tail = 1; tail <= 12 && tail < image.size(); tail++) {
+    bool first = true;
+    chunkings.push_back({ "last " + String(tail) + " bytes apart", [&image, tail, first]() mutable {
+                           size_t len = first ? image.size() - tail : image.size();
+                           first = false;
+                           return len;
+                         } });
+  }
+  for (const auto& chunking : chunkings) {
+    Result_t result = inflate(image, chunking.second);
+    CHECK(result.ok, "%s: %s", chunking.first.c_str(), result.error.c_str());
+    CHECK(result.output == original, "%s: %zu bytes out, %zu expected", chunking.first.c_str(), result.output.size(), original.size());
+  }
+
+  Bytes broken(image.begin(), image.end() - 1);
+  checkRejected("truncated trailer", broken, "truncated");
+
+  broken.assign(image.begin(), image.end() - 9);
+  checkRejected("truncated stream", broken, "truncated");
+
+  broken = image;
+  broken[broken.size() - 8] ^= 0x01;
+  checkRejected("wrong CRC-32", broken, "checksum mismatch");
+
+  broken = image;
+  broken[broken.size() - 1] ^= 0x01;
+  checkRejected("wrong size", broken, "checksum mismatch");
+
+  broken = image;
+  broken.insert(broken.end() - 8, 16, 0);  // more than the inflater reads ahead
+  checkRejected("data after the stream", broken, "Unexpected data");
+
+  printf("%s %s: %zu bytes -> %zu bytes\n", failures ? "FAIL" : "ok", argv[2], image.size(), original.size());
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * Applies a patch written by extras/tools/ota_delta.py with the firmware's OtaDeltaPatcher
+ * and compares the result with the target image byte for byte.
+ *
+ *     test_ota_delta base.bin target.bin target.patch
+ *
+ * The patch is fed in several chunkings, since the patcher parses headers and control
+ * records across write() boundaries. Broken inputs must be rejected with an error.
+ */
+
+#include <stdlib.h>
+#include <functional>
+#include <random>
+#include <vector>
+#include "OtaDeltaPatcher.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                                  \
+  do {                                                         \
+    if (!(condition)) {                                        \
+      printf("FAIL %s:%d: %s: ", __FILE__, __LINE__, #condition); \
+      printf(__VA_ARGS__);                                     \
+      printf("\n");                                            \
+      failures++;                                              \
+    }                                                          \
+  } while (0)
+
+class CollectingSink : public OtaSink {
+public:
+  bool write(const uint8_t* data, size_t len) override {
+    m_data.insert(m_data.end(), data, data + len);
+    return true;
+  }
+  String getError() const override { return ""; }
+
+  Bytes m_data;
+};
+
+struct Result_t {
+  bool ok;
+  bool patching;
+  Bytes output;
+  String error;
+};
+
+static Bytes readFile(const char* path) {
+  Bytes data;
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    printf("Cannot open %s\n", path);
+    exit(2);
+  }
+  uint8_t buffer[4096];
+  size_t len;
+  while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0) data.insert(data.end(), buffer, buffer + len);
+  fclose(file);
+  return data;
+}
+
+static Bytes sha256(const Bytes& data) {
+  Bytes digest(32);
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  mbedtls_sha256_update(&sha, data.data(), data.size());
+  mbedtls_sha256_finish(&sha, digest.data());
+  mbedtls_sha256_free(&sha);
+  return digest;
+}
+
+/**
+ * Run one stream through a fresh patcher, cut into chunks of the sizes chunk() returns.
+ */
+template <typename Chunker>
+static Result_t apply(const Bytes& patch, Chunker chunk) {
+  static OtaDeltaPatcher patcher;   // large, like the firmware's instance
+  CollectingSink sink;
+  Result_t result;
+
+  patcher.begin(sink);
+  result.ok = true;
+  for (size_t pos = 0; pos < patch.size() && result.ok;) {
+    size_t len = min(chunk(), patch.size() - pos);
+    result.ok = patcher.write(patch.data() + pos, len);
+    pos += len;
+  }
+  if (result.ok) result.ok = patcher.end();
+  if (result.ok && patcher.isPatching()) {
+    result.ok = memcmp(patcher.targetSha256(), sha256(sink.m_data).data(), 32) == 0;
+    if (!result.ok) result.error = "SHA-256 of the output does not match the header";
+  } else {
+    result.error = patcher.getError();
+  }
+  result.patching = patcher.isPatching();
+  result.output = sink.m_data;
+  return result;
+}
+
+static Result_t applyWhole(const Bytes& patch) {
+  return apply(patch, [&]() { return patch.size(); });
+}
+
+static void checkRejected(const char* what, const Bytes& patch, const char* error) {
+  Result_t result = applyWhole(patch);
+  CHECK(!result.ok, "%s was accepted", what);
+  CHECK(strstr(result.error.c_str(), error), "%s: got \"%s\", expected \"%s\"", what, result.error.c_str(), error);
+}
+
+int main(int argc, char** argv) {
+  if (argc != 4) {
+    printf("Usage: %s base.bin target.bin target.patch\n", argv[0]);
+    return 2;
+  }
+  Serial.verbose = getenv("VERBOSE") != nullptr;
+
+  const Bytes base = readFile(argv[1]);
+  const Bytes target = readFile(argv[2]);
+  const Bytes patch = readFile(argv[3]);
+  hostRunningPartition.data = base;
+
+  // Good patch, chunked the way the HTTP client, the inflater and a slow link would.
+  std::mt19937 rng(1);
+  const std::pair<const char*, std::function<size_t()>> chunkings[] = {
+    { "whole", [&]() { return patch.size(); } },
+    { "1 byte", []() { return (size_t)1; } },
+    { "7 bytes", []() { return (size_t)7; } },
+    { "random", [&]() { return (size_t)(rng() % 4096 + 1); } },
+  };
+  for (const auto& chunking : chunkings) {
+    Result_t result = apply(patch, chunking.second);
+    CHECK(result.ok, "%s: %s", chunking.first, result.error.c_str());
+    CHECK(result.patching, "%s: not recognised as a patch", chunking.first);
+    CHECK(result.output == target, "%s: %zu bytes out, %zu expected", chunking.first, result.output.size(), target.size());
+  }
+
+  // A device running other firmware must not build an image from the patch.
+  Bytes other = base;
+  other[other.size() / 2] ^= 0x01;
+  hostRunningPartition.data = other;
+  checkRejected("patch for another base", patch, "does not match the running firmware");
+  hostRunningPartition.data = base;
+
+  Bytes broken(patch.begin(), patch.end() - 1);
+  checkRejected("truncated patch", broken, "truncated");
+
+  broken = patch;
+  broken.push_back(0);
+  checkRejected("patch with trailing data", broken, "Unexpected data after patch");
+
+  if (patch.size() >= sizeof(OtaDeltaHeader_t) + 12) {
+    broken = patch;
+    uint32_t huge = 0x7FFFFFFF;
+    memcpy(broken.data() + sizeof(OtaDeltaHeader_t), &huge, sizeof(huge));
+    checkRejected("record longer than the image", broken, "record out of range");
+  }
+
+  // Full images are handed on untouched.
+  if (!OtaDeltaPatcher::isDelta(target.data(), target.size())) {
+    Result_t result = apply(target, []() { return (size_t)1000; });
+    CHECK(result.ok && !result.patching, "full image: %s", result.error.c_str());
+    CHECK(result.output == target, "full image: %zu bytes out, %zu expected", result.output.size(), target.size());
+  }
+
+  printf("%s %s: %zu byte patch -> %zu bytes\n", failures ? "FAIL" : "ok", argv[3], patch.size(), target.size());
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,267 @@
+/**
+ * Runs the reference firmware (examples/Wally) on the host and fails if a steady-state path
+ * touches the heap after initialisation:
+ *
+ *  - a wall switch toggling its relay, up to the power state event handed to the SDK
+ *  - a power state command from the server, up to the relay
+ *  - full and compact health reports, into the SDK's report String
+ *
+ *     test_steady_state_alloc
+ *
+ * malloc, calloc, realloc and the aligned variants are replaced for the whole process and
+ * count every call from any thread once armed, so an allocation anywhere on the path fails
+ * the test, not only inside the ALLOC_GUARD_SCOPE blocks. setup() and a warm-up round of
+ * every path run first, with the report at its limits: HEALTH_MAX_TASKS tasks, a full
+ * journal batch, the boot history, the breadcrumbs and core dump of a crash and full metric
+ * series. The SDK itself is a stub, its own message buffers are not covered.
+ *
+ * Built with -m32 and the ArduinoJson release the library depends on, the arena peaks
+ * printed at the end are the ones of a report on the ESP32. Set VERBOSE for the firmware log.
+ */
+
+#include <errno.h>
+#include <malloc.h>
+#include <atomic>
+#include "../../examples/Wally/Wally.ino"
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                                  \
+  do {                                                         \
+    if (!(condition)) {                                        \
+      printf("FAIL %s:%d: %s: ", __FILE__, __LINE__, #condition); \
+      printf(__VA_ARGS__);                                     \
+      printf("\n");                                            \
+      failures++;                                              \
+    }                                                          \
+  } while (0)
+
+// ---- counting allocator -----------------------------------------------------------------
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+struct Allocation_t {
+  size_t size;
+  void* caller;
+};
+
+static std::atomic<bool> s_armed{ false };
+static std::atomic<uint32_t> s_allocations{ 0 };
+static Allocation_t s_first[8];
+
+static void countAllocation(size_t size, void* caller) {
+  if (!s_armed.load(std::memory_order_relaxed)) return;
+  uint32_t index = s_allocations.fetch_add(1);
+  if (index < sizeof(s_first) / sizeof(s_first[0])) s_first[index] = { size, caller };
+}
+
+extern "C" {
+void* malloc(size_t size) {
+  countAllocation(size, __builtin_return_address(0));
+  return __libc_malloc(size);
+}
+void* calloc(size_t count, size_t size) {
+  countAllocation(count * size, __builtin_return_address(0));
+  return __libc_calloc(count, size);
+}
+void* realloc(void* ptr, size_t size) {
+  countAllocation(size, __builtin_return_address(0));
+  return __libc_realloc(ptr, size);
+}
+void* memalign(size_t alignment, size_t size) {
+  countAllocation(size, __builtin_return_address(0));
+  return __libc_memalign(alignment, size);
+}
+void* aligned_alloc(size_t alignment, size_t size) {
+  countAllocation(size, __builtin_return_address(0));
+  return __libc_memalign(alignment, size);
+}
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+  countAllocation(size, __builtin_return_address(0));
+  *ptr = __libc_memalign(alignment, size);
+  return *ptr ? 0 : ENOMEM;
+}
+void free(void* ptr) {
+  __libc_free(ptr);
+}
+}
+
+/**
+ * @brief Count the allocations of one step and report the first few.
+ */
+static void expectNoAllocations(const char* step, const std::function<void()>& run) {
+  s_allocations = 0;
+  s_armed = true;
+  run();
+  s_armed = false;
+
+  uint32_t count = s_allocations;
+  CHECK(count == 0, "%s: %u allocations", step, count);
+  for (uint32_t i = 0; i < count && i < sizeof(s_first) / sizeof(s_first[0]); i++) {
+    printf("  %u bytes from %p (addr2line -fpiCe %s %p)\n", (unsigned)s_first[i].size, s_first[i].caller,
+           program_invocation_name, s_first[i].caller);
+  }
+}
+
+// ---- firmware state ---------------------------------------------------------------------
+
+static esp_partition_t s_journalPartition = { JOURNAL_PARTITION_LABEL, 32 * SPI_FLASH_SEC_SIZE, {}, 0x310000 };
+
+static void waitFor(const char* what, const std::function<bool()>& done) {
+  for (int i = 0; i < 20000 && !done(); i++) usleep(100);
+  CHECK(done(), "timed out waiting for %s", what);
+}
+
+/**
+ * @brief What the previous boots and the crash that ended the last one left behind.
+ */
+static void prepareDevice() {
+  SPIFFS.files[PRODUCT_CONFIG_FILE] = std::vector<uint8_t>();
+  const char* config =
+    "{\"credentials\": {\"appkey\": \"de0bxxxx-1x3x-4x3x-ax2x-5dabxxxxxxxx\","
+    " \"appsecret\": \"5f36xxxx-x3x7-4x3x-xexe-e86724a9xxxx-4c4axxxx-3x3x-x5xe-x9x3-333d65xxxxxx\"},"
+    " \"devices\": [{\"id\": \"5dc1564130xxxxxxxxxxxxxx\", \"name\": \"Switch 1\"},"
+    " {\"id\": \"5dc1564130yyyyyyyyyyyyyy\", \"name\": \"Switch 2\"}]}";
+  SPIFFS.files[PRODUCT_CONFIG_FILE].assign(config, config + strlen(config));
+  g_wifiManager.updatePrimarySettings("host-network", "host-password");
+
+  s_journalPartition.data.assign(s_journalPartition.size, 0xFF);
+  hostDataPartitions[0] = &s_journalPartition;
+
+  // Previous boots, each with every mark and a full length version
+  Preferences preferences;
+  preferences.begin("boot");
+  preferences.putULong("count", 10);
+  for (uint32_t boot = 10 - BOOT_HISTORY_SIZE + 1; boot < 10; boot++) {
+    BootRecord_t record = {};
+    record.boot = boot;
+    strlcpy(record.version, "10.20.30-rc.4567", sizeof(record.version));
+    record.preAppMs = 310;
+    record.reason = ESP_RST_SW;
+    record.count = BOOT_MAX_MARKS;
+    for (uint8_t i = 0; i < BOOT_MAX_MARKS; i++) {
+      char name[sizeof(record.marks[i].name) + 1];
+      snprintf(name, sizeof(name), "phase%03u", i);
+      memcpy(record.marks[i].name, name, sizeof(record.marks[i].name));  // 8 characters, not terminated
+      record.marks[i].ms = 100000 + i * 1000;
+    }
+    char key[8];
+    snprintf(key, sizeof(key), "r%u", (unsigned)(boot % BOOT_HISTORY_SIZE));
+    preferences.putBytes(key, &record, sizeof(record));
+  }
+  preferences.end();
+
+  // A full breadcrumb trail and a core dump from the crash
+  for (int i = 0; i < BREADCRUMB_COUNT + 8; i++) BREADCRUMB("crumb42x", -1000000000 - i);
+  Breadcrumbs::begin();
+  hostResetReason = ESP_RST_PANIC;
+  hostCoreDump = true;
+  strlcpy(hostCoreDumpSummary.exc_task, "NetworkTask", sizeof(hostCoreDumpSummary.exc_task));
+  hostCoreDumpSummary.exc_pc = 0x400d1234;
+  memset(hostCoreDumpSummary.app_elf_sha256, 'a', 64);
+  hostCoreDumpSummary.ex_info.mcause = 7;
+  hostCoreDumpSummary.ex_info.mtval = 0x3ffb0000;
+}
+
+/**
+ * @brief Fill what the reports carry up to their limits. After setup().
+ */
+static void fillReport() {
+  // Enough journal records for a full batch in every report
+  MetricsSample_t sample = { 81234, 65536, 1830, -61, 3 };
+  for (int i = 0; i < 64 * JOURNAL_UPLOAD_BATCH; i++) g_journal.record(JOURNAL_METRICS, &sample, sizeof(sample));
+
+  // Made-up tasks up to HEALTH_MAX_TASKS
+  hostExtraTasks = HEALTH_MAX_TASKS - uxTaskGetNumberOfTasks();
+
+  // Full metric series
+  delay(2 * METRICS_SERIES_POINTS * METRICS_SAMPLE_PERIOD_MS);
+}
+
+// ---- steady-state paths -----------------------------------------------------------------
+
+static uint8_t s_switchLevel[2] = { HIGH, HIGH };
+
+static void toggleWallSwitch(uint8_t channel) {
+  SinricProSwitch& device = SinricPro[channelDeviceId(channel)];
+  uint8_t relay = channel == 0 ? gpio_relay1 : gpio_relay2;
+  uint32_t events = device.events;
+
+  // The relay may already be at the new state after setup(), the event is always sent
+  s_switchLevel[channel] = !s_switchLevel[channel];
+  hostSetPin(channel == 0 ? gpio_switch1 : gpio_switch2, s_switchLevel[channel]);
+
+  waitFor("the power state event", [&]() { return device.events != events; });
+  CHECK(device.lastEventState == (hostPinLevel[relay] == HIGH), "event and relay disagree");
+}
+
+static void powerStateCommand(uint8_t channel, bool state) {
+  uint8_t relay = channel == 0 ? gpio_relay1 : gpio_relay2;
+  CHECK(SinricPro.hostPost(HOST_REQUEST_POWER_STATE, channel, state), "power state command rejected");
+  waitFor("the relay", [&]() { return hostPinLevel[relay] == (state ? HIGH : LOW); });
+}
+
+static void healthReport() {
+  CHECK(SinricPro.hostPost(HOST_REQUEST_HEALTH), "health report failed");
+}
+
+static void runPaths(int rounds) {
+  for (int i = 0; i < rounds; i++) {
+    toggleWallSwitch(i % 2);
+    powerStateCommand(i % 2, i % 4 < 2);
+    healthReport();
+  }
+}
+
+static void checkArena(JsonObjectConst report, const char* name) {
+  JsonObjectConst arena = report[name];
+  printf("%s: size %u, peak %u, fallbacks %u\n", name, arena["size"].as<unsigned>(), arena["peak"].as<unsigned>(),
+         arena["fallbacks"].as<unsigned>());
+  CHECK(!arena.isNull() && arena["fallbacks"] == 0, "%s overflowed to the heap", name);
+}
+
+int main(int argc, char** argv) {
+  Serial.verbose = getenv("VERBOSE") != nullptr;
+  hostTimeScale = 100;  // sample periods, debouncing and event rate limits in ms of real time
+
+  prepareDevice();
+  hostPinLevel[gpio_reset] = HIGH;  // not pressed
+  setup();
+  fillReport();
+  SinricPro.healthReport.reserve(48 * 1024);  // sized once by the first reports otherwise
+
+  // Full reports. The first round also runs every path once.
+  runPaths(4);
+  expectNoAllocations("full reports", []() { runPaths(8); });
+  printf("full report: %u bytes\n", (unsigned)SinricPro.healthReport.length());
+
+  // Compact reports: the first is full, later ones after a task ended or every HEALTH_FULL_REPORT_EVERY
+  g_healthManager.setCompact(true);
+  runPaths(4);
+  expectNoAllocations("compact reports", []() {
+    runPaths(8);
+    hostExtraTasks--;  // a task ended: resent as a full report
+    healthReport();
+    for (int i = 0; i < HEALTH_FULL_REPORT_EVERY; i++) healthReport();
+  });
+  printf("compact report: %u bytes\n", (unsigned)SinricPro.healthReport.length());
+  JsonDocument report;
+  CHECK(!deserializeJson(report, SinricPro.healthReport) && report["seq"].is<uint32_t>(), "not a compact report");
+
+  // A last full report carries the arena peaks
+  g_healthManager.setCompact(false);
+  healthReport();
+  CHECK(!deserializeJson(report, SinricPro.healthReport), "report is not JSON");
+  checkArena(report.as<JsonObjectConst>(), "healthArena");
+  checkArena(report.as<JsonObjectConst>(), "changesArena");
+
+  printf("%s\n", failures ? "FAIL" : "ok");
+  fflush(stdout);
+  _Exit(failures ? 1 : 0);  // the firmware tasks never end
+}
@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+"""
+Create and apply delta OTA patches for Wally.
+
+A patch rebuilds a new firmware image from the one currently running on the device:
+
+    python3 ota_delta.py diff old.bin new.bin update.patch.gz
+    python3 ota_delta.py apply old.bin update.patch.gz check.bin
+
+"diff" applies the patch it wrote and compares the result with new.bin before it exits.
+Patches ending in .gz are gzip compressed, which is what the device expects to download;
+the diff bytes of unchanged code are mostly zero and compress very well.
+
+Format (little endian), see OtaDeltaPatcher.h:
+
+    "WDP1" oldSize:u32 newSize:u32 oldSha256[32] newSha256[32]
+    { diffLength:u32 extraLength:u32 seek:i32 diff[diffLength] extra[extraLength] }*
+"""
+
+import argparse
+import gzip
+import hashlib
+import struct
+import sys
+
+MAGIC = b"WDP1"
+HEADER = struct.Struct("<4sII32s32s")
+CONTROL = struct.Struct("<IIi")
+
+KEY_LENGTH = 12      # bytes hashed to find a match candidate
+MIN_MATCH = 24       # shorter matches at a new alignment cost more than they save
+MAX_MERGE_GAP = 256  # mismatching bytes folded into a diff between two aligned matches
+
+
+class Region:
+    def __init__(self, new_start, old_start, length):
+        self.new_start = new_start
+        self.old_start = old_start
+        self.length = length
+
+    @property
+    def delta(self):
+        return self.old_start - self.new_start
+
+    @property
+    def new_end(self):
+        return self.new_start + self.length
+
+
+def index_old(old):
+    index = {}
+    for pos in range(len(old) - KEY_LENGTH + 1):
+        index.setdefault(old[pos:pos + KEY_LENGTH], pos)
+    return index
+
+
+def match_length(old, new, old_pos, new_pos):
+    length = 0
+    limit = min(len(old) - old_pos, len(new) - new_pos)
+    # Compare in blocks first, then byte by byte.
+    while length + 64 <= limit and old[old_pos + length:old_pos + length + 64] == new[new_pos + length:new_pos + length + 64]:
+        length += 64
+    while length < limit and old[old_pos + length] == new[new_pos + length]:
+        length += 1
+    return length
+
+
+def find_regions(old, new):
+    """Exact matches of new in old, merged into regions that share an alignment."""
+    index = index_old(old)
+    regions = []
+    delta = 0
+    pos = 0
+
+    while pos + KEY_LENGTH <= len(new):
+        # Prefer the current alignment: code after an insertion keeps the same shift.
+        old_pos = pos + delta
+        length = match_length(old, new, old_pos, pos) if 0 <= old_pos < len(old) else 0
+
+        if length < KEY_LENGTH:
+            candidate = index.get(new[pos:pos + KEY_LENGTH])
+            if candidate is not None:
+                candidate_length = match_length(old, new, candidate, pos)
+                if candidate_length >= MIN_MATCH:
+                    old_pos, length = candidate, candidate_length
+
+        if length < KEY_LENGTH:
+            pos += 1
+            continue
+
+        delta = old_pos - pos
+        last = regions[-1] if regions else None
+        if last and last.delta == delta and pos - last.new_end <= MAX_MERGE_GAP:
+            last.length = pos + length - last.new_start  # the gap becomes non-zero diff bytes
+        else:
+            regions.append(Region(pos, old_pos, length))
+        pos += length
+
+    return regions
+
+
+def diff(old, new):
+    regions = find_regions(old, new)
+    out = bytearray(HEADER.pack(MAGIC, len(old), len(new), hashlib.sha256(old).digest(), hashlib.sha256(new).digest()))
+
+    # Bytes before the first region are extra data of an empty leading record.
+    new_pos = 0
+    old_pos = 0
+    first_new = regions[0].new_start if regions else len(new)
+    first_old = regions[0].old_start if regions else 0
+    if first_new > 0 or first_old > 0:
+        out += CONTROL.pack(0, first_new, first_old)
+        out += new[:first_new]
+        new_pos, old_pos = first_new, first_old
+
+    for i, region in enumerate(regions):
+        following = regions[i + 1] if i + 1 < len(regions) else None
+        extra_end = following.new_start if following else len(new)
+        seek = (following.old_start if following else 0) - (region.old_start + region.length)
+
+        out += CONTROL.pack(region.length, extra_end - region.new_end, seek)
+        out += bytes((n - o) & 0xFF for n, o in zip(new[region.new_start:region.new_end], old[region.old_start:region.old_start + region.length]))
+        out += new[region.new_end:extra_end]
+
+    return bytes(out)
+
+
+def apply(old, patch):
+    magic, old_size, new_size, old_sha, new_sha = HEADER.unpack_from(patch, 0)
+    if magic != MAGIC:
+        raise ValueError("not a patch")
+    if old_size != len(old) or hashlib.sha256(old).digest() != old_sha:
+        raise ValueError("patch does not apply to this image")
+
+    new = bytearray()
+    pos = HEADER.size
+    old_pos = 0
+    while len(new) < new_size:
+        diff_length, extra_length, seek = CONTROL.unpack_from(patch, pos)
+        pos += CONTROL.size
+        if old_pos + diff_length > old_size or len(new) + diff_length + extra_length > new_size:
+            raise ValueError("corrupt patch: record out of range")
+        new += bytes((d + o) & 0xFF for d, o in zip(patch[pos:pos + diff_length], old[old_pos:old_pos + diff_length]))
+        pos += diff_length
+        new += patch[pos:pos + extra_length]
+        pos += extra_length
+        old_pos += diff_length + seek
+        if not 0 <= old_pos <= old_size:
+            raise ValueError("corrupt patch: seek out of range")
+
+    if pos != len(patch):
+        raise ValueError("unexpected data after patch")
+    if hashlib.sha256(new).digest() != new_sha:
+        raise ValueError("patched image hash mismatch")
+    return bytes(new)
+
+
+def read(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    return gzip.decompress(data) if data[:2] == b"\x1f\x8b" else data
+
+
+def write(path, data):
+    if path.endswith(".gz"):
+        data = gzip.compress(data, 9, mtime=0)
+    with open(path, "wb") as f:
+        f.write(data)
+    return len(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+    diff_parser = commands.add_parser("diff", help="create a patch from old to new")
+    diff_parser.add_argument("old")
+    diff_parser.add_argument("new")
+    diff_parser.add_argument("patch", help="output, gzip compressed if it ends in .gz")
+    apply_parser = commands.add_parser("apply", help="apply a patch to old")
+    apply_parser.add_argument("old")
+    apply_parser.add_argument("patch")
+    apply_parser.add_argument("new", help="output")
+    args = parser.parse_args()
+
+    old = read(args.old)
+    if args.command == "diff":
+        new = read(args.new)
+        patch = diff(old, new)
+        if apply(old, patch) != new:
+            sys.exit("internal error: patch does not reproduce %s" % args.new)
+        size = write(args.patch, patch)
+        print("%s: %d bytes (%.1f%% of %d)" % (args.patch, size, 100.0 * size / max(len(new), 1), len(new)))
+    else:
+        new = apply(old, read(args.patch))
+        write(args.new, new)
+        print("%s: %d bytes, SHA-256 verified" % (args.new, len(new)))
+
+
+if __name__ == "__main__":
+    main()
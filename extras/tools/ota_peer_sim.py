@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+"""
+Simulate a site rollout with the OTA peer cache (OTA_PEER_CACHE_ENABLED).
+
+Starts an origin server and a number of simulated devices on localhost. Every device
+follows the firmware's OTAManager logic: look for a peer that advertises the new
+version, download from it in OTA_CHUNK_SIZE ranges, check the SHA-256 against
+<origin url>.sha256 and fall back to the origin on any failure. A device that has
+installed the image starts sharing it. WAN (origin) and LAN (peer) bytes are counted.
+
+    python3 ota_peer_sim.py firmware.bin --devices 20 --bad-peers 2 --drop-rate 0.1
+
+Discovery uses an in-process registry that stands in for mDNS. With --mdns (needs
+the zeroconf package) the simulated peers are also advertised as _wally-ota._tcp, so
+real devices on the LAN can download from them.
+"""
+
+import argparse
+import hashlib
+import http.client
+import random
+import socket
+import threading
+import time
+from argparse import Namespace
+from http.server import ThreadingHTTPServer
+from urllib.parse import urlsplit
+
+from ota_test_server import OtaRequestHandler
+
+CHUNK_SIZE = 65536  # OTA_CHUNK_SIZE
+MAX_RETRIES = 5     # OTA_MAX_RETRIES
+
+
+class Counter:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.bytes = 0
+
+    def add(self, n):
+        with self.lock:
+            self.bytes += n
+
+
+class CountingHandler(OtaRequestHandler):
+    def do_GET(self):
+        self.wfile = CountingWriter(self.wfile, self.server.counter)
+        super().do_GET()
+
+
+class CountingWriter:
+    def __init__(self, wfile, counter):
+        self.wfile = wfile
+        self.counter = counter
+
+    def write(self, data):
+        self.counter.add(len(data))
+        return self.wfile.write(data)
+
+    def __getattr__(self, name):
+        return getattr(self.wfile, name)
+
+
+def serve(image, counter, drop_rate=0.0, sidecars=None):
+    server = ThreadingHTTPServer(("127.0.0.1", 0), CountingHandler)
+    server.cfg = Namespace(image=image, ranges=True, drop_rate=drop_rate, block=1460, rate=0, sidecars=sidecars or {})
+    server.counter = counter
+    server.log_message = lambda *args: None
+    OtaRequestHandler.log_message = lambda *args: None
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    return server
+
+
+class Registry:
+    """Stands in for mDNS: service name -> (url, TXT version)."""
+
+    def __init__(self, mdns):
+        self.lock = threading.Lock()
+        self.peers = {}
+        self.zeroconf = None
+        if mdns:
+            from zeroconf import Zeroconf
+            self.zeroconf = Zeroconf()
+
+    def advertise(self, name, port, version):
+        with self.lock:
+            self.peers[name] = ("http://127.0.0.1:%d/firmware.bin" % port, version)
+        if self.zeroconf:
+            from zeroconf import ServiceInfo
+            address = socket.inet_aton(socket.gethostbyname(socket.gethostname()))
+            self.zeroconf.register_service(ServiceInfo("_wally-ota._tcp.local.", "%s._wally-ota._tcp.local." % name,
+                                                       addresses=[address], port=port, properties={"version": version}))
+
+    def find(self, version, exclude):
+        with self.lock:
+            candidates = [url for name, (url, v) in self.peers.items() if v == version and name != exclude]
+        return random.choice(candidates) if candidates else None
+
+
+def get(url, start=None, end=None):
+    parts = urlsplit(url)
+    connection = http.client.HTTPConnection(parts.hostname, parts.port, timeout=10)
+    headers = {"Range": "bytes=%d-%d" % (start, end)} if start is not None else {}
+    connection.request("GET", parts.path, headers=headers)
+    response = connection.getresponse()
+    if response.status not in (200, 206):
+        raise IOError("HTTP %d" % response.status)
+    return response.read()
+
+
+def download(url, total):
+    """Range download with retries, like OTAManager::download()."""
+    image = bytearray()
+    retries = 0
+    while len(image) < total:
+        start = len(image)
+        end = min(start + CHUNK_SIZE - start % CHUNK_SIZE, total) - 1
+        try:
+            image += get(url, start, end)
+            retries = 0
+        except (IOError, http.client.HTTPException) as e:
+            retries += 1
+            if retries > MAX_RETRIES:
+                raise IOError("gave up after %d retries: %s" % (MAX_RETRIES, e))
+    return bytes(image[:total])
+
+
+class Device(threading.Thread):
+    def __init__(self, name, args, origin_url, total, version, registry):
+        super().__init__()
+        self.name = name
+        self.args = args
+        self.origin_url = origin_url
+        self.total = total
+        self.version = version
+        self.registry = registry
+        self.lan = Counter()
+        self.source = None
+        self.error = None
+
+    def run(self):
+        time.sleep(random.uniform(0, self.args.stagger))
+        image = None
+
+        peer = self.registry.find(self.version, self.name)
+        if peer:
+            expected = bytes.fromhex(get(self.origin_url + ".sha256")[:64].decode())
+            try:
+                image = download(peer, self.total)
+                if hashlib.sha256(image).digest() != expected:
+                    raise IOError("Image hash mismatch")
+                self.source = "peer"
+            except IOError as e:
+                print("%s: peer download failed: %s. Using the origin" % (self.name, e))
+                image = None
+
+        if image is None:
+            image = download(self.origin_url, self.total)
+            self.source = "origin"
+
+        # Installed and verified: share it.
+        if self.name in self.args.bad:
+            image = bytes(b ^ 0xFF for b in image[:1024]) + image[1024:]
+        server = serve(image, self.lan, self.args.drop_rate)
+        self.registry.advertise(self.name, server.server_address[1], self.version)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("image", help="firmware image to roll out")
+    parser.add_argument("--devices", type=int, default=10)
+    parser.add_argument("--version", default="1.2.0")
+    parser.add_argument("--bad-peers", type=int, default=0, help="devices that share a corrupted image")
+    parser.add_argument("--drop-rate", type=float, default=0.0, help="probability that a response is cut short")
+    parser.add_argument("--stagger", type=float, default=2.0, help="devices start within this many seconds")
+    parser.add_argument("--mdns", action="store_true", help="also advertise peers with zeroconf")
+    parser.add_argument("--seed", type=int)
+    args = parser.parse_args()
+
+    if args.seed is not None:
+        random.seed(args.seed)
+    with open(args.image, "rb") as f:
+        image = f.read()
+    sha256 = hashlib.sha256(image).hexdigest()
+
+    names = ["wally-%02d" % i for i in range(args.devices)]
+    args.bad = set(random.sample(names, min(args.bad_peers, len(names))))
+
+    wan = Counter()
+    origin = serve(image, wan, args.drop_rate, {".sha256": ("%s  firmware.bin\n" % sha256).encode()})
+    origin_url = "http://127.0.0.1:%d/firmware.bin" % origin.server_address[1]
+
+    registry = Registry(args.mdns)
+    devices = [Device(name, args, origin_url, len(image), args.version, registry) for name in names]
+    for device in devices:
+        device.start()
+    for device in devices:
+        device.join()
+
+    lan = sum(d.lan.bytes for d in devices)
+    sources = [d.source for d in devices]
+    print("%d devices: %d from the origin, %d from peers (%d bad peers)" %
+          (len(devices), sources.count("origin"), sources.count("peer"), len(args.bad)))
+    print("WAN: %d bytes (%.1f images), LAN: %d bytes" % (wan.bytes, wan.bytes / len(image), lan))
+
+
+if __name__ == "__main__":
+    main()
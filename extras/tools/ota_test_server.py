@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""
+Local HTTP server for exercising OTA downloads.
+
+Serves a firmware image with "Range: bytes=a-b" support and can inject connection
+drops, so resumable downloads can be tested without a flaky network.
+
+    python3 ota_test_server.py firmware.bin --port 8080 --drop-rate 0.3
+
+--ignore-range-rate answers some range requests with the whole image, like a proxy or
+CDN that ignores Range. The device must start over instead of writing it at the offset.
+
+Then trigger an OTA update with url http://<host-ip>:8080/firmware.bin. With
+--signature and --sha256, requests for <any path>.sig and <any path>.sha256 return
+those files (the hash is needed when devices try LAN peers first, see ota_peer_sim.py).
+
+With --tls cert.pem key.pem the server speaks HTTPS, for measuring handshake cost and
+testing OTA_TLS_FINGERPRINT. A self-signed certificate and its fingerprint:
+
+    openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes -days 365 \
+        -subj /CN=ota-test -keyout key.pem -out cert.pem
+    openssl x509 -in cert.pem -noout -fingerprint -sha256
+"""
+
+import argparse
+import os
+import random
+import re
+import ssl
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+RANGE_RE = re.compile(r"bytes=(\d+)-(\d*)")
+
+
+class OtaRequestHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # keep-alive, like a CDN
+
+    def do_GET(self):
+        cfg = self.server.cfg
+        data = cfg.image
+        suffix = next((s for s in cfg.sidecars if self.path.endswith(s)), None)
+        if suffix:
+            data = cfg.sidecars[suffix]
+        elif self.path.endswith((".sig", ".sha256")):
+            self.send_error(404)
+            return
+        total = len(data)
+
+        start, end = 0, total - 1
+        status = 200
+        match = RANGE_RE.fullmatch(self.headers.get("Range", "")) if cfg.ranges else None
+        if match and int(match.group(1)) > 0 and random.random() < cfg.ignore_range_rate:
+            self.log_message("ignoring Range: %s", self.headers["Range"])
+            match = None
+        if match:
+            start = int(match.group(1))
+            end = min(int(match.group(2)) if match.group(2) else total - 1, total - 1)
+            if start > end:
+                self.send_response(416)
+                self.send_header("Content-Range", "bytes */%d" % total)
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return
+            status = 206
+
+        body = data[start:end + 1]
+        self.send_response(status)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(len(body)))
+        self.send_header("Accept-Ranges", "bytes" if cfg.ranges else "none")
+        if status == 206:
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, end, total))
+        self.end_headers()
+
+        # Drop somewhere inside the body with the configured probability.
+        drop_at = len(body)
+        if data is cfg.image and len(body) > 1 and random.random() < cfg.drop_rate:
+            drop_at = random.randrange(1, len(body))
+
+        sent = 0
+        while sent < drop_at:
+            n = min(cfg.block, drop_at - sent)
+            self.wfile.write(body[sent:sent + n])
+            sent += n
+            if cfg.rate:
+                time.sleep(n / cfg.rate)
+
+        if drop_at < len(body):
+            self.log_message("dropped connection after %d/%d bytes of %d-%d", sent, len(body), start, end)
+            self.close_connection = True
+            self.connection.shutdown(2)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("image", help="firmware image to serve")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--drop-rate", type=float, default=0.0, help="probability that a response is cut short (0..1)")
+    parser.add_argument("--rate", type=int, default=0, help="throttle to this many bytes/s (0: unlimited)")
+    parser.add_argument("--block", type=int, default=1460, help="write size in bytes")
+    parser.add_argument("--no-ranges", dest="ranges", action="store_false", help="ignore Range headers")
+    parser.add_argument("--ignore-range-rate", type=float, default=0.0,
+                        help="probability that a range request not starting at 0 gets the whole image (0..1)")
+    parser.add_argument("--signature", help="detached signature served for <path>.sig")
+    parser.add_argument("--sha256", help="sha256sum output for the final image, served for <path>.sha256")
+    parser.add_argument("--tls", nargs=2, metavar=("CERT", "KEY"), help="serve HTTPS with this certificate and key")
+    parser.add_argument("--seed", type=int, help="random seed for reproducible drops")
+    cfg = parser.parse_args()
+
+    if cfg.seed is not None:
+        random.seed(cfg.seed)
+    path = cfg.image
+    with open(path, "rb") as f:
+        cfg.image = f.read()
+    cfg.sidecars = {}
+    for suffix, sidecar in ((".sig", cfg.signature), (".sha256", cfg.sha256)):
+        if sidecar:
+            with open(sidecar, "rb") as f:
+                cfg.sidecars[suffix] = f.read()
+
+    server = ThreadingHTTPServer(("0.0.0.0", cfg.port), OtaRequestHandler)
+    server.cfg = cfg
+    if cfg.tls:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(*cfg.tls)
+        server.socket = context.wrap_socket(server.socket, server_side=True)
+    print("Serving %s (%d bytes) on port %d%s" % (os.path.basename(path), len(cfg.image), cfg.port, " (TLS)" if cfg.tls else ""))
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+"""
+Flash and RAM used by every object file of a firmware, from the GNU ld map file.
+
+Build with -Wl,-Map (the ESP32-size environment of Wally-PIO does, and runs this script
+as its size_report target), then:
+
+    python3 size_report.py firmware.map --filter "Sinric|Wally" --top 30
+    python3 size_report.py firmware.map --json 1.2.0.json
+    python3 size_report.py firmware.map --compare 1.2.0.json --budget-flash 1400000 --budget-ram 120000
+
+Columns, in bytes:
+  flash  everything in the image: code and constants in flash, IRAM code, initial values of .data
+  iram   code that runs from internal RAM
+  dram   .data and .bss in internal RAM (the heap gets the rest)
+  rtc    RTC memory, psram: .bss placed in external RAM
+Header-only libraries (ArduinoJson) count in the objects that include them.
+Exits with 1 if a budget is exceeded, so a release build can check it.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+COLUMNS = ("flash", "iram", "dram", "rtc", "psram")
+
+OUTPUT_SECTION = re.compile(r"^(\.[\w.]+)")
+INPUT_SECTION = re.compile(r"^ (\S+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+INPUT_NAME = re.compile(r"^ (\.\S+)$")
+INPUT_CONTINUED = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+
+
+def classify(section):
+    """Returns the columns an output section counts in."""
+    if section.startswith((".flash.text", ".flash.rodata", ".flash.appdesc")):
+        return ("flash",) if "noload" not in section else ()
+    if section.startswith((".iram0.text", ".iram0.vectors", ".iram0.data")):
+        return ("flash", "iram")
+    if section.startswith(".dram0.data"):
+        return ("flash", "dram")
+    if section.startswith((".dram0.bss", ".noinit")):
+        return ("dram",)
+    if section.startswith((".rtc.text", ".rtc.data", ".rtc.force_fast", ".rtc.force_slow")):
+        return ("flash", "rtc")
+    if section.startswith((".rtc.bss", ".rtc_noinit", ".rtc.noinit")):
+        return ("rtc",)
+    if section.startswith(".ext_ram"):
+        return ("psram",)
+    return ()
+
+
+def object_name(path):
+    """libfoo.a(bar.o) for archive members, the file name for plain objects."""
+    match = re.match(r"(.*?)([^/\\]+\.a)\((.*)\)$", path)
+    if match:
+        return "%s(%s)" % (match.group(2), match.group(3))
+    return os.path.basename(path)
+
+
+def parse_map(lines):
+    """Returns {object: {column: bytes}}."""
+    sizes = {}
+    columns = ()
+    in_map = False
+    pending = None  # input section name on a line of its own
+
+    def add(size, path):
+        if not columns or size == 0 or path.startswith("*"):
+            return
+        entry = sizes.setdefault(object_name(path.strip()), dict.fromkeys(COLUMNS, 0))
+        for column in columns:
+            entry[column] += size
+
+    for line in lines:
+        line = line.rstrip("\r\n")
+        if not in_map:
+            in_map = line.startswith("Linker script and memory map")
+            continue
+
+        if pending:
+            match = INPUT_CONTINUED.match(line)
+            pending = None
+            if match:
+                add(int(match.group(2), 16), match.group(3))
+                continue
+
+        match = OUTPUT_SECTION.match(line)
+        if match:
+            columns = classify(match.group(1))
+            continue
+
+        match = INPUT_SECTION.match(line)
+        if match:
+            if match.group(1) != "*fill*" and not match.group(4).startswith("0x"):
+                add(int(match.group(3), 16), match.group(4))
+            continue
+
+        if INPUT_NAME.match(line):
+            pending = line
+
+    return sizes
+
+
+def totals(sizes):
+    return {column: sum(entry[column] for entry in sizes.values()) for column in COLUMNS}
+
+
+def print_table(sizes, base, top):
+    rows = sorted(sizes.items(), key=lambda item: (-item[1]["flash"], item[0]))
+    if top:
+        rows = rows[:top]
+    width = max([len(name) for name, _ in rows] + [len("total")])
+
+    header = "%-*s" % (width, "object") + "".join("%10s" % column for column in COLUMNS)
+    if base is not None:
+        header += "%10s%10s" % ("+flash", "+dram")
+    print(header)
+
+    def line(name, entry, before):
+        text = "%-*s" % (width, name) + "".join("%10d" % entry[column] for column in COLUMNS)
+        if base is not None:
+            before = before or dict.fromkeys(COLUMNS, 0)
+            text += "%+10d%+10d" % (entry["flash"] - before["flash"], entry["dram"] - before["dram"])
+        print(text)
+
+    for name, entry in rows:
+        line(name, entry, base.get(name) if base is not None else None)
+    line("total", totals(sizes), totals(base) if base is not None else None)
+
+    if base is not None:
+        gone = sorted(set(base) - set(sizes))
+        if gone:
+            print("removed: %s" % ", ".join(gone))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("map", help="linker map file")
+    parser.add_argument("--filter", help="only objects matching this regular expression")
+    parser.add_argument("--top", type=int, default=0, help="largest N objects only")
+    parser.add_argument("--json", help="save the sizes, e.g. per release")
+    parser.add_argument("--compare", help="sizes saved with --json to compare against")
+    parser.add_argument("--budget-flash", type=int, help="fail if the whole image uses more flash")
+    parser.add_argument("--budget-ram", type=int, help="fail if the whole image uses more DRAM + IRAM")
+    args = parser.parse_args()
+
+    with open(args.map, errors="replace") as f:
+        sizes = parse_map(f)
+    if not sizes:
+        sys.exit("%s: no allocated sections found. Is it a GNU ld map file?" % args.map)
+    image = totals(sizes)
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(sizes, f, indent=1, sort_keys=True)
+
+    base = None
+    if args.compare:
+        with open(args.compare) as f:
+            base = json.load(f)
+
+    shown = sizes
+    if args.filter:
+        pattern = re.compile(args.filter)
+        shown = {name: entry for name, entry in sizes.items() if pattern.search(name)}
+        if base is not None:
+            base = {name: entry for name, entry in base.items() if pattern.search(name)}
+    print_table(shown, base, args.top)
+
+    failed = False
+    if args.budget_flash is not None and image["flash"] > args.budget_flash:
+        print("flash budget exceeded: %d > %d bytes" % (image["flash"], args.budget_flash))
+        failed = True
+    ram = image["dram"] + image["iram"]
+    if args.budget_ram is not None and ram > args.budget_ram:
+        print("RAM budget exceeded: %d > %d bytes" % (ram, args.budget_ram))
+        failed = True
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
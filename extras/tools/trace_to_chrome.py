@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""
+Convert a ProvTrace dump to Chrome trace JSON (chrome://tracing, https://ui.perfetto.dev).
+
+Build with TRACE_EVENT_COUNT > 0, then capture a dump either from the serial monitor
+(send 't' to the Wally example) or from the trace BLE characteristic. The input may be a
+whole serial log: lines without "TRACE " are skipped and the last complete dump is used.
+
+    python3 trace_to_chrome.py serial.log -o trace.json
+
+Every task is a thread, the core an event ran on is in its args. The device clock wraps
+after 71 minutes; timestamps are unwrapped. End events whose begin was overwritten in the
+ring are dropped, begin events still open at dump time are closed at the dump time.
+"""
+
+import argparse
+import json
+import sys
+
+WRAP = 1 << 32
+
+
+def parse_dumps(lines):
+    """Yields (now, overwritten, tasks, events) for every complete dump."""
+    dump = None
+    for line in lines:
+        start = line.find("TRACE ")
+        if start < 0:
+            continue
+        fields = line[start:].rstrip("\r\n").split(" ")
+        kind = fields[1] if len(fields) > 1 else ""
+
+        if kind == "v1":
+            dump = {"now": int(fields[4]), "overwritten": int(fields[3]), "tasks": {}, "events": []}
+        elif dump is None:
+            continue
+        elif kind == "T":
+            dump["tasks"][fields[2]] = " ".join(fields[3:])
+        elif kind == "E":
+            time, phase, core, task, arg = int(fields[2]), fields[3], int(fields[4]), fields[5], int(fields[6])
+            dump["events"].append((time, phase, core, task, arg, " ".join(fields[7:])))
+        elif kind == "END":
+            yield dump
+            dump = None
+
+
+def unwrap(events, now):
+    """Makes the 32-bit us timestamps monotonic, returns them and the unwrapped dump time."""
+    offset = 0
+    previous = None
+    times = []
+    for event in events:
+        time = event[0] + offset
+        if previous is not None and time < previous - WRAP // 2:
+            offset += WRAP
+            time += WRAP
+        times.append(time)
+        previous = time
+    if previous is not None:
+        now = previous + (now - previous) % WRAP  # the dump was taken after the last event
+    return times, now
+
+
+def convert(dump):
+    tids = {task: index + 1 for index, task in enumerate(dump["tasks"])}
+    trace = [{"name": "process_name", "ph": "M", "pid": 1, "args": {"name": "device"}}]
+    for task, tid in tids.items():
+        trace.append({"name": "thread_name", "ph": "M", "pid": 1, "tid": tid, "args": {"name": dump["tasks"][task]}})
+
+    times, now = unwrap(dump["events"], dump["now"])
+    origin = times[0] if times else 0
+    open_events = {}  # tid -> names of the open begin events
+
+    for time, (_, phase, core, task, arg, name) in zip(times, dump["events"]):
+        tid = tids.setdefault(task, len(tids) + 1)
+        stack = open_events.setdefault(tid, [])
+        event = {"name": name, "ph": phase, "ts": time - origin, "pid": 1, "tid": tid, "args": {"core": core}}
+        if arg:
+            event["args"]["arg"] = arg
+
+        if phase == "B":
+            stack.append(name)
+        elif phase == "E":
+            if name not in stack:
+                continue  # begin was overwritten
+            while stack and stack.pop() != name:
+                pass
+        elif phase == "i":
+            event["s"] = "t"
+        trace.append(event)
+
+    for tid, stack in open_events.items():
+        for name in reversed(stack):
+            trace.append({"name": name, "ph": "E", "ts": now - origin, "pid": 1, "tid": tid, "args": {"unfinished": True}})
+
+    return {"traceEvents": trace, "displayTimeUnit": "ms",
+            "otherData": {"overwritten": dump["overwritten"], "events": len(dump["events"])}}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="serial log or BLE dump, - for stdin")
+    parser.add_argument("-o", "--output", help="output file (default: stdout)")
+    args = parser.parse_args()
+
+    with (sys.stdin if args.input == "-" else open(args.input, errors="replace")) as f:
+        dumps = list(parse_dumps(f))
+    if not dumps:
+        sys.exit("No complete trace dump (TRACE v1 ... TRACE END) found")
+
+    dump = dumps[-1]
+    if dump["overwritten"]:
+        print("%d older events were overwritten, raise TRACE_EVENT_COUNT to keep them" % dump["overwritten"], file=sys.stderr)
+
+    result = convert(dump)
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(result, f)
+    else:
+        json.dump(result, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
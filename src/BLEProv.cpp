@@ -15,8 +15,9 @@ BLEProvClass::BLEProvClass()
 , m_WiFiCredentialsCallbackHandler(nullptr),
   m_CloudCredentialsCallbackHandler(nullptr),
   m_receivedCloudCredentialsConfig(""),
-  m_uuidService(BLE_SERVICE_UUID),
-  m_uuidWiFiConfig(BLE_WIFI_CONFIG_UUID),
+  m_uuidService(BLE_SERVICE_UUID)
+#if !BLE_PROV_COMPACT
+, m_uuidWiFiConfig(BLE_WIFI_CONFIG_UUID),
   m_uuidWiFiConfigNotify(BLE_WIFI_CONFIG_NOTIFY_UUID),
   m_uuidKeyExchange(BLE_KEY_EXCHANGE_UUID),
   m_uuidKeyExchangeNotify(BLE_KEY_EXCHANGE_NOTIFY_UUID),
@@ -25,7 +26,9 @@ BLEProvClass::BLEProvClass()
   m_uuidWiFiList(BLE_WIFI_LIST_UUID),
   m_uuidWiFiListNotify(BLE_WIFI_LIST_NOTIFY_UUID),
   m_uuidProvInfo(BLE_PROV_INFO_UUID),
-  m_uuidProvInfoNotify(BLE_INFO_NOTIFY_UUID){}
+  m_uuidProvInfoNotify(BLE_INFO_NOTIFY_UUID)
+#endif
+  {}
 
 /**
 * @brief Setup BLE provisioning endpoints 
@@ -34,6 +37,7 @@ void BLEProvClass::begin(const String &deviceName, const String &retailItemId) {
   if (m_begin) stop();
 
   DEBUG_PROV(PSTR("[BLEProvClass.begin]: Setup BLE endpoints ..\r\n"));
+  BREADCRUMB("bleBegin", ESP.getFreeHeap());
   
   NimBLEDevice::init(deviceName.c_str());
   NimBLEDevice::setPower(ESP_PWR_LVL_P9);
@@ -46,6 +50,13 @@ void BLEProvClass::begin(const String &deviceName, const String &retailItemId) {
 
   m_pService = m_pServer->createService(m_uuidService);
 
+#if BLE_PROV_COMPACT
+  // Every command and response goes through these two, so the app subscribes to a single CCCD.
+  m_provRx = m_pService->createCharacteristic(NimBLEUUID(BLE_RX_UUID), NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::WRITE_NR);
+  m_provRx->setCallbacks(this);
+
+  m_provTx = m_pService->createCharacteristic(NimBLEUUID(BLE_TX_UUID), NIMBLE_PROPERTY::NOTIFY);
+#else
   m_provWiFiConfig = m_pService->createCharacteristic(m_uuidWiFiConfig, NIMBLE_PROPERTY::WRITE_NR); 
   m_provWiFiConfig->setValue("wifi_config");
   m_provWiFiConfig->setCallbacks(this);
@@ -86,6 +97,16 @@ void BLEProvClass::begin(const String &deviceName, const String &retailItemId) {
   m_provInfoNotify->setValue("prov_info_notify");
   m_provInfoNotify->setCallbacks(this);
 
+#if TRACE_EVENT_COUNT > 0
+  m_provTrace = m_pService->createCharacteristic(NimBLEUUID(BLE_TRACE_UUID), NIMBLE_PROPERTY::WRITE_NR);
+  m_provTrace->setValue("trace");
+  m_provTrace->setCallbacks(this);
+
+  m_provTraceNotify = m_pService->createCharacteristic(NimBLEUUID(BLE_TRACE_NOTIFY_UUID), NIMBLE_PROPERTY::NOTIFY);
+  m_provTraceNotify->setValue("trace_notify");
+  m_provTraceNotify->setCallbacks(this);
+#endif
+#endif
  
   m_pService->start();
   
@@ -102,8 +123,10 @@ void BLEProvClass::begin(const String &deviceName, const String &retailItemId) {
 /**
 * @brief Generate a session encryption key using public key.
 */
-void BLEProvClass::handleKeyExchange(const std::string& publicKey, NimBLECharacteristic* pCharacteristic) {
+void BLEProvClass::handleKeyExchange(const std::string& publicKey) {
+  TRACE_SCOPE("keyExchange", publicKey.length());
   DEBUG_PROV(PSTR("[BLEProvClass.handleKeyExchange()]:: Start!\r\n"));
+  BREADCRUMB("keyx", ESP.getFreeHeap());
 
   struct KeyExchangeData {
     BLEProvClass* provClass;
@@ -112,7 +135,7 @@ void BLEProvClass::handleKeyExchange(const std::string& publicKey, NimBLECharact
 
   KeyExchangeData* data = (KeyExchangeData*)malloc(sizeof(KeyExchangeData));
   if (data == nullptr) {
-    DEBUG_PROV(PSTR("[BLEProvClass.handleKeyExchange()]: ProvData allocation failed!\r\n"));
+    DEBUG_PROV_ERROR(PSTR("[BLEProvClass.handleKeyExchange()]: ProvData allocation failed!\r\n"));
     return;
   }
 
@@ -121,6 +144,7 @@ void BLEProvClass::handleKeyExchange(const std::string& publicKey, NimBLECharact
 
   void (*onCharacteristicWriteTask)(void*) = [](void* param) {
     KeyExchangeData* data = static_cast<KeyExchangeData*>(param);
+    TRACE_BEGIN("keyxTask");
     std::string sessionKey;
     std::string publicKey(data->publicKey);
 
@@ -130,15 +154,19 @@ void BLEProvClass::handleKeyExchange(const std::string& publicKey, NimBLECharact
 
     data->provClass->m_crypto.deinitMbedTLS();
 
-    DEBUG_PROV(PSTR("[BLEProvClass.handleKeyExchange()]: Encrypted session key is: %s\r\n"), sessionKey.c_str());      
+    DEBUG_PROV(PSTR("[BLEProvClass.handleKeyExchange()]: Encrypted session key: %u bytes\r\n"), sessionKey.length());      
+
+    data->provClass->splitWrite(ProvOpcode::KeyExchange, sessionKey);
+
+    DEBUG_PROV(PSTR("[BLEProvClass.handleKeyExchange()]: Stack high-water mark: %u bytes\r\n"), uxTaskGetStackHighWaterMark(NULL));
+    BREADCRUMB("keyxDone", uxTaskGetStackHighWaterMark(NULL));
+    TRACE_END("keyxTask");
 
-    data->provClass->splitWrite(data->provClass->m_provKeyExchangeNotify, sessionKey);
-    
     vTaskDelete(NULL);
   };
 
   // Needs to run in a RTOS Task because MbedTLS crypto stack needs a large stack 
-  xTaskCreatePinnedToCore(onCharacteristicWriteTask, "BLEProvCharacteristicTask", 12288, data, 0, NULL, 0); 
+  xTaskCreatePinnedToCore(onCharacteristicWriteTask, "BLEProvCharacteristicTask", BLE_PROV_CRYPTO_TASK_STACK_SIZE, data, 0, NULL, 0); 
 }
 
  
@@ -146,10 +174,15 @@ void BLEProvClass::handleKeyExchange(const std::string& publicKey, NimBLECharact
 * @brief Called when mobile sends Sinric Pro credentials (appkey, secret, devceids). 
 * Mobile sends authentication config string in chucks due to BLE limitations
 */
-void BLEProvClass::handleCloudCredentialsConfig(const std::string& cloudCredentialsConfigChuck, NimBLECharacteristic* pCharacteristic) {
+void BLEProvClass::handleCloudCredentialsConfig(const std::string& cloudCredentialsConfigChuck) {
+  TRACE_SCOPE("cloudConfig", cloudCredentialsConfigChuck.length());
   if(m_expectedAuthConfigPayloadSize == -1) {
       m_expectedAuthConfigPayloadSize = std::atoi(cloudCredentialsConfigChuck.c_str());
       DEBUG_PROV(PSTR("[BLEProvClass.handleCloudCredentialsConfig()]: Expected config payload size: %d\r\n"), m_expectedAuthConfigPayloadSize);
+      BREADCRUMB("cloudCfg", m_expectedAuthConfigPayloadSize);
+      // One buffer for the whole payload: it is decoded and decrypted where it is
+      wipe(m_receivedCloudCredentialsConfig);
+      if (m_expectedAuthConfigPayloadSize > 0) m_receivedCloudCredentialsConfig.reserve(m_expectedAuthConfigPayloadSize);
   } else {
     // Append data chucks
     m_receivedCloudCredentialsConfig.append(cloudCredentialsConfigChuck);
@@ -160,22 +193,20 @@ void BLEProvClass::handleCloudCredentialsConfig(const std::string& cloudCredenti
       DEBUG_PROV(PSTR("[BLEProvClass.handleCloudCredentialsConfig()]: Auth config payload receive completed\r\n")); 
       
       if (m_CloudCredentialsCallbackHandler) {
-         std::vector<uint8_t> decodedConfig = m_crypto.base64Decode(m_receivedCloudCredentialsConfig);
-         m_crypto.aesCTRXdecrypt(m_crypto.key, m_crypto.iv, decodedConfig);
-         std::string authConfig(decodedConfig.begin(), decodedConfig.end());    
-    
-         DEBUG_PROV(PSTR("[BLEProvClass.handleCloudCredentialsConfig()]: Decrypted config: %s\r\n"), authConfig.c_str());  
+         bool success = decryptInPlace(m_receivedCloudCredentialsConfig);
+         DEBUG_PROV(PSTR("[BLEProvClass.handleCloudCredentialsConfig()]: Decrypted config: %u bytes\r\n"), m_receivedCloudCredentialsConfig.length());  
     
          // Calling callback to connect to WiFi      
-         bool success = m_CloudCredentialsCallbackHandler(String(authConfig.c_str())); 
+         success = success && m_CloudCredentialsCallbackHandler(m_receivedCloudCredentialsConfig.c_str(), m_receivedCloudCredentialsConfig.length()); 
+         wipe(m_receivedCloudCredentialsConfig);
          std::string jsonString;
          
-         JsonDocument doc;
+         JsonDocument doc(JsonArena::instance());
          doc["success"] = success ? true : false;
-         serializeJsonPretty(doc, jsonString); 
-         DEBUG_PROV(PSTR("[BLEProvClass.handleCloudCredentialsConfig()]: Response: %s\r\n"), jsonString.c_str());    
+         serializeJson(doc, jsonString); 
+         DEBUG_PROV(PSTR("[BLEProvClass.handleCloudCredentialsConfig()]: Response: %u bytes\r\n"), jsonString.length());    
     
-         splitWrite(m_provCloudCredentialConfigNotify, jsonString);
+         splitWrite(ProvOpcode::CloudCredentials, jsonString);
 
          DEBUG_PROV(PSTR("[BLEProvClass.handleCloudCredentialsConfig()]: Notified!\r\n"));    
 
@@ -188,15 +219,15 @@ void BLEProvClass::handleCloudCredentialsConfig(const std::string& cloudCredenti
             m_BleProvDoneCallbackHandler();
          }
         } else {
-          DEBUG_PROV(PSTR("[BLEProvClass.handleCloudCredentialsConfig()]: Auth callback not defined!\r\n"));  
+          DEBUG_PROV_ERROR(PSTR("[BLEProvClass.handleCloudCredentialsConfig()]: Auth callback not defined!\r\n"));  
+          wipe(m_receivedCloudCredentialsConfig);
           
           std::string jsonString;
-          JsonDocument doc;
+          JsonDocument doc(JsonArena::instance());
           doc[F("success")] = false;
           doc[F("message")] = F("Failed set authentication (nocallback)..");
-          serializeJsonPretty(doc, jsonString);
-          pCharacteristic->setValue(jsonString);
-          pCharacteristic->notify(true);
+          serializeJson(doc, jsonString);
+          notify(ProvOpcode::CloudCredentials, jsonString);
         }    
     }          
   }     
@@ -205,50 +236,48 @@ void BLEProvClass::handleCloudCredentialsConfig(const std::string& cloudCredenti
 /**
 * @brief Called when mobile sends WiFi credentials.
 */
-void BLEProvClass::handleWiFiConfig(const std::string& wificonfig, NimBLECharacteristic* pCharacteristic) {
+void BLEProvClass::handleWiFiConfig(std::string wificonfig) {
+  TRACE_SCOPE("wifiConfig", wificonfig.length());
   DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiConfig()]: Start!\r\n"));  
+  BREADCRUMB("wifiCfg", wificonfig.length());
  
   if (m_WiFiCredentialsCallbackHandler) {
-     std::vector<uint8_t> decoded = m_crypto.base64Decode(wificonfig);
-     m_crypto.aesCTRXdecrypt(m_crypto.key, m_crypto.iv, decoded);
-     std::string wiFi_config(decoded.begin(), decoded.end());
-
-     DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiConfig()]: Wi-Fi config: %s\r\n"), wiFi_config.c_str());  
+     bool success = decryptInPlace(wificonfig);
+     DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiConfig()]: Wi-Fi config: %u bytes\r\n"), wificonfig.length());  
      
-     bool success = m_WiFiCredentialsCallbackHandler(String(wiFi_config.c_str())); 
+     success = success && m_WiFiCredentialsCallbackHandler(wificonfig.c_str(), wificonfig.length()); 
+     wipe(wificonfig);
 
      std::string jsonString = "";
      
      if(success) {
-        JsonDocument doc;
+        JsonDocument doc(JsonArena::instance());
         doc[F("success")] = true;
         doc[F("message")] = F("Success!");
         doc[F("bssid")] = WiFi.macAddress();
         doc[F("ip")] = WiFi.localIP().toString();
-        serializeJsonPretty(doc, jsonString); 
+        serializeJson(doc, jsonString); 
      } else {
-        JsonDocument doc;
+        JsonDocument doc(JsonArena::instance());
         doc[F("success")] = false;
         doc[F("message")] = F("Failed to connect to WiFi. Is password correct?");
-        serializeJsonPretty(doc, jsonString);
+        serializeJson(doc, jsonString);
      }
 
      DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiConfig()]: WiFi Config response size: %u\r\n"), jsonString.length());    
-     DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiConfig()]: WiFi Config response: %s\r\n"), jsonString.c_str());    
       
-     splitWrite(m_provWiFiConfigNotify, jsonString);
+     splitWrite(ProvOpcode::WiFiConfig, jsonString);
 
      DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiConfig()]: Done!\r\n"));          
     } else {
-      DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiConfig()]: m_WiFiCredentialsCallbackHandler not set!\r\n"));    
+      DEBUG_PROV_ERROR(PSTR("[BLEProvClass.handleWiFiConfig()]: m_WiFiCredentialsCallbackHandler not set!\r\n"));    
       
       std::string jsonString;
-      JsonDocument doc;
+      JsonDocument doc(JsonArena::instance());
       doc[F("success")] = false;
       doc[F("message")] = F("Wifi Credentials Callback not set!..");
-      serializeJsonPretty(doc, jsonString);
-      m_provWiFiConfigNotify->setValue(jsonString);
-      m_provWiFiConfigNotify->notify();
+      serializeJson(doc, jsonString);
+      notify(ProvOpcode::WiFiConfig, jsonString);
    }
 
    DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiConfig()]: End!\r\n"));   
@@ -257,8 +286,10 @@ void BLEProvClass::handleWiFiConfig(const std::string& wificonfig, NimBLECharact
 /**
 * @brief Called when mobile wants a list of WiFis ESP can connect to.
 */
-void BLEProvClass::handleWiFiList(NimBLECharacteristic* pCharacteristic) {
+void BLEProvClass::handleWiFiList() {
+  TRACE_SCOPE("wifiList");
   DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiList()]: Start!\r\n"));  
+  BREADCRUMB("wifiScan", 0);
 
   DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiList()]: Scanning networks..!\r\n")); 
   
@@ -278,7 +309,7 @@ void BLEProvClass::handleWiFiList(NimBLECharacteristic* pCharacteristic) {
     DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiList()]: Scanning completed..!\r\n"));
     
     if (ret == WIFI_SCAN_FAILED) {
-      DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiList()]: Scan failed!\r\n"));
+      DEBUG_PROV_ERROR(PSTR("[BLEProvClass.handleWiFiList()]: Scan failed!\r\n"));
       scanAttempts++;
       if (scanAttempts < maxAttempts) {
         DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiList()]: Resetting WiFi and retrying scan...\r\n"));
@@ -296,7 +327,7 @@ void BLEProvClass::handleWiFiList(NimBLECharacteristic* pCharacteristic) {
   }
 
   if (scanAttempts == maxAttempts) {
-    DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiList()]: All scan attempts failed after WiFi resets!\r\n"));
+    DEBUG_PROV_ERROR(PSTR("[BLEProvClass.handleWiFiList()]: All scan attempts failed after WiFi resets!\r\n"));
   } else {
     DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiList()]: Scan successful!\r\n"));
   }
@@ -314,75 +345,194 @@ void BLEProvClass::handleWiFiList(NimBLECharacteristic* pCharacteristic) {
   // Free memory
   WiFi.scanDelete();
    
-  splitWrite(m_provWiFiListNotify, std::string(jsonString.c_str()));      
+  splitWrite(ProvOpcode::WiFiList, std::string(jsonString.c_str()));      
       
   DEBUG_PROV(PSTR("[BLEProvClass.handleWiFiList()]: End!\r\n"));    
 }
 
+/**
+* @brief Base64 decode and decrypt a payload in its own buffer. The plaintext stays NUL terminated.
+*/
+bool BLEProvClass::decryptInPlace(std::string& data) {
+  uint8_t* buffer = reinterpret_cast<uint8_t*>(&data[0]);
+  size_t length = 0;
+  bool success = m_crypto.base64DecodeInPlace(buffer, data.length(), length) &&
+                 m_crypto.aesCTRXdecrypt(m_crypto.key, m_crypto.iv, buffer, length);
+  data.resize(success ? length : 0);  // shrinking does not reallocate
+  return success;
+}
+
+/**
+* @brief Clear a buffer that held credentials and release it.
+*/
+void BLEProvClass::wipe(std::string& data) {
+  if (!data.empty()) memset(&data[0], 0, data.length());
+  std::string().swap(data);
+}
+
 /**
 * @brief Split the data into chunks and write. App will reassemble the complete data from these fragments.
 */
-void BLEProvClass::splitWrite(NimBLECharacteristic * pCharacteristic, const std::string& data) {
+void BLEProvClass::splitWrite(ProvOpcode opcode, const std::string& data) {
+  TRACE_SCOPE("splitWrite", data.length());
+
   // Write length
-  pCharacteristic->setValue(ProvUtil::to_string(data.length()));
-  pCharacteristic->notify(true);
+  notify(opcode, ProvUtil::to_string(data.length()));
   delay(500);
 
-  // Write data
+  // Write data. The compact layout spends one byte of each fragment on the opcode.
+  const int fragmentSize = BLE_PROV_COMPACT ? BLE_FRAGMENT_SIZE - 1 : BLE_FRAGMENT_SIZE;
   int offset          = 0;
   int remainingLength = data.length();
   const uint8_t* str  = reinterpret_cast<const uint8_t*>(data.c_str());
 
   while (remainingLength > 0) {
-    int bytesToSend = min(BLE_FRAGMENT_SIZE, remainingLength); // send in chunks bytes until all the bytes are sent
+    int bytesToSend = min(fragmentSize, remainingLength); // send in chunks bytes until all the bytes are sent
     DEBUG_PROV(PSTR("[BLEProvClass.splitWrite()]: Sending %u bytes!\r\n"), bytesToSend);    
-    pCharacteristic->setValue((str + offset), bytesToSend);
-    pCharacteristic->notify();
+    TRACE_INSTANT("fragment", bytesToSend);
+    notify(opcode, str + offset, bytesToSend);
     delay(10);
     remainingLength -= bytesToSend;
     offset += bytesToSend;
   }
 }
 
+/**
+* @brief Send one notification in reply to opcode. With BLE_PROV_COMPACT it goes out on TX behind the
+* opcode and is cut at BLE_FRAGMENT_SIZE, so longer data goes through splitWrite().
+*/
+void BLEProvClass::notify(ProvOpcode opcode, const uint8_t* data, size_t length) {
+#if BLE_PROV_COMPACT
+  uint8_t frame[BLE_FRAGMENT_SIZE];
+  frame[0] = static_cast<uint8_t>(opcode);
+  length = min(length, sizeof(frame) - 1);
+  memcpy(frame + 1, data, length);
+  m_provTx->setValue(frame, length + 1);
+  m_provTx->notify();
+#else
+  NimBLECharacteristic* pCharacteristic = notifyCharacteristic(opcode);
+  if (!pCharacteristic) return;
+  pCharacteristic->setValue(data, length);
+  pCharacteristic->notify();
+#endif
+}
+
+void BLEProvClass::notify(ProvOpcode opcode, const std::string& data) {
+  notify(opcode, reinterpret_cast<const uint8_t*>(data.data()), data.length());
+}
+
+#if !BLE_PROV_COMPACT
+/**
+* @brief The characteristic that carries the responses to opcode in the classic layout.
+*/
+NimBLECharacteristic* BLEProvClass::notifyCharacteristic(ProvOpcode opcode) {
+  switch (opcode) {
+    case ProvOpcode::WiFiConfig:       return m_provWiFiConfigNotify;
+    case ProvOpcode::KeyExchange:      return m_provKeyExchangeNotify;
+    case ProvOpcode::CloudCredentials: return m_provCloudCredentialConfigNotify;
+    case ProvOpcode::WiFiList:         return m_provWiFiListNotify;
+    case ProvOpcode::ProvInfo:         return m_provInfoNotify;
+#if TRACE_EVENT_COUNT > 0
+    case ProvOpcode::Trace:            return m_provTraceNotify;
+#endif
+    default:                           return nullptr;
+  }
+}
+#endif
+
 /**
 * @brief Called when mobile wants a information about this device.
 */
-void BLEProvClass::handleProvInfo(NimBLECharacteristic* pCharacteristic) {
+void BLEProvClass::handleProvInfo() {
+  TRACE_SCOPE("provInfo");
   DEBUG_PROV(PSTR("[BLEProvClass.handleProvInfo()]: Start!\r\n"));  
 
   std::string jsonString;
-  JsonDocument doc;
+  JsonDocument doc(JsonArena::instance());
   doc[F("retailItemId")] = m_retailItemId;
   doc[F("version")] = BLE_PROV_VERSION;
+#if BLE_PROV_COMPACT
+  doc[F("layout")] = F("compact");  // the app found RX/TX already, this confirms the opcode framing
+#endif
        
-  serializeJsonPretty(doc, jsonString);
+  serializeJson(doc, jsonString);
 
   DEBUG_PROV(PSTR("[BLEProvClass.handleProvInfo()]: Write: %s\r\n"), jsonString.c_str());  
   
-  splitWrite(m_provInfoNotify, jsonString); 
+  splitWrite(ProvOpcode::ProvInfo, jsonString); 
 
   DEBUG_PROV(PSTR("[BLEProvClass.handleProvInfo()]: End!\r\n"));    
 }
 
+#if TRACE_EVENT_COUNT > 0
+/**
+* @brief Called when mobile asks for the trace events. Writing "clear" drops them after sending.
+*/
+void BLEProvClass::handleTrace(const std::string& command) {
+  std::string dump;
+  ProvTrace::dump(dump, command == "clear");
+  splitWrite(ProvOpcode::Trace, dump);
+}
+#endif
+
 void BLEProvClass::onWrite(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc) {
-  DEBUG_PROV(PSTR("[BLEProvClass.onWrite()]: UUID: %s, Got: %s\r\n"), pCharacteristic->getUUID().toString().c_str(), pCharacteristic->getValue().c_str());
-  if (pCharacteristic == m_provKeyExchange && m_provKeyExchange->getDataLength()) { 
-     handleKeyExchange(m_provKeyExchange->getValue(), pCharacteristic); 
-  }        
-  else if (pCharacteristic == m_provWiFiConfig && m_provWiFiConfig->getDataLength()) { 
-    handleWiFiConfig(m_provWiFiConfig->getValue(), pCharacteristic);
+  TRACE_SCOPE("onWrite", pCharacteristic->getDataLength());
+  DEBUG_PROV(PSTR("[BLEProvClass.onWrite()]: UUID: %s, Got: %u bytes\r\n"), pCharacteristic->getUUID().toString().c_str(), pCharacteristic->getValue().length());
+#if BLE_PROV_COMPACT
+  std::string value = pCharacteristic->getValue();
+  if (pCharacteristic != m_provRx || value.empty()) {
+    DEBUG_PROV_ERROR(PSTR("[BLEProvClass.onWrite()]: Opcode missing!\r\n"));
+    return;
   }
-  else if (pCharacteristic == m_provCloudCredentialConfig && m_provCloudCredentialConfig->getDataLength()) { 
-    handleCloudCredentialsConfig(m_provCloudCredentialConfig->getValue(), pCharacteristic);
+  ProvOpcode opcode = static_cast<ProvOpcode>(value[0]);
+  value.erase(0, 1);
+  dispatch(opcode, std::move(value));
+#else
+  ProvOpcode opcode;
+  if (pCharacteristic == m_provKeyExchange) opcode = ProvOpcode::KeyExchange;
+  else if (pCharacteristic == m_provWiFiConfig) opcode = ProvOpcode::WiFiConfig;
+  else if (pCharacteristic == m_provCloudCredentialConfig) opcode = ProvOpcode::CloudCredentials;
+  else if (pCharacteristic == m_provWiFiList) opcode = ProvOpcode::WiFiList;
+  else if (pCharacteristic == m_provInfo) opcode = ProvOpcode::ProvInfo;
+#if TRACE_EVENT_COUNT > 0
+  else if (pCharacteristic == m_provTrace) opcode = ProvOpcode::Trace;
+#endif
+  else {
+    DEBUG_PROV_ERROR(PSTR("[BLEProvClass.onWrite()]: Characteristic not found!"));
+    return;
   }
-  else if (pCharacteristic == m_provWiFiList) { 
-    handleWiFiList(pCharacteristic);
+  dispatch(opcode, pCharacteristic->getValue());
+#endif
+}
+
+/**
+* @brief Run the command for opcode. Both layouts end up here.
+*/
+void BLEProvClass::dispatch(ProvOpcode opcode, std::string value) {
+  switch (opcode) {
+    case ProvOpcode::KeyExchange:
+      if (!value.empty()) handleKeyExchange(value);
+      break;
+    case ProvOpcode::WiFiConfig:
+      if (!value.empty()) handleWiFiConfig(std::move(value));
+      break;
+    case ProvOpcode::CloudCredentials:
+      if (!value.empty()) handleCloudCredentialsConfig(value);
+      break;
+    case ProvOpcode::WiFiList:
+      handleWiFiList();
+      break;
+    case ProvOpcode::ProvInfo:
+      handleProvInfo();
+      break;
+#if TRACE_EVENT_COUNT > 0
+    case ProvOpcode::Trace:
+      handleTrace(value);
+      break;
+#endif
+    default:
+      DEBUG_PROV_ERROR(PSTR("[BLEProvClass.dispatch()]: Unknown opcode 0x%02x!\r\n"), static_cast<unsigned>(opcode));
   }
-  else if (pCharacteristic == m_provInfo) { 
-    handleProvInfo(pCharacteristic);
-  } else {
-    DEBUG_PROV(PSTR("[BLEProvClass.onWrite()]: Characteristic not found!"));
-  }     
 }
 
 /**
@@ -390,6 +540,7 @@ void BLEProvClass::onWrite(NimBLECharacteristic* pCharacteristic, ble_gap_conn_d
 */
 void BLEProvClass::onConnect(NimBLEServer* pServer) {
   DEBUG_PROV(PSTR("[BLEProvClass.onConnect()]: Client connected\r\n"));
+  BREADCRUMB("bleConn", 0);
 }
 
 /**
@@ -404,6 +555,7 @@ void BLEProvClass::onConnect(BLEServer* pServer, ble_gap_conn_desc* desc) {
 */
 void BLEProvClass::onDisconnect(NimBLEServer* pServer) {
   DEBUG_PROV(PSTR("[BLEProvClass.onDisconnect()]: Client disconnected\r\n"));
+  BREADCRUMB("bleDisc", 0);
 
   if (m_begin) { 
     DEBUG_PROV(PSTR("[BLEProvClass.onDisconnect()]: Start advertising\r\n"));
@@ -433,6 +585,7 @@ void BLEProvClass::stop() {
 * @brief Deinit BLE ..
 */
 void BLEProvClass::deinit() {
+  BREADCRUMB("bleDeini", ESP.getFreeHeap());
   NimBLEDevice::deinit();
 }
 
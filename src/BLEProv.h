@@ -18,11 +18,29 @@
 #include "ProvDebug.h"
 #include "CryptoMbedTLS.h" 
 #include "ProvUtil.h"
+#include "Breadcrumbs.h"
+#include "ProvTrace.h"
+#include "JsonArena.h"
+
+/**
+ * @brief What a message is about. With BLE_PROV_COMPACT every write to the RX characteristic and
+ * every notification on TX starts with one, followed by what the classic characteristic would carry.
+ * The values are the last byte of the classic characteristic UUIDs.
+ */
+enum class ProvOpcode : uint8_t {
+  WiFiConfig       = 0x01,
+  KeyExchange      = 0x02,
+  CloudCredentials = 0x03,
+  WiFiList         = 0x05,
+  ProvInfo         = 0x07,
+  Trace            = 0x11,  // only with TRACE_EVENT_COUNT > 0
+};
 
 class BLEProvClass : protected NimBLECharacteristicCallbacks, NimBLEServerCallbacks {
   public:
-    using WiFiCredentialsCallbackHandler = std::function<bool(const String)>;
-    using CloudCredentialsCallbackHandler = std::function<bool(const String)>;    
+    // The decrypted JSON, NUL terminated and only valid during the call.
+    using WiFiCredentialsCallbackHandler = std::function<bool(const char* config, size_t length)>;
+    using CloudCredentialsCallbackHandler = std::function<bool(const char* config, size_t length)>;
     using BleProvDoneCallbackHandler = std::function<void(void)>;
     
     BLEProvClass();
@@ -40,14 +58,25 @@ class BLEProvClass : protected NimBLECharacteristicCallbacks, NimBLEServerCallba
     void setProductId(const std::string &productId);
 
   private:
-    void splitWrite(NimBLECharacteristic * pCharacteristic, const std::string& jsonString);
+    void splitWrite(ProvOpcode opcode, const std::string& jsonString);
+    void notify(ProvOpcode opcode, const uint8_t* data, size_t length);
+    void notify(ProvOpcode opcode, const std::string& data);
+#if !BLE_PROV_COMPACT
+    NimBLECharacteristic* notifyCharacteristic(ProvOpcode opcode);
+#endif
+    bool decryptInPlace(std::string& data);
+    static void wipe(std::string& data);
 
   protected:
-    void handleKeyExchange(const std::string& public_key_pem, NimBLECharacteristic* pCharacteristic);
-    void handleWiFiConfig(const std::string& wificonfig, NimBLECharacteristic* pCharacteristic);
-    void handleCloudCredentialsConfig(const std::string& authconfig, NimBLECharacteristic* pCharacteristic);
-    void handleWiFiList(NimBLECharacteristic* pCharacteristic);
-    void handleProvInfo(NimBLECharacteristic* pCharacteristic);
+    void dispatch(ProvOpcode opcode, std::string value);
+    void handleKeyExchange(const std::string& public_key_pem);
+    void handleWiFiConfig(std::string wificonfig);
+    void handleCloudCredentialsConfig(const std::string& authconfig);
+    void handleWiFiList();
+    void handleProvInfo();
+#if TRACE_EVENT_COUNT > 0
+    void handleTrace(const std::string& command);
+#endif
 
     virtual void onWrite(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc) override;
     virtual void onConnect(NimBLEServer* pServer) override;
@@ -66,6 +95,10 @@ class BLEProvClass : protected NimBLECharacteristicCallbacks, NimBLEServerCallba
     NimBLEService *m_pService;
     NimBLEAdvertising *m_pAdvertising;
 
+#if BLE_PROV_COMPACT
+    NimBLECharacteristic *m_provRx;
+    NimBLECharacteristic *m_provTx;
+#else
     NimBLECharacteristic *m_provWiFiConfig; 
     NimBLECharacteristic *m_provWiFiConfigNotify; 
     NimBLECharacteristic *m_provKeyExchange;
@@ -76,26 +109,36 @@ class BLEProvClass : protected NimBLECharacteristicCallbacks, NimBLEServerCallba
     NimBLECharacteristic *m_provWiFiListNotify;  
     NimBLECharacteristic *m_provInfo;  
     NimBLECharacteristic *m_provInfoNotify;  
+#if TRACE_EVENT_COUNT > 0
+    NimBLECharacteristic *m_provTrace;
+    NimBLECharacteristic *m_provTraceNotify;
+#endif
+#endif
     
     CryptoMbedTLS m_crypto; 
     int m_expectedAuthConfigPayloadSize = -1;
     std::string m_receivedCloudCredentialsConfig;
     volatile bool m_provConfigDone = false;
 
-    const std::string BLE_SERVICE_UUID                          = "0000ffff-0000-1000-8000-00805f9b34fb";
+    static constexpr const char* BLE_SERVICE_UUID                        = "0000ffff-0000-1000-8000-00805f9b34fb";
 
-    const std::string BLE_WIFI_CONFIG_UUID                      = "00000001-0000-1000-8000-00805f9b34fb"; 
-    const std::string BLE_KEY_EXCHANGE_UUID                     = "00000002-0000-1000-8000-00805f9b34fb"; 
-    const std::string BLE_CLOUD_CREDENTIAL_CONFIG_UUID          = "00000003-0000-1000-8000-00805f9b34fb"; 
-    const std::string BLE_WIFI_CONFIG_NOTIFY_UUID               = "00000004-0000-1000-8000-00805f9b34fb"; 
-    const std::string BLE_WIFI_LIST_UUID                        = "00000005-0000-1000-8000-00805f9b34fb";    
-    const std::string BLE_WIFI_LIST_NOTIFY_UUID                 = "00000006-0000-1000-8000-00805f9b34fb";    
-    const std::string BLE_PROV_INFO_UUID                        = "00000007-0000-1000-8000-00805f9b34fb";    
-    const std::string BLE_INFO_NOTIFY_UUID                      = "00000008-0000-1000-8000-00805f9b34fb";    
-    const std::string BLE_CLOUD_CREDENTIAL_CONFIG_NOTIFY_UUID   = "00000009-0000-1000-8000-00805f9b34fb";
-    const std::string BLE_KEY_EXCHANGE_NOTIFY_UUID              = "00000010-0000-1000-8000-00805f9b34fb";
+    static constexpr const char* BLE_WIFI_CONFIG_UUID                    = "00000001-0000-1000-8000-00805f9b34fb"; 
+    static constexpr const char* BLE_KEY_EXCHANGE_UUID                   = "00000002-0000-1000-8000-00805f9b34fb"; 
+    static constexpr const char* BLE_CLOUD_CREDENTIAL_CONFIG_UUID        = "00000003-0000-1000-8000-00805f9b34fb"; 
+    static constexpr const char* BLE_WIFI_CONFIG_NOTIFY_UUID             = "00000004-0000-1000-8000-00805f9b34fb"; 
+    static constexpr const char* BLE_WIFI_LIST_UUID                      = "00000005-0000-1000-8000-00805f9b34fb";    
+    static constexpr const char* BLE_WIFI_LIST_NOTIFY_UUID               = "00000006-0000-1000-8000-00805f9b34fb";    
+    static constexpr const char* BLE_PROV_INFO_UUID                      = "00000007-0000-1000-8000-00805f9b34fb";    
+    static constexpr const char* BLE_INFO_NOTIFY_UUID                    = "00000008-0000-1000-8000-00805f9b34fb";    
+    static constexpr const char* BLE_CLOUD_CREDENTIAL_CONFIG_NOTIFY_UUID = "00000009-0000-1000-8000-00805f9b34fb";
+    static constexpr const char* BLE_KEY_EXCHANGE_NOTIFY_UUID            = "00000010-0000-1000-8000-00805f9b34fb";
+    static constexpr const char* BLE_TRACE_UUID                          = "00000011-0000-1000-8000-00805f9b34fb";  // only with TRACE_EVENT_COUNT > 0
+    static constexpr const char* BLE_TRACE_NOTIFY_UUID                   = "00000012-0000-1000-8000-00805f9b34fb";
+    static constexpr const char* BLE_RX_UUID                             = "00000013-0000-1000-8000-00805f9b34fb";  // only with BLE_PROV_COMPACT
+    static constexpr const char* BLE_TX_UUID                             = "00000014-0000-1000-8000-00805f9b34fb";
 
     NimBLEUUID m_uuidService;   
+#if !BLE_PROV_COMPACT
     NimBLEUUID m_uuidWiFiConfig; 
     NimBLEUUID m_uuidWiFiConfigNotify;
     NimBLEUUID m_uuidKeyExchange;
@@ -106,5 +149,6 @@ class BLEProvClass : protected NimBLECharacteristicCallbacks, NimBLEServerCallba
     NimBLEUUID m_uuidWiFiListNotify;
     NimBLEUUID m_uuidProvInfo;
     NimBLEUUID m_uuidProvInfoNotify;
+#endif
 };
  
\ No newline at end of file
@@ -0,0 +1,80 @@
+/*
+ *  Copyright (c) 2019 - 2024 Sinric. All rights reserved.
+ *  Licensed under Creative Commons Attribution-Share Alike (CC BY-SA)
+ *
+ *  This file is part of the Sinric Pro ESP32 Business SDK (https://github.com/sinricpro/esp32-business-sdk)
+ */
+
+#include "Breadcrumbs.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define BREADCRUMB_MAGIC  0x42524431  // "BRD1"
+
+struct BreadcrumbRing_t {
+  uint32_t magic;
+  uint32_t head;      // total number of breadcrumbs added
+  uint32_t check;     // magic ^ head, catches a ring that is only partly valid
+  Breadcrumb_t entries[BREADCRUMB_COUNT];
+};
+
+RTC_NOINIT_ATTR static BreadcrumbRing_t s_ring;
+static Breadcrumb_t s_previous[BREADCRUMB_COUNT];
+static uint8_t s_previousCount = 0;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void onShutdown() {
+  Breadcrumbs::add("restart");
+}
+
+void Breadcrumbs::begin() {
+  if (s_ring.magic == BREADCRUMB_MAGIC && s_ring.check == (BREADCRUMB_MAGIC ^ s_ring.head)) {
+    uint32_t count = s_ring.head < BREADCRUMB_COUNT ? s_ring.head : BREADCRUMB_COUNT;
+    for (uint32_t i = 0; i < count; i++) {
+      s_previous[i] = s_ring.entries[(s_ring.head - count + i) % BREADCRUMB_COUNT];
+    }
+    s_previousCount = count;
+  }
+
+  s_ring.head = 0;
+  s_ring.check = BREADCRUMB_MAGIC;
+  s_ring.magic = BREADCRUMB_MAGIC;
+
+  esp_register_shutdown_handler(onShutdown);
+}
+
+void Breadcrumbs::add(const char* tag, int32_t arg) {
+  Breadcrumb_t crumb;
+  crumb.time = (uint32_t)(esp_timer_get_time() / 1000);
+  crumb.arg = arg;
+  strncpy(crumb.tag, tag, sizeof(crumb.tag));
+  const char* task = pcTaskGetName(NULL);
+  strncpy(crumb.task, task ? task : "", sizeof(crumb.task));
+
+  portENTER_CRITICAL_SAFE(&s_lock);
+  s_ring.entries[s_ring.head % BREADCRUMB_COUNT] = crumb;
+  s_ring.head++;
+  s_ring.check = BREADCRUMB_MAGIC ^ s_ring.head;
+  portEXIT_CRITICAL_SAFE(&s_lock);
+}
+
+uint8_t Breadcrumbs::previousCount() {
+  return s_previousCount;
+}
+
+const Breadcrumb_t& Breadcrumbs::previous(uint8_t index) {
+  return s_previous[index < s_previousCount ? index : 0];
+}
+
+// Called from the task watchdog interrupt, before a panic when CONFIG_ESP_TASK_WDT_PANIC is set.
+extern "C" void esp_task_wdt_isr_user_handler(void) {
+  Breadcrumbs::add("twdt");
+}
+
+// Moves the previous trail out of the way before any SDK or sketch code records.
+static struct BreadcrumbsInit {
+  BreadcrumbsInit() { Breadcrumbs::begin(); }
+} s_breadcrumbsInit;
@@ -0,0 +1,42 @@
+/*
+ *  Copyright (c) 2019 - 2024 Sinric. All rights reserved.
+ *  Licensed under Creative Commons Attribution-Share Alike (CC BY-SA)
+ *
+ *  This file is part of the Sinric Pro ESP32 Business SDK (https://github.com/sinricpro/esp32-business-sdk)
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include "ProvSettings.h"
+
+/**
+ * @brief One breadcrumb. 20 bytes.
+ */
+struct Breadcrumb_t {
+  uint32_t time;  // ms since boot
+  int32_t arg;    // tag specific value
+  char tag[8];    // not terminated when 8 characters long
+  char task[4];   // first characters of the task name
+};
+
+/**
+ * @brief Ring of tagged events in RTC memory that survives panics, watchdog and software resets.
+ *
+ * Recording takes a spinlock and copies 20 bytes, so it is cheap enough for hot paths and
+ * ISRs (not IRAM-only ones). The trail of the previous boot is moved to RAM before setup()
+ * runs and is available through previousCount()/previous(). It is lost on power-on.
+ *
+ *     BREADCRUMB("keyx", ESP.getFreeHeap());
+ */
+class Breadcrumbs {
+  public:
+    static void add(const char* tag, int32_t arg = 0);
+
+    static uint8_t previousCount();
+    static const Breadcrumb_t& previous(uint8_t index);  // oldest first
+
+    static void begin();  // runs from a static constructor
+};
+
+#define BREADCRUMB(tag, arg) Breadcrumbs::add(tag, arg)
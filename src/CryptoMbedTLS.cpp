@@ -7,24 +7,26 @@
 #include "CryptoMbedTLS.h"
 
 /**
- * @brief Decode a base64 string
+ * @brief Decode base64 in place, without a second buffer
  * @param data
- *      Data to encode
+ *      Base64 text. Receives the decoded bytes at the start
+ * @param length
+ *      Length of the text
+ * @param decodedLength
+ *      Receives the number of decoded bytes
  * @return
- *      Encoded data
+ *      False if data is not valid base64
  */
-std::vector<uint8_t> CryptoMbedTLS::base64Decode(const std::string &data)
+bool CryptoMbedTLS::base64DecodeInPlace(uint8_t* data, size_t length, size_t& decodedLength)
 {
-    // Calculate max decode length
-    size_t requiredSize;
-
-    mbedtls_base64_encode(nullptr, 0, &requiredSize, (unsigned char *)data.c_str(), data.size());
-
-    std::vector<uint8_t> output(requiredSize);
-    size_t outputLen = 0;
-    mbedtls_base64_decode(output.data(), requiredSize, &outputLen, (unsigned char *)data.c_str(), data.size());
-
-    return std::vector<uint8_t>(output.begin(), output.begin() + outputLen);
+    // mbedtls checks the whole input first, then decodes front to back and writes 3 bytes
+    // for every 4 characters read, so the output never overtakes the input.
+    decodedLength = 0;
+    if (mbedtls_base64_decode(data, length, &decodedLength, data, length) != 0) {
+        DEBUG_PROV_ERROR(PSTR("[CryptoMbedTLS.base64DecodeInPlace()]: Invalid base64.\r\n"));
+        return false;
+    }
+    return true;
 }
 
 /**
@@ -52,11 +54,12 @@ std::string CryptoMbedTLS::base64Encode(const std::vector<uint8_t> &data)
  * @brief Base function for AES CTR encryption/decryption
  * @param key Secret key
  * @param iv Initial vector
- * @param data Data to encrypt/decrypt
+ * @param data Data to encrypt/decrypt in place
+ * @param length Length of data
  * @param isEncrypt True for encryption, false for decryption
  * @return Boolean indicating success or failure
  */
-bool CryptoMbedTLS::aesCTRXcryptBase(const std::vector<uint8_t> &key, std::vector<uint8_t> &iv, std::vector<uint8_t> &data, bool isEncrypt) 
+bool CryptoMbedTLS::aesCTRXcryptBase(const std::vector<uint8_t> &key, std::vector<uint8_t> &iv, uint8_t* data, size_t length, bool isEncrypt) 
 {
     if (!isAesInitialized()) return false;
 
@@ -68,7 +71,7 @@ bool CryptoMbedTLS::aesCTRXcryptBase(const std::vector<uint8_t> &key, std::vecto
         return false;
     }
 
-    bool success = performCryption(ctx, iv, data, isEncrypt);
+    bool success = performCryption(ctx, iv, data, length, isEncrypt);
 
     mbedtls_aes_free(&ctx);
     return success;
@@ -79,7 +82,7 @@ bool CryptoMbedTLS::aesCTRXcryptBase(const std::vector<uint8_t> &key, std::vecto
  */
 bool CryptoMbedTLS::aesCTRXcrypt(const std::vector<uint8_t> &key, std::vector<uint8_t> &iv, std::vector<uint8_t> &data) 
 {
-    return aesCTRXcryptBase(key, iv, data, true);
+    return aesCTRXcryptBase(key, iv, data.data(), data.size(), true);
 }
 
 /**
@@ -87,7 +90,15 @@ bool CryptoMbedTLS::aesCTRXcrypt(const std::vector<uint8_t> &key, std::vector<ui
  */
 bool CryptoMbedTLS::aesCTRXdecrypt(const std::vector<uint8_t> &key, std::vector<uint8_t> &iv, std::vector<uint8_t> &data)
 {
-    return aesCTRXcryptBase(key, iv, data, false);
+    return aesCTRXcryptBase(key, iv, data.data(), data.size(), false);
+}
+
+/**
+ * @brief Decrypt an AES CTR encrypted buffer in place
+ */
+bool CryptoMbedTLS::aesCTRXdecrypt(const std::vector<uint8_t> &key, std::vector<uint8_t> &iv, uint8_t* data, size_t length)
+{
+    return aesCTRXcryptBase(key, iv, data, length, false);
 }
 
 bool CryptoMbedTLS::isAesInitialized()
@@ -105,14 +116,15 @@ bool CryptoMbedTLS::setupAesContext(mbedtls_aes_context &ctx, const std::vector<
                        : mbedtls_aes_setkey_dec(&ctx, key.data(), key.size() * 8);
     
     if (rc != 0) {
-        DEBUG_PROV(PSTR("[CryptoMbedTLS.setupAesContext()]: mbedtls_aes_setkey_%s failed.\r\n"), isEncrypt ? "enc" : "dec");
+        DEBUG_PROV_ERROR(PSTR("[CryptoMbedTLS.setupAesContext()]: mbedtls_aes_setkey_%s failed.\r\n"), isEncrypt ? "enc" : "dec");
         return false;
     }
     return true;
 }
 
-bool CryptoMbedTLS::performCryption(mbedtls_aes_context &ctx, std::vector<uint8_t> &iv, std::vector<uint8_t> &data, bool isEncrypt)
+bool CryptoMbedTLS::performCryption(mbedtls_aes_context &ctx, std::vector<uint8_t> &iv, uint8_t* data, size_t length, bool isEncrypt)
 {
+    TRACE_SCOPE(isEncrypt ? "aesEncrypt" : "aesDecrypt", length);
     size_t off = 0;
     unsigned char streamBlock[16] = {0};
     char copyOfIv[16];
@@ -120,12 +132,12 @@ bool CryptoMbedTLS::performCryption(mbedtls_aes_context &ctx, std::vector<uint8_
 
     DEBUG_PROV(PSTR("[CryptoMbedTLS.performCryption()]: Perform %s .."), isEncrypt ? "encrypting" : "decrypting");
 
-    int rc = mbedtls_aes_crypt_ctr(&ctx, data.size(), &off,
+    int rc = mbedtls_aes_crypt_ctr(&ctx, length, &off,
                                    reinterpret_cast<unsigned char*>(copyOfIv),
-                                   streamBlock, data.data(), data.data());
+                                   streamBlock, data, data);
 
     if (rc != 0) {
-        DEBUG_PROV(PSTR("[CryptoMbedTLS.performCryption()]: mbedtls_aes_crypt_ctr failed.\r\n"));
+        DEBUG_PROV_ERROR(PSTR("[CryptoMbedTLS.performCryption()]: mbedtls_aes_crypt_ctr failed.\r\n"));
     } else {
         DEBUG_PROV(PSTR("Success!\r\n"));
     }
@@ -137,16 +149,16 @@ bool CryptoMbedTLS::performCryption(mbedtls_aes_context &ctx, std::vector<uint8_
  * @brief initialize MbedTLS
  */
 bool CryptoMbedTLS::initMbedTLS() {
+  TRACE_SCOPE("drbgSeed");
   mbedtls_ctr_drbg_init(&m_ctr_drbg_contex);
   mbedtls_entropy_init(&m_entropy_context);
-  mbedtls_pk_init(&m_pk_context);
 
   // Initialize entropy.
   int res = mbedtls_ctr_drbg_seed(
       &m_ctr_drbg_contex, mbedtls_entropy_func, &m_entropy_context, NULL, 0);
   
   if (res != 0) {
-    DEBUG_PROV(PSTR("[CryptoMbedTLS.initMbedTLS()] mbedtls_ctr_drbg_seed failed.\r\n"));
+    DEBUG_PROV_ERROR(PSTR("[CryptoMbedTLS.initMbedTLS()] mbedtls_ctr_drbg_seed failed.\r\n"));
     return false;
   }
  
@@ -160,26 +172,23 @@ bool CryptoMbedTLS::initMbedTLS() {
 void CryptoMbedTLS::deinitMbedTLS() {
   DEBUG_PROV(PSTR("[CryptoMbedTLS.deinitMbedTLS()] mbedtls deinit.\r\n"));
    
-  mbedtls_pk_free(&m_pk_context);
   mbedtls_entropy_free(&m_entropy_context);
   mbedtls_ctr_drbg_free(&m_ctr_drbg_contex);
 }
 
 /**
- * @brief Generate a shared secret using public key
+ * @brief Generate a shared secret using the app's key
  *
- * @param public_key_pem Public RSA key in PEM format
+ * @param public_key_pem App key for BLE_PROV_KEY_EXCHANGE, a public RSA key in PEM format
  * @param data Reference to shared key
  * @return Boolean indicating success or failure
  */
 bool CryptoMbedTLS::getSharedSecret(const std::string& public_key_pem, std::string& data) {
-    if (!parsePublicKey(public_key_pem)) return false;
-    
     unsigned char session_key[32];
     if (!generateSessionKey(session_key)) return false;
     
     std::vector<uint8_t> encrypted_key;
-    if (!encryptSessionKey(session_key, encrypted_key)) return false;
+    if (!BLE_PROV_KEY_EXCHANGE::wrap(public_key_pem, session_key, sizeof(session_key), &m_ctr_drbg_contex, encrypted_key)) return false;
     
     prepareAesKeyAndIv(session_key);
     encodeSessionKey(encrypted_key, data);
@@ -187,46 +196,61 @@ bool CryptoMbedTLS::getSharedSecret(const std::string& public_key_pem, std::stri
     return true;
 }
 
-bool CryptoMbedTLS::parsePublicKey(const std::string& public_key_pem) {
-    DEBUG_PROV(PSTR("[CryptoMbedTLS.parsePublicKey()]: Loading Public key..."));
-    
-    int rc = mbedtls_pk_parse_public_key(&m_pk_context,
-                                         reinterpret_cast<const unsigned char*>(public_key_pem.c_str()),
-                                         public_key_pem.size() + 1);
-    if (rc != 0) {
-        DEBUG_PROV(PSTR("[CryptoMbedTLS.parsePublicKey()]: mbedtls_pk_parse_public_key failed.\r\n"));
-        return false;
-    }
-    DEBUG_PROV(PSTR("[CryptoMbedTLS.parsePublicKey()]: Public key loaded successfully.\r\n"));
-    return true;
-}
-
 bool CryptoMbedTLS::generateSessionKey(unsigned char* session_key) {
+  TRACE_SCOPE("sessionKey");
   DEBUG_PROV(PSTR("[CryptoMbedTLS.generateSessionKey()]: Generating sessionKey key..."));
 
     int rc = mbedtls_ctr_drbg_random(&m_ctr_drbg_contex, session_key, 32);
     if (rc != 0) {
-        DEBUG_PROV(PSTR("[CryptoMbedTLS.generateSessionKey()]: mbedtls_ctr_drbg_random failed.\r\n"));
+        DEBUG_PROV_ERROR(PSTR("[CryptoMbedTLS.generateSessionKey()]: mbedtls_ctr_drbg_random failed.\r\n"));
         return false;
     }
     DEBUG_PROV(PSTR("[CryptoMbedTLS.generateSessionKey()]: Session key generated successfully.\r\n"));
     return true;
 }
 
-bool CryptoMbedTLS::encryptSessionKey(const unsigned char* session_key, std::vector<uint8_t>& encrypted_key) {
-  DEBUG_PROV(PSTR("[CryptoMbedTLS.encryptSessionKey()]: Encrypting sessionKey key..."));
+/**
+ * @brief Encrypt the session key with the app's RSA public key
+ *
+ * @param appKey Public RSA key in PEM format
+ * @param sessionKey Session key to wrap
+ * @param length Length of the session key
+ * @param drbg Random generator for the padding
+ * @param wrapped Receives the encrypted session key
+ * @return Boolean indicating success or failure
+ */
+bool RsaKeyExchange::wrap(const std::string& appKey, const unsigned char* sessionKey, size_t length,
+                          mbedtls_ctr_drbg_context* drbg, std::vector<uint8_t>& wrapped) {
+    mbedtls_pk_context pk;
+    mbedtls_pk_init(&pk);
+
+    int rc;
+    {
+        TRACE_SCOPE("parseKey", appKey.size());
+        DEBUG_PROV(PSTR("[RsaKeyExchange.wrap()]: Loading Public key..."));
+        rc = mbedtls_pk_parse_public_key(&pk, reinterpret_cast<const unsigned char*>(appKey.c_str()), appKey.size() + 1);
+    }
+    if (rc != 0) {
+        DEBUG_PROV_ERROR(PSTR("[RsaKeyExchange.wrap()]: mbedtls_pk_parse_public_key failed.\r\n"));
+        mbedtls_pk_free(&pk);
+        return false;
+    }
+
+    {
+        TRACE_SCOPE("rsaEncrypt");
+        DEBUG_PROV(PSTR("[RsaKeyExchange.wrap()]: Encrypting sessionKey key..."));
+        wrapped.resize(512);
+        size_t olen = 0;
+        rc = mbedtls_pk_encrypt(&pk, sessionKey, length, wrapped.data(), &olen, wrapped.size(), mbedtls_ctr_drbg_random, drbg);
+        wrapped.resize(rc == 0 ? olen : 0);
+    }
+    mbedtls_pk_free(&pk);
 
-    encrypted_key.resize(512);
-    size_t olen = 0;
-    int rc = mbedtls_pk_encrypt(&m_pk_context, session_key, 32,
-                                encrypted_key.data(), &olen, encrypted_key.size(),
-                                mbedtls_ctr_drbg_random, &m_ctr_drbg_contex);
     if (rc != 0) {
-        DEBUG_PROV(PSTR("[CryptoMbedTLS.encryptSessionKey()]: mbedtls_pk_encrypt failed.\r\n"));
+        DEBUG_PROV_ERROR(PSTR("[RsaKeyExchange.wrap()]: mbedtls_pk_encrypt failed.\r\n"));
         return false;
     }
-    encrypted_key.resize(olen);
-    DEBUG_PROV(PSTR("[CryptoMbedTLS.encryptSessionKey()]: Session key encrypted successfully.\r\n"));
+    DEBUG_PROV(PSTR("[RsaKeyExchange.wrap()]: Session key encrypted successfully.\r\n"));
     return true;
 }
 
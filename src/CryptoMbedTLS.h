@@ -24,9 +24,27 @@
 #include <mbedtls/ctr_drbg.h>
 #include <mbedtls/pk.h>
 
+#include "ProvSettings.h"
 #include "ProvDebug.h"
+#include "ProvTrace.h"
 
 #define MAX_RSA_BUF_SIZE 1024
+
+/**
+ * Key exchange policies wrap the AES session key so only the app can read it. BLE_PROV_KEY_EXCHANGE
+ * (ProvSettings.h) picks one at compile time and only that one is linked. A policy provides
+ *
+ *     static bool wrap(const std::string& appKey, const unsigned char* sessionKey, size_t length,
+ *                      mbedtls_ctr_drbg_context* drbg, std::vector<uint8_t>& wrapped);
+ */
+
+/**
+ * @brief The app sends an RSA public key in PEM, the session key goes back PKCS#1 v1.5 encrypted.
+ */
+struct RsaKeyExchange {
+    static bool wrap(const std::string& appKey, const unsigned char* sessionKey, size_t length,
+                     mbedtls_ctr_drbg_context* drbg, std::vector<uint8_t>& wrapped);
+};
  
 class CryptoMbedTLS {
 private:
@@ -34,18 +52,15 @@ private:
     
     mbedtls_ctr_drbg_context m_ctr_drbg_contex;
     mbedtls_entropy_context m_entropy_context;
-    mbedtls_pk_context m_pk_context;
 
-    bool parsePublicKey(const std::string& public_key_pem);
     bool generateSessionKey(unsigned char* session_key);
-    bool encryptSessionKey(const unsigned char* session_key, std::vector<uint8_t>& encrypted_key);
     void prepareAesKeyAndIv(const unsigned char* session_key);
     void encodeSessionKey(const std::vector<uint8_t>& encrypted_key, std::string& data);
 
-    bool performCryption(mbedtls_aes_context &ctx, std::vector<uint8_t> &iv, std::vector<uint8_t> &data, bool isEncrypt);
+    bool performCryption(mbedtls_aes_context &ctx, std::vector<uint8_t> &iv, uint8_t* data, size_t length, bool isEncrypt);
     bool setupAesContext(mbedtls_aes_context &ctx, const std::vector<uint8_t> &key, bool isEncrypt);
     bool isAesInitialized();
-    bool aesCTRXcryptBase(const std::vector<uint8_t> &key, std::vector<uint8_t> &iv, std::vector<uint8_t> &data, bool isEncrypt);
+    bool aesCTRXcryptBase(const std::vector<uint8_t> &key, std::vector<uint8_t> &iv, uint8_t* data, size_t length, bool isEncrypt);
 public:
     CryptoMbedTLS();
     ~CryptoMbedTLS();
@@ -54,14 +69,15 @@ public:
     std::vector<uint8_t> iv = {};
         
     // Base64
-    std::vector<uint8_t> base64Decode(const std::string& data);
+    bool base64DecodeInPlace(uint8_t* data, size_t length, size_t& decodedLength);
     std::string base64Encode(const std::vector<uint8_t>& data);
  
     // AES CTR
     bool aesCTRXcrypt(const std::vector<uint8_t>& key, std::vector<uint8_t>& iv, std::vector<uint8_t>& data);
     bool aesCTRXdecrypt(const std::vector<uint8_t> &key, std::vector<uint8_t> &iv, std::vector<uint8_t> &data);
+    bool aesCTRXdecrypt(const std::vector<uint8_t> &key, std::vector<uint8_t> &iv, uint8_t* data, size_t length);
 
-    // RSA
+    // Key exchange (BLE_PROV_KEY_EXCHANGE)
     bool initMbedTLS();
     bool getSharedSecret(const std::string& public_key_pem, std::string& data);
     void deinitMbedTLS();
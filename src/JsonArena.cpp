@@ -0,0 +1,161 @@
+/*
+ *  Copyright (c) 2019 - 2024 Sinric. All rights reserved.
+ *  Licensed under Creative Commons Attribution-Share Alike (CC BY-SA)
+ *
+ *  This file is part of the Sinric Pro ESP32 Business SDK (https://github.com/sinricpro/esp32-business-sdk)
+ */
+
+#include "JsonArena.h"
+#include "esp_heap_caps.h"
+
+static inline uint32_t alignSize(size_t size) {
+  return (size + 7) & ~(size_t)7;  // doubles in the variant pool need 8-byte alignment
+}
+
+JsonArena* JsonArena::instance() {
+  static JsonArena arena(JSON_ARENA_SIZE, JSON_ARENA_PSRAM_SIZE);
+  return &arena;
+}
+
+JsonArena::JsonArena(size_t size, size_t psramSize)
+: m_taken(false), m_internalSize(size), m_psramSize(psramSize), m_buffer(nullptr), m_size(0), m_offset(0),
+  m_newest(NO_BLOCK), m_live(0), m_stats(), m_lock(portMUX_INITIALIZER_UNLOCKED) {
+#ifdef BOARD_HAS_PSRAM
+  if (!psramSize) begin();  // else wait for PSRAM, added to the heap after the static constructors
+#else
+  begin();
+#endif
+}
+
+void JsonArena::begin() {
+  if (m_taken) return;
+
+  uint8_t* buffer = nullptr;
+  uint32_t size = 0;
+  bool psram = false;
+  if (m_psramSize) {
+    buffer = (uint8_t*)heap_caps_aligned_alloc(8, m_psramSize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (buffer) {
+      size = m_psramSize;
+      psram = true;
+    }
+  }
+  if (!buffer && m_internalSize) {
+    buffer = (uint8_t*)heap_caps_aligned_alloc(8, m_internalSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (buffer) size = m_internalSize;
+  }
+
+  portENTER_CRITICAL(&m_lock);
+  if (!m_taken) {
+    m_buffer = buffer;
+    m_size = size;
+    m_stats.size = size;
+    m_stats.psram = psram;
+    m_taken = true;
+    buffer = nullptr;
+  }
+  portEXIT_CRITICAL(&m_lock);
+  heap_caps_free(buffer);  // another task was first
+}
+
+bool JsonArena::contains(void* ptr) const {
+  return m_buffer && (uint8_t*)ptr >= m_buffer && (uint8_t*)ptr < m_buffer + m_size;
+}
+
+JsonArena::Block_t* JsonArena::blockOf(void* ptr) const {
+  return (Block_t*)((uint8_t*)ptr - sizeof(Block_t));
+}
+
+void* JsonArena::allocate(size_t size) {
+  if (!m_taken) begin();
+  uint32_t needed = sizeof(Block_t) + alignSize(size);
+
+  portENTER_CRITICAL(&m_lock);
+  if (m_buffer && needed <= m_size - m_offset) {
+    Block_t* block = (Block_t*)(m_buffer + m_offset);
+    block->size = alignSize(size);
+    block->previous = m_newest;
+    m_newest = m_offset;
+    m_offset += needed;
+    m_live++;
+    m_stats.allocations++;
+    if (m_offset > m_stats.peak) m_stats.peak = m_offset;
+    portEXIT_CRITICAL(&m_lock);
+    return block + 1;
+  }
+  m_stats.fallbacks++;
+  portEXIT_CRITICAL(&m_lock);
+
+  return malloc(size);
+}
+
+void JsonArena::deallocate(void* ptr) {
+  if (!ptr) return;
+  if (!contains(ptr)) {
+    free(ptr);
+    return;
+  }
+
+  portENTER_CRITICAL(&m_lock);
+  Block_t* block = blockOf(ptr);
+  m_live--;
+  if (m_live == 0) {
+    m_offset = 0;
+    m_newest = NO_BLOCK;
+    m_stats.resets++;
+  } else if ((uint8_t*)block == m_buffer + m_newest) {
+    m_offset = m_newest;  // newest block: give the space back
+    m_newest = block->previous;
+  } else {
+    block->size |= 0x80000000;  // freed, reclaimed when the blocks after it are
+  }
+  // Reclaim freed blocks that became the newest.
+  while (m_newest != NO_BLOCK && (((Block_t*)(m_buffer + m_newest))->size & 0x80000000)) {
+    m_offset = m_newest;
+    m_newest = ((Block_t*)(m_buffer + m_newest))->previous;
+  }
+  portEXIT_CRITICAL(&m_lock);
+}
+
+void* JsonArena::reallocate(void* ptr, size_t newSize) {
+  if (!ptr) return allocate(newSize);
+  if (!contains(ptr)) return realloc(ptr, newSize);
+
+  portENTER_CRITICAL(&m_lock);
+  Block_t* block = blockOf(ptr);
+  uint32_t oldSize = block->size;
+  uint32_t offset = (uint8_t*)block - m_buffer;
+
+  if (offset == m_newest && sizeof(Block_t) + alignSize(newSize) <= m_size - offset) {
+    // Newest block: grow or shrink in place.
+    block->size = alignSize(newSize);
+    m_offset = offset + sizeof(Block_t) + block->size;
+    if (m_offset > m_stats.peak) m_stats.peak = m_offset;
+    portEXIT_CRITICAL(&m_lock);
+    return ptr;
+  }
+  if (newSize <= oldSize) {
+    portEXIT_CRITICAL(&m_lock);
+    return ptr;
+  }
+  portEXIT_CRITICAL(&m_lock);
+
+  void* moved = allocate(newSize);
+  if (!moved) return nullptr;
+  memcpy(moved, ptr, oldSize);
+  deallocate(ptr);
+  return moved;
+}
+
+JsonArenaStats_t JsonArena::stats() {
+  portENTER_CRITICAL(&m_lock);
+  JsonArenaStats_t stats = m_stats;
+  stats.used = m_offset;
+  portEXIT_CRITICAL(&m_lock);
+  return stats;
+}
+
+// Takes the arena from the heap before anything can fragment it, unless it waits for PSRAM.
+static struct JsonArenaInit {
+  JsonArenaInit() { JsonArena::instance(); }
+} s_jsonArenaInit;
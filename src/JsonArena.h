@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2019 - 2024 Sinric. All rights reserved.
+ *  Licensed under Creative Commons Attribution-Share Alike (CC BY-SA)
+ *
+ *  This file is part of the Sinric Pro ESP32 Business SDK (https://github.com/sinricpro/esp32-business-sdk)
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <atomic>
+#include "ProvSettings.h"
+
+/**
+ * @brief Arena allocator counters.
+ */
+struct JsonArenaStats_t {
+  uint32_t size;         // arena bytes, 0 when no arena could be allocated
+  uint32_t used;         // bytes in use now
+  uint32_t peak;         // most bytes in use at once
+  uint32_t allocations;  // blocks served from the arena
+  uint32_t fallbacks;    // blocks that did not fit and came from the heap
+  uint32_t resets;       // times the arena emptied
+  bool psram;
+};
+
+/**
+ * @brief ArduinoJson allocator that serves short-lived documents from one preallocated arena.
+ *
+ * Blocks are taken from the arena front to back. Freeing the newest block returns its space,
+ * other blocks stay used until every block is free, then the arena starts over. A block that
+ * does not fit comes from the heap. The arena is allocated once: JSON_ARENA_PSRAM_SIZE bytes of
+ * PSRAM when available, JSON_ARENA_SIZE bytes of internal RAM otherwise. So documents leave no
+ * holes in the internal heap that NimBLE and WiFi need.
+ *
+ * PSRAM joins the heap in initArduino(), after the static constructors. On boards built with
+ * BOARD_HAS_PSRAM the arena is therefore taken by begin(), from setup(), or else by the first
+ * allocate(). Other boards take the internal RAM in the constructor, before anything can
+ * fragment the heap.
+ *
+ * Only for documents that are destroyed soon: one long-lived document keeps the arena from
+ * starting over. A long-lived document that is cleared now and then can have an arena of its
+ * own. Safe to use from several tasks.
+ *
+ *     JsonDocument doc(JsonArena::instance());
+ */
+class JsonArena : public ArduinoJson::Allocator {
+  public:
+    /**
+     * @brief Take the arena from PSRAM if psramSize is set and PSRAM is available, else from internal RAM.
+     *
+     * Without BOARD_HAS_PSRAM, or without psramSize, the arena is taken right away.
+     */
+    JsonArena(size_t size, size_t psramSize = 0);
+
+    /**
+     * @brief Take the arena if not done yet. Call it from setup(), once PSRAM is in the heap.
+     */
+    void begin();
+
+    /**
+     * @brief The arena shared by the short-lived documents (JSON_ARENA_SIZE, JSON_ARENA_PSRAM_SIZE).
+     */
+    static JsonArena* instance();
+
+    void* allocate(size_t size) override;
+    void deallocate(void* ptr) override;
+    void* reallocate(void* ptr, size_t newSize) override;
+
+    JsonArenaStats_t stats();
+
+  private:
+    struct Block_t {
+      uint32_t size;      // usable bytes
+      uint32_t previous;  // offset of the previous newest block, NO_BLOCK if none
+    };
+    static const uint32_t NO_BLOCK = UINT32_MAX;
+
+    bool contains(void* ptr) const;
+    Block_t* blockOf(void* ptr) const;
+
+    std::atomic<bool> m_taken;  // begin() is done, whether it got an arena or not
+    size_t m_internalSize;
+    size_t m_psramSize;
+    uint8_t* m_buffer;
+    uint32_t m_size;
+    uint32_t m_offset;  // first free byte
+    uint32_t m_newest;  // offset of the newest block, NO_BLOCK if none
+    uint32_t m_live;    // blocks not freed
+    JsonArenaStats_t m_stats;
+    portMUX_TYPE m_lock;
+};
@@ -7,13 +7,13 @@
 
 #pragma once
 
-#ifdef CORE_DEBUG_LEVEL
-  #ifdef DEBUG_ESP_PORT
-    #define DEBUG_PROV(...) DEBUG_ESP_PORT.printf( __VA_ARGS__ )
-  #else
-    #include <Arduino.h>
-    #define DEBUG_PROV(...) Serial.printf( __VA_ARGS__ )
-  #endif
-#else
-  #define DEBUG_PROV(x...) if (false) do { (void)0; } while (0)
-#endif  
\ No newline at end of file
+#include "ProvLog.h"
+
+// Messages above PROV_LOG_LEVEL compile to nothing, so release and debug builds only differ by
+// the ring writes of the enabled messages. See ProvLog.h.
+#define PROV_LOG_AT(level, ...)  do { if (PROV_LOG_LEVEL >= (level)) ProvLog::write((level), __VA_ARGS__); } while (0)
+
+#define DEBUG_PROV_ERROR(...)  PROV_LOG_AT(PROV_LOG_ERROR, __VA_ARGS__)
+#define DEBUG_PROV_WARN(...)   PROV_LOG_AT(PROV_LOG_WARN, __VA_ARGS__)
+#define DEBUG_PROV_INFO(...)   PROV_LOG_AT(PROV_LOG_INFO, __VA_ARGS__)
+#define DEBUG_PROV(...)        PROV_LOG_AT(PROV_LOG_DEBUG, __VA_ARGS__)
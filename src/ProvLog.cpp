@@ -0,0 +1,226 @@
+/*
+ *  Copyright (c) 2019 - 2024 Sinric. All rights reserved.
+ *  Licensed under Creative Commons Attribution-Share Alike (CC BY-SA)
+ *
+ *  This file is part of the Sinric Pro ESP32 Business SDK (https://github.com/sinricpro/esp32-business-sdk)
+ */
+
+#include <Arduino.h>
+#include <atomic>
+#include "ProvLog.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef DEBUG_ESP_PORT
+  #define PROV_LOG_PORT DEBUG_ESP_PORT
+#else
+  #define PROV_LOG_PORT Serial
+#endif
+
+static_assert((PROV_LOG_BUFFER_SIZE & (PROV_LOG_BUFFER_SIZE - 1)) == 0, "PROV_LOG_BUFFER_SIZE must be a power of two");
+
+/*
+ * Ring layout, all in 32-bit words:
+ *   header   words (16 bit, 0 = not committed yet), level (8 bit), argument count (8 bit)
+ *   format   pointer to the format string
+ *   time     ms since boot
+ *   strings  bit n set: argument n is a string
+ *   args     a value word, or for strings a length word followed by the padded characters
+ *
+ * Producers reserve space with a CAS on m_head and publish by storing the header last. The log
+ * task formats committed records in order, zeroes them and advances m_tail. A record that does
+ * not fit before the end of the ring is preceded by a padding record (level 0xFF).
+ */
+namespace {
+  const uint32_t RING_WORDS = PROV_LOG_BUFFER_SIZE / 4;
+  const uint8_t LEVEL_PADDING = 0xFF;
+
+  uint32_t s_ring[RING_WORDS];
+  std::atomic<uint32_t> s_head(0);  // words reserved, monotonic
+  std::atomic<uint32_t> s_tail(0);  // words consumed, monotonic
+  std::atomic<uint32_t> s_dropped(0);
+  std::atomic<bool> s_taskStarted(false);
+
+  inline uint32_t makeHeader(uint32_t words, uint8_t level, uint8_t count) {
+    return words | ((uint32_t)level << 16) | ((uint32_t)count << 24);
+  }
+
+  inline void publish(uint32_t index, uint32_t header) {
+    __atomic_store_n(&s_ring[index], header, __ATOMIC_RELEASE);
+  }
+
+  const char LEVEL_LETTERS[] = "?EWID";
+
+  // Formats one conversion at a time, so the raw arguments never need a va_list.
+  size_t formatRecord(const uint32_t* record, char* out, size_t size) {
+    uint8_t count = record[0] >> 24;
+    const char* format = (const char*)record[1];
+    uint32_t strings = record[3];
+    const uint32_t* arg = record + 4;
+
+    size_t len = 0;
+    uint8_t index = 0;
+    while (*format && len + 1 < size) {
+      if (*format != '%') {
+        out[len++] = *format++;
+        continue;
+      }
+      if (format[1] == '%') {
+        out[len++] = '%';
+        format += 2;
+        continue;
+      }
+
+      // Copy the conversion spec without length modifiers: every argument is 32 bits wide.
+      char spec[16];
+      size_t specLen = 0;
+      spec[specLen++] = *format++;
+      while (*format && !strchr("diouxXcsp", *format)) {
+        if (!strchr("hlzjt", *format) && specLen < sizeof(spec) - 2) spec[specLen++] = *format;
+        format++;
+      }
+      if (!*format) break;
+      char conversion = *format++;
+      spec[specLen++] = conversion;
+      spec[specLen] = '\0';
+
+      if (index >= count) break;
+      int written;
+      if (strings & (1UL << index)) {
+        uint32_t strLen = *arg++;
+        char str[PROV_LOG_MAX_STRING + 1];
+        memcpy(str, arg, strLen);
+        str[strLen] = '\0';
+        arg += (strLen + 3) / 4;
+        written = snprintf(out + len, size - len, spec, str);
+      } else if (conversion == 'd' || conversion == 'i') {
+        written = snprintf(out + len, size - len, spec, (int)*arg++);
+      } else if (conversion == 'p') {
+        written = snprintf(out + len, size - len, spec, (void*)*arg++);
+      } else if (conversion == 's') {
+        written = snprintf(out + len, size - len, "%s", "(null)");
+        arg++;
+      } else {
+        written = snprintf(out + len, size - len, spec, (unsigned)*arg++);
+      }
+      index++;
+      if (written > 0) len += min((size_t)written, size - len - 1);
+    }
+    out[len] = '\0';
+    return len;
+  }
+
+  // Formats and prints every committed record. Returns false when the ring is empty.
+  bool drain() {
+    bool printed = false;
+    while (true) {
+      uint32_t tail = s_tail.load(std::memory_order_relaxed);
+      if (tail == s_head.load(std::memory_order_acquire)) return printed;
+
+      uint32_t index = tail % RING_WORDS;
+      uint32_t header = __atomic_load_n(&s_ring[index], __ATOMIC_ACQUIRE);
+      if (header == 0) return printed;  // reserved, not written yet
+
+      uint32_t words = header & 0xFFFF;
+      uint8_t level = (header >> 16) & 0xFF;
+      if (level != LEVEL_PADDING) {
+        char line[256];
+        int prefix = snprintf(line, sizeof(line), "%c (%u) ", LEVEL_LETTERS[level < sizeof(LEVEL_LETTERS) - 1 ? level : 0], (unsigned)s_ring[index + 2]);
+        formatRecord(&s_ring[index], line + prefix, sizeof(line) - prefix);
+        PROV_LOG_PORT.print(line);
+        printed = true;
+      }
+
+      memset(&s_ring[index], 0, words * 4);
+      s_tail.store(tail + words, std::memory_order_release);
+    }
+  }
+
+  void logTask(void*) {
+    uint32_t reported = 0;
+    while (true) {
+      drain();
+      uint32_t dropped = s_dropped.load(std::memory_order_relaxed);
+      if (dropped != reported) {
+        PROV_LOG_PORT.printf("W [ProvLog]: %u messages dropped\r\n", (unsigned)(dropped - reported));
+        reported = dropped;
+      }
+      vTaskDelay(pdMS_TO_TICKS(PROV_LOG_FLUSH_MS));
+    }
+  }
+
+  void startTask() {
+    bool expected = false;
+    if (s_taskStarted.compare_exchange_strong(expected, true)) {
+      xTaskCreate(logTask, "ProvLogTask", 3072, nullptr, PROV_LOG_TASK_PRIORITY, nullptr);
+    }
+  }
+}
+
+void ProvLog::record(uint8_t level, const char* format, const ProvLogArg* args, uint8_t count) {
+  if (count > 32) count = 32;
+
+  uint32_t strings = 0;
+  uint32_t words = 4;
+  for (uint8_t i = 0; i < count; i++) {
+    if (args[i].str) {
+      strings |= 1UL << i;
+      words += 1 + (min(strlen(args[i].str), (size_t)PROV_LOG_MAX_STRING) + 3) / 4;
+    } else {
+      words += 1;
+    }
+  }
+
+  if (words > RING_WORDS / 2) {
+    s_dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  // Reserve, with padding if the record would wrap.
+  uint32_t head = s_head.load(std::memory_order_relaxed);
+  uint32_t start, padding;
+  do {
+    uint32_t index = head % RING_WORDS;
+    padding = index + words > RING_WORDS ? RING_WORDS - index : 0;
+    if (head + padding + words - s_tail.load(std::memory_order_acquire) > RING_WORDS) {
+      s_dropped.fetch_add(1, std::memory_order_relaxed);
+      startTask();
+      return;
+    }
+    start = head + padding;
+  } while (!s_head.compare_exchange_weak(head, start + words, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+  if (padding) publish(head % RING_WORDS, makeHeader(padding, LEVEL_PADDING, 0));
+
+  uint32_t* record = &s_ring[start % RING_WORDS];
+  record[1] = (uint32_t)format;
+  record[2] = (uint32_t)(esp_timer_get_time() / 1000);
+  record[3] = strings;
+  uint32_t* arg = record + 4;
+  for (uint8_t i = 0; i < count; i++) {
+    if (args[i].str) {
+      uint32_t len = min(strlen(args[i].str), (size_t)PROV_LOG_MAX_STRING);
+      *arg++ = len;
+      memcpy(arg, args[i].str, len);
+      arg += (len + 3) / 4;
+    } else {
+      *arg++ = args[i].value;
+    }
+  }
+  publish(start % RING_WORDS, makeHeader(words, level, count));
+
+  startTask();
+}
+
+void ProvLog::flush(uint32_t timeoutMs) {
+  uint32_t target = s_head.load(std::memory_order_acquire);
+  unsigned long start = millis();
+  while ((int32_t)(s_tail.load(std::memory_order_acquire) - target) < 0 && millis() - start < timeoutMs) {
+    delay(5);
+  }
+}
+
+uint32_t ProvLog::dropped() {
+  return s_dropped.load(std::memory_order_relaxed);
+}
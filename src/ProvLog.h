@@ -0,0 +1,87 @@
+/*
+ *  Copyright (c) 2019 - 2024 Sinric. All rights reserved.
+ *  Licensed under Creative Commons Attribution-Share Alike (CC BY-SA)
+ *
+ *  This file is part of the Sinric Pro ESP32 Business SDK (https://github.com/sinricpro/esp32-business-sdk)
+ *
+ *  @brief Deferred logging: call sites store the format string pointer and the raw arguments in a
+ *  lock-free ring, a low priority task formats and prints them.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <type_traits>
+#include "ProvSettings.h"
+
+#define PROV_LOG_NONE   0
+#define PROV_LOG_ERROR  1
+#define PROV_LOG_WARN   2
+#define PROV_LOG_INFO   3
+#define PROV_LOG_DEBUG  4
+
+#ifndef PROV_LOG_LEVEL
+  #if defined(DEBUG_PROV_LOG)
+    #define PROV_LOG_LEVEL  PROV_LOG_DEBUG
+  #elif defined(CORE_DEBUG_LEVEL)
+    #define PROV_LOG_LEVEL  (CORE_DEBUG_LEVEL < PROV_LOG_DEBUG ? CORE_DEBUG_LEVEL : PROV_LOG_DEBUG)
+  #else
+    #define PROV_LOG_LEVEL  PROV_LOG_NONE
+  #endif
+#endif
+
+#ifndef PROV_LOG_BUFFER_SIZE
+#define PROV_LOG_BUFFER_SIZE     2048              // Log ring size in bytes, power of two. Messages are dropped when full
+#endif
+#ifndef PROV_LOG_MAX_STRING
+#define PROV_LOG_MAX_STRING      64                // %s arguments are copied into the ring, truncated to this length
+#endif
+#ifndef PROV_LOG_TASK_PRIORITY
+#define PROV_LOG_TASK_PRIORITY   0                 // Formatting and printing only runs when nothing else wants the CPU
+#endif
+#ifndef PROV_LOG_FLUSH_MS
+#define PROV_LOG_FLUSH_MS        50                // Log task poll period
+#endif
+
+/**
+ * @brief One log argument: a 32-bit value or a string that is copied when the message is recorded.
+ * Floating point and 64-bit values are not supported.
+ */
+struct ProvLogArg {
+  const char* str;
+  uint32_t value;
+
+  ProvLogArg() : str(nullptr), value(0) {}
+  ProvLogArg(const char* s) : str(s ? s : "(null)"), value(0) {}
+  ProvLogArg(char* s) : ProvLogArg((const char*)s) {}
+  template <typename T, typename = typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type>
+  ProvLogArg(T v) : str(nullptr), value((uint32_t)v) {}
+  template <typename T>
+  ProvLogArg(T* p) : str(nullptr), value((uint32_t)(uintptr_t)p) {}
+};
+
+class ProvLog {
+  public:
+    /**
+     * @brief Record a message. Never blocks and never formats. Any task.
+     * @param format printf style format with a static lifetime (a literal)
+     */
+    template <typename... Args>
+    static void write(uint8_t level, const char* format, Args... args) {
+      const ProvLogArg packed[] = { ProvLogArg(args)..., ProvLogArg() };
+      record(level, format, packed, sizeof...(Args));
+    }
+
+    /**
+     * @brief Wait until the log task has printed everything recorded so far.
+     */
+    static void flush(uint32_t timeoutMs = 200);
+
+    /**
+     * @brief Messages lost because the ring was full.
+     */
+    static uint32_t dropped();
+
+  private:
+    static void record(uint8_t level, const char* format, const ProvLogArg* args, uint8_t count);
+};
@@ -7,7 +7,7 @@
 
 #pragma once 
  
-// #define DEBUG_PROV_LOG   // Print provisioning debug logs
+// #define DEBUG_PROV_LOG   // Print all provisioning logs. Otherwise the level follows CORE_DEBUG_LEVEL, see ProvLog.h
 
 // DO NOT CHANGE !! 
 #define DEFAULT_BLE_PROV_TIMEOUT      60000 * 45          // BLE provisioning timeout. Default 45 mins.
@@ -15,4 +15,33 @@
 #define BLE_PROV_VERSION              1                   // provisioning protocol version
 #define BLE_FRAGMENT_SIZE             180                 // BLE message size. Capped at 180 because IPhone 8 limitations.
 #define PRODUCT_CONFIG_FILE           "/prod_config.json" // product configuration file 
-#define BUSINESS_SDK_VERSION          "1.1.5"             // SDK version  
\ No newline at end of file
+#define BUSINESS_SDK_VERSION          "2.0.0"             // SDK version
+
+// Tunables. Override with build flags.
+#ifndef BLE_PROV_CRYPTO_TASK_STACK_SIZE
+#define BLE_PROV_CRYPTO_TASK_STACK_SIZE  12288             // Key exchange task stack. MbedTLS RSA needs a large stack
+#endif  
+
+#ifndef BLE_PROV_KEY_EXCHANGE
+#define BLE_PROV_KEY_EXCHANGE            RsaKeyExchange    // Session key exchange policy, see CryptoMbedTLS.h. The provisioning app speaks RSA
+#endif
+
+#ifndef BLE_PROV_COMPACT
+#define BLE_PROV_COMPACT                 0                 // 1: one write and one notify characteristic carrying ProvOpcode tagged messages instead of one pair per command
+#endif
+
+#ifndef BREADCRUMB_COUNT
+#define BREADCRUMB_COUNT                 32                // Breadcrumbs kept in RTC memory across resets (20 bytes each)
+#endif
+
+#ifndef TRACE_EVENT_COUNT
+#define TRACE_EVENT_COUNT                0                 // Trace events kept in RAM (16 bytes each). 0 compiles TRACE_* out
+#endif
+
+#ifndef JSON_ARENA_SIZE
+#define JSON_ARENA_SIZE                  8192              // JsonArena in internal RAM when there is no PSRAM, taken before setup(). 0: documents use the heap
+#endif
+
+#ifndef JSON_ARENA_PSRAM_SIZE
+#define JSON_ARENA_PSRAM_SIZE            65536             // JsonArena in PSRAM with BOARD_HAS_PSRAM, taken by JsonArena::begin() or the first document. 0: never use PSRAM
+#endif
@@ -7,6 +7,8 @@
 
 #pragma once 
 
+#include "Breadcrumbs.h"
+
 #define IDLE              0
 #define WAIT_WIFI_CONFIG  1
 #define CONNECTING_WIFI   2
@@ -24,5 +26,5 @@ private:
 public:
   static ProvState& getInstance();
   int getState() const { return m_state; }
-  void setState(int newState) { m_state = newState; } 
+  void setState(int newState) { m_state = newState; BREADCRUMB("prov", newState); } 
 }; 
\ No newline at end of file
@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2019 - 2024 Sinric. All rights reserved.
+ *  Licensed under Creative Commons Attribution-Share Alike (CC BY-SA)
+ *
+ *  This file is part of the Sinric Pro ESP32 Business SDK (https://github.com/sinricpro/esp32-business-sdk)
+ */
+
+#include "ProvTrace.h"
+
+namespace {
+  class StringPrint : public Print {
+    public:
+      StringPrint(std::string& out) : m_out(out) {}
+      size_t write(uint8_t c) override { m_out += (char)c; return 1; }
+      size_t write(const uint8_t* buffer, size_t size) override { m_out.append((const char*)buffer, size); return size; }
+
+    private:
+      std::string& m_out;
+  };
+}
+
+void ProvTrace::dump(std::string& out, bool clear) {
+  StringPrint print(out);
+  dump(print, clear);
+}
+
+#if TRACE_EVENT_COUNT > 0
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define TRACE_TASK_COUNT  16
+
+struct TraceTask_t {
+  uint32_t task;
+  char name[configMAX_TASK_NAME_LEN];
+};
+
+static TraceEvent_t s_events[TRACE_EVENT_COUNT];
+static uint32_t s_head = 0;  // total number of events added
+static uint32_t s_first = 0;  // first event not cleared
+static bool s_paused = false;
+static TraceTask_t s_tasks[TRACE_TASK_COUNT];  // names of the tasks seen, kept after a task is deleted
+static uint8_t s_taskCount = 0;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void ProvTrace::add(char phase, const char* name, uint16_t arg) {
+  TraceEvent_t event;
+  event.time = (uint32_t)esp_timer_get_time();
+  event.name = name;
+  event.task = (uint32_t)xTaskGetCurrentTaskHandle();
+  event.phase = phase;
+  event.core = xPortGetCoreID();
+  event.arg = arg;
+
+  portENTER_CRITICAL_SAFE(&s_lock);
+  if (!s_paused) {
+    s_events[s_head % TRACE_EVENT_COUNT] = event;
+    s_head++;
+
+    uint8_t i = 0;
+    while (i < s_taskCount && s_tasks[i].task != event.task) i++;
+    if (i == s_taskCount && i < TRACE_TASK_COUNT) {
+      const char* taskName = pcTaskGetName(NULL);
+      s_tasks[i].task = event.task;
+      strlcpy(s_tasks[i].name, taskName ? taskName : "?", sizeof(s_tasks[i].name));
+      s_taskCount++;
+    }
+  }
+  portEXIT_CRITICAL_SAFE(&s_lock);
+}
+
+void ProvTrace::dump(Print& out, bool clear) {
+  portENTER_CRITICAL(&s_lock);
+  s_paused = true;
+  uint32_t head = s_head;
+  portEXIT_CRITICAL(&s_lock);
+
+  // Nothing writes while paused, so the ring can be read without the lock.
+  uint32_t first = head - s_first > TRACE_EVENT_COUNT ? head - TRACE_EVENT_COUNT : s_first;
+  out.printf("TRACE v1 %u %u %u\r\n", (unsigned)(head - first), (unsigned)(first - s_first), (unsigned)esp_timer_get_time());
+  for (uint8_t i = 0; i < s_taskCount; i++) {
+    out.printf("TRACE T %08x %s\r\n", (unsigned)s_tasks[i].task, s_tasks[i].name);
+  }
+  for (uint32_t i = first; i < head; i++) {
+    const TraceEvent_t& event = s_events[i % TRACE_EVENT_COUNT];
+    out.printf("TRACE E %u %c %u %08x %u %s\r\n", (unsigned)event.time, event.phase, event.core, (unsigned)event.task, event.arg, event.name);
+  }
+  out.print("TRACE END\r\n");
+
+  portENTER_CRITICAL(&s_lock);
+  if (clear) s_first = head;
+  s_paused = false;
+  portEXIT_CRITICAL(&s_lock);
+}
+
+#else
+
+void ProvTrace::add(char phase, const char* name, uint16_t arg) {}
+
+void ProvTrace::dump(Print& out, bool clear) {
+  out.print("TRACE v1 0 0 0\r\nTRACE END\r\n");
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2019 - 2024 Sinric. All rights reserved.
+ *  Licensed under Creative Commons Attribution-Share Alike (CC BY-SA)
+ *
+ *  This file is part of the Sinric Pro ESP32 Business SDK (https://github.com/sinricpro/esp32-business-sdk)
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <string>
+#include "ProvSettings.h"
+
+/**
+ * @brief One trace event. 16 bytes.
+ */
+struct TraceEvent_t {
+  uint32_t time;     // us since boot
+  const char* name;  // string literal
+  uint32_t task;     // task handle
+  char phase;        // 'B' begin, 'E' end, 'i' instant
+  uint8_t core;
+  uint16_t arg;      // event specific value
+};
+
+/**
+ * @brief Begin/end events in a fixed RAM ring, dumped as text for extras/tools/trace_to_chrome.py.
+ *
+ * Recording takes a spinlock and copies 16 bytes; the oldest events are overwritten when the
+ * ring is full. Names must be string literals. With TRACE_EVENT_COUNT 0 (the default) the
+ * TRACE_* macros compile to nothing.
+ *
+ *     void handleWiFiList() {
+ *       TRACE_SCOPE("wifiList");
+ *       ...
+ *     }
+ *
+ * dump() writes one line per event, prefixed with "TRACE", so it can be cut from a serial log:
+ *
+ *     TRACE v1 <events> <overwritten> <now us>
+ *     TRACE T <task> <task name>
+ *     TRACE E <time us> <phase> <core> <task> <arg> <name>
+ *     TRACE END
+ */
+class ProvTrace {
+  public:
+    static void add(char phase, const char* name, uint16_t arg = 0);
+
+    /**
+     * @brief Print the recorded events, oldest first. Recording is paused meanwhile.
+     * @param clear Drop the printed events.
+     */
+    static void dump(Print& out, bool clear = false);
+    static void dump(std::string& out, bool clear = false);
+};
+
+class ProvTraceScope {
+  public:
+    ProvTraceScope(const char* name, uint16_t arg = 0) : m_name(name) { ProvTrace::add('B', name, arg); }
+    ~ProvTraceScope() { ProvTrace::add('E', m_name); }
+
+  private:
+    const char* m_name;
+};
+
+#if TRACE_EVENT_COUNT > 0
+  #define TRACE_CONCAT_(a, b) a##b
+  #define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+  #define TRACE_BEGIN(name, ...)  ProvTrace::add('B', name, ##__VA_ARGS__)
+  #define TRACE_END(name, ...)    ProvTrace::add('E', name, ##__VA_ARGS__)
+  #define TRACE_INSTANT(name, ...) ProvTrace::add('i', name, ##__VA_ARGS__)
+  #define TRACE_SCOPE(name, ...)  ProvTraceScope TRACE_CONCAT(traceScope, __LINE__)(name, ##__VA_ARGS__)
+#else
+  #define TRACE_BEGIN(name, ...)   do { } while (0)
+  #define TRACE_END(name, ...)     do { } while (0)
+  #define TRACE_INSTANT(name, ...) do { } while (0)
+  #define TRACE_SCOPE(name, ...)   do { } while (0)
+#endif
@@ -35,9 +35,10 @@ String ProvUtil::getMacAddress() {
 }
 
 std::string ProvUtil::to_string(int a) {
-   std::ostringstream ss;
-   ss << a;
-   return ss.str(); 
+   // Not std::ostringstream: iostreams add tens of KB of flash
+   char buffer[12];
+   snprintf(buffer, sizeof(buffer), "%d", a);
+   return std::string(buffer);
 }
 
 //wait approx. [period] ms
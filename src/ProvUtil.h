@@ -7,7 +7,7 @@
 
 #pragma once 
 #include <Arduino.h>
-#include <sstream>
+#include <string>
 #include "esp_system.h"
 #include <WiFi.h>
 
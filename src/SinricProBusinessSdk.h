@@ -5,4 +5,7 @@
  *  This file is part of the Sinric Pro ESP32 Business SDK (https://github.com/sinricpro/esp32-business-sdk)
  */
 
-#include "WiFiProv.h"
\ No newline at end of file
+#include "WiFiProv.h"
+#include "Breadcrumbs.h"
+#include "ProvTrace.h"
+#include "JsonArena.h"
\ No newline at end of file
@@ -49,13 +49,15 @@ bool WiFiProv::hasProvisioned() {
  *      Provisioning failed
  */
 bool WiFiProv::beginProvision() {
+  JsonArena::instance()->begin();  // PSRAM is in the heap by now
+
   if(!m_wifiCredentialsCallback) {
-    DEBUG_PROV(PSTR("[WiFiProv.beginProvision()]: WiFi credential callback not set! Cannot continue!!"));
+    DEBUG_PROV_ERROR(PSTR("[WiFiProv.beginProvision()]: WiFi credential callback not set! Cannot continue!!"));
     return false;
   }
 
   if(!m_cloudCredentialsCallback) {
-    DEBUG_PROV(PSTR("[WiFiProv.beginProvision()]: Cloud credential callback not set! Cannot continue!!"));
+    DEBUG_PROV_ERROR(PSTR("[WiFiProv.beginProvision()]: Cloud credential callback not set! Cannot continue!!"));
     return false;
   }  
 
@@ -63,7 +65,7 @@ bool WiFiProv::beginProvision() {
     m_isConfigured = startBLEConfig(); 
     
     if(!m_isConfigured) {
-      DEBUG_PROV(PSTR("[WiFiProv.beginProvision()]: Provisioing failed!...\r\n"));
+      DEBUG_PROV_ERROR(PSTR("[WiFiProv.beginProvision()]: Provisioing failed!...\r\n"));
     }
   } else {
     DEBUG_PROV(PSTR("[WiFiProv.beginProvision()]: Already provisioned!"));
@@ -78,13 +80,15 @@ WiFiProv::~WiFiProv(){}
 /**
 * @brief Gets called when appkey/appsecret and device ids are recevied by the app.
 * @param config
-*      appkey/appsecret and device ids in json format
+*      appkey/appsecret and device ids in json format, the decrypted BLE buffer
+* @param length
+*      length of config
 * @return
 *      ok
 */ 
-bool WiFiProv::onBleCloudCredetials(const String &config) {
-  DEBUG_PROV(PSTR("[WiFiProv.onAuthCredetials()]: JSON: %s\r\n"), config.c_str());  
-  return m_cloudCredentialsCallback(config);
+bool WiFiProv::onBleCloudCredetials(const char* config, size_t length) {
+  DEBUG_PROV(PSTR("[WiFiProv.onAuthCredetials()]: JSON: %u bytes\r\n"), length);  
+  return m_cloudCredentialsCallback(config, length);
 }
 
 /**
@@ -98,17 +102,19 @@ void WiFiProv::onCloudCredentials(CloudCredentialsCallback cb) {
 /**
 * @brief Gets called when wifi credentials are recevied via BLE from the app.
 * @param wifiConfig
-*      WiFi SSID/Password in json format
+*      WiFi SSID/Password in json format, the decrypted BLE buffer
+* @param length
+*      length of wifiConfig
 * @return
 *      ok
 */ 
-bool WiFiProv::onBleWiFiCredetials(String wifiConfig) {
+bool WiFiProv::onBleWiFiCredetials(const char* wifiConfig, size_t length) {
   bool success = false;
  
-  JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, wifiConfig);
+  JsonDocument doc(JsonArena::instance());
+  DeserializationError error = deserializeJson(doc, wifiConfig, length);
   if (error) {
-      DEBUG_PROV(PSTR("[WiFiProv.onBleWiFiCredetials()]: deserializeJson() failed: %s"), error.c_str());
+      DEBUG_PROV_ERROR(PSTR("[WiFiProv.onBleWiFiCredetials()]: deserializeJson() failed: %s"), error.c_str());
       return false;
   }
 
@@ -167,8 +173,8 @@ bool WiFiProv::startBLEConfig() {
   DEBUG_PROV(PSTR("[WiFiProv.startBLEConfig()]: Setup BLE provisioning.. \r\n"));
 
   // Setup callbacks from BLE  
-  BLEProv.onWiFiCredentials(std::bind(&WiFiProv::onBleWiFiCredetials, this, std::placeholders::_1));
-  BLEProv.onCloudCredentials(std::bind(&WiFiProv::onBleCloudCredetials, this, std::placeholders::_1));
+  BLEProv.onWiFiCredentials(std::bind(&WiFiProv::onBleWiFiCredetials, this, std::placeholders::_1, std::placeholders::_2));
+  BLEProv.onCloudCredentials(std::bind(&WiFiProv::onBleCloudCredetials, this, std::placeholders::_1, std::placeholders::_2));
   BLEProv.onBleProvDone(std::bind(&WiFiProv::onBleProvDone, this));
   
   String bleHostName = String();
@@ -205,7 +211,7 @@ bool WiFiProv::startBLEConfig() {
         BLEProv.stop(); 
         BLEProv.deinit();
         delay(1000);         
-        DEBUG_PROV(PSTR("[WiFiProv.startBLEConfig()]: BLE config timed out!\r\n"));  
+        DEBUG_PROV_ERROR(PSTR("[WiFiProv.startBLEConfig()]: BLE config timed out!\r\n"));  
         provState.setState(TIMEOUT);
         break;
     } 
@@ -220,6 +226,7 @@ bool WiFiProv::startBLEConfig() {
  */
 void WiFiProv::restart() {
   DEBUG_PROV(PSTR("[WiFiProv.restart()]: Restarting ESP ..\r\n"));
+  ProvLog::flush();
   ESP.restart();
   while(1){}  
 }
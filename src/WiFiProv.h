@@ -20,7 +20,9 @@ class WiFiProv {
   public:
     using ProvDoneCallback = std::function<void(void)>;
     using WiFiCredentialsCallback = std::function<bool(const char* ssid, const char* password)>;
-    using CloudCredentialsCallback = std::function<bool(const String &config)>;
+    // The decrypted JSON, NUL terminated and only valid during the call. Parse it or store it, do not keep the pointer.
+    // Was bool(const String& config) before 2.0.0: String(config, length) gives the old argument.
+    using CloudCredentialsCallback = std::function<bool(const char* config, size_t length)>;
     using LoopCallback = std::function<void(int state)>;
     
     WiFiProv(const String &retailItemId);
@@ -38,11 +40,11 @@ class WiFiProv {
     void restart();
     
     // BLE
-    bool onBleWiFiCredetials(String wifiConfig);
+    bool onBleWiFiCredetials(const char* wifiConfig, size_t length);
     bool startBLEConfig();
     void onBleProvDone();
     void onProvDone(ProvDoneCallback cb);
-    bool onBleCloudCredetials(const String &config);  
+    bool onBleCloudCredetials(const char* config, size_t length);
  
     bool m_isConfigured;
     int m_timeout = DEFAULT_BLE_PROV_TIMEOUT;